@@ -1,4 +1,5 @@
 #include <cassert>
+#include <sstream>
 
 #include "cereal/messaging/msgq_to_zmq.h"
 #include "cereal/services.h"
@@ -19,16 +20,32 @@ static std::vector<std::string> get_services(std::string whitelist_str, bool zmq
   return service_list;
 }
 
-void msgq_to_zmq(const std::vector<std::string> &endpoints, const std::string &ip) {
-  MsgqToZmq bridge;
+// BRIDGE_MAX_RATE="service:hz,service:hz" caps how often each service is sent.
+// Only the latest message of each interval is sent, for services where older values are stale
+static std::map<std::string, float> get_max_rates() {
+  std::map<std::string, float> max_rates;
+  std::istringstream stream(util::getenv("BRIDGE_MAX_RATE", ""));
+  std::string entry;
+  while (std::getline(stream, entry, ',')) {
+    size_t pos = entry.find(':');
+    if (pos != std::string::npos) {
+      max_rates[entry.substr(0, pos)] = std::stof(entry.substr(pos + 1));
+    }
+  }
+  return max_rates;
+}
+
+void msgq_to_zmq(const std::vector<std::string> &endpoints, const std::string &ip, bool compress) {
+  MsgqToZmq bridge(get_max_rates(), compress);
   bridge.run(endpoints, ip);
 }
 
-void zmq_to_msgq(const std::vector<std::string> &endpoints, const std::string &ip) {
+void zmq_to_msgq(const std::vector<std::string> &endpoints, const std::string &ip, bool compress) {
   auto poller = std::make_unique<ZMQPoller>();
   auto pub_context = std::make_unique<MSGQContext>();
   auto sub_context = std::make_unique<ZMQContext>();
   std::map<SubSocket *, PubSocket *> sub2pub;
+  std::map<SubSocket *, BridgeDecoder> decoders;
 
   for (auto endpoint : endpoints) {
     auto pub_sock = new MSGQPubSocket();
@@ -42,9 +59,20 @@ void zmq_to_msgq(const std::vector<std::string> &endpoints, const std::string &i
 
   while (!do_exit) {
     for (auto sub_sock : poller->poll(100)) {
-      std::unique_ptr<Message> msg(sub_sock->receive(true));
-      if (msg) {
-        sub2pub[sub_sock]->sendMessage(msg.get());
+      // the publisher coalesces messages, drain what arrived together
+      for (int i = 0; i < 200; ++i) {
+        std::unique_ptr<Message> msg(sub_sock->receive(true));
+        if (!msg) break;
+
+        PubSocket *pub_sock = sub2pub[sub_sock];
+        if (compress) {
+          // frames that can't be decoded yet, before the dictionary arrives, are dropped
+          decoders[sub_sock].decode(msg->getData(), msg->getSize(), [=](const char *data, size_t size) {
+            pub_sock->send((char *)data, size);
+          });
+        } else {
+          pub_sock->sendMessage(msg.get());
+        }
       }
     }
   }
@@ -61,11 +89,13 @@ int main(int argc, char **argv) {
   std::string ip = is_zmq_to_msgq ? argv[1] : "127.0.0.1";
   std::string whitelist_str = is_zmq_to_msgq ? std::string(argv[2]) : "";
   std::vector<std::string> endpoints = get_services(whitelist_str, is_zmq_to_msgq);
+  // both ends of the bridge need the same setting
+  bool compress = util::getenv("BRIDGE_COMPRESS", 0) != 0;
 
   if (is_zmq_to_msgq) {
-    zmq_to_msgq(endpoints, ip);
+    zmq_to_msgq(endpoints, ip, compress);
   } else {
-    msgq_to_zmq(endpoints, ip);
+    msgq_to_zmq(endpoints, ip, compress);
   }
   return 0;
 }
@@ -0,0 +1,180 @@
+#include "cereal/messaging/bridge_codec.h"
+
+#include <cassert>
+#include <cstring>
+
+#include <capnp/serialize-packed.h>
+#include <kj/io.h>
+#include <zdict.h>
+
+// messages the dictionary is trained on
+constexpr size_t DICT_SAMPLES = 500;
+constexpr size_t DICT_SIZE = 16 * 1024;
+// sanity limit for a decompressed window, and for a message in it
+constexpr size_t MAX_WINDOW_SIZE = 64 * 1024 * 1024;
+
+static void xor_words(char *dst, const char *src, size_t size) {
+  for (size_t i = 0; i < size; i += sizeof(uint64_t)) {
+    uint64_t a, b;
+    memcpy(&a, dst + i, sizeof(a));
+    memcpy(&b, src + i, sizeof(b));
+    a ^= b;
+    memcpy(dst + i, &a, sizeof(a));
+  }
+}
+
+BridgeEncoder::BridgeEncoder(int level) : level(level) {
+  cctx = ZSTD_createCCtx();
+  assert(cctx);
+}
+
+BridgeEncoder::~BridgeEncoder() {
+  ZSTD_freeCDict(cdict);
+  ZSTD_freeCCtx(cctx);
+}
+
+void BridgeEncoder::add(const char *data, size_t size) {
+  // capnp messages are whole words, which packing relies on
+  assert(size % sizeof(uint64_t) == 0);
+
+  const bool delta = !prev.empty() && prev.size() == size;
+  scratch.assign(data, size);
+  if (delta) {
+    xor_words(scratch.data(), prev.data(), size);
+  }
+  prev.assign(data, size);
+
+  kj::VectorOutputStream packed_out;
+  {
+    capnp::_::PackedOutputStream packed(packed_out);
+    packed.write(scratch.data(), size);
+  }
+  auto packed_data = packed_out.getArray();
+
+  const size_t entry_start = window.size();
+  bridge_msg_header header = {.size = (uint32_t)size, .delta = delta, .packed_size = (uint32_t)packed_data.size()};
+  window.append((const char *)&header, sizeof(header));
+  window.append((const char *)packed_data.begin(), packed_data.size());
+
+  if (!training_done) {
+    samples.append(window, entry_start, std::string::npos);
+    sample_sizes.push_back(window.size() - entry_start);
+    if (sample_sizes.size() == DICT_SAMPLES) {
+      train();
+    }
+  }
+}
+
+void BridgeEncoder::train() {
+  training_done = true;
+
+  std::string dict(DICT_SIZE, '\0');
+  size_t dict_size = ZDICT_trainFromBuffer(dict.data(), dict.size(), samples.data(), sample_sizes.data(), sample_sizes.size());
+  samples = {};
+  sample_sizes = {};
+  if (ZDICT_isError(dict_size)) {
+    // too little or too uniform data to train on, keep compressing without one
+    return;
+  }
+
+  dict.resize(dict_size);
+  cdict = ZSTD_createCDict(dict.data(), dict.size(), level);
+  dict_id = ZDICT_getDictID(dict.data(), dict.size());
+
+  bridge_frame_header header = {.type = BRIDGE_FRAME_DICTIONARY, .dict_id = dict_id};
+  dict_frame.assign((const char *)&header, sizeof(header));
+  dict_frame += dict;
+}
+
+std::string BridgeEncoder::encode() {
+  if (window.empty()) {
+    return {};
+  }
+
+  std::string frame(sizeof(bridge_frame_header) + ZSTD_compressBound(window.size()), '\0');
+  bridge_frame_header header = {.type = BRIDGE_FRAME_DATA, .dict_id = cdict ? dict_id : 0};
+  memcpy(frame.data(), &header, sizeof(header));
+
+  char *dst = frame.data() + sizeof(header);
+  const size_t capacity = frame.size() - sizeof(header);
+  size_t compressed_size = cdict ? ZSTD_compress_usingCDict(cctx, dst, capacity, window.data(), window.size(), cdict)
+                                 : ZSTD_compressCCtx(cctx, dst, capacity, window.data(), window.size(), level);
+  assert(!ZSTD_isError(compressed_size));
+  frame.resize(sizeof(header) + compressed_size);
+
+  window.clear();
+  prev.clear();
+  return frame;
+}
+
+BridgeDecoder::BridgeDecoder() {
+  dctx = ZSTD_createDCtx();
+  assert(dctx);
+}
+
+BridgeDecoder::~BridgeDecoder() {
+  ZSTD_freeDDict(ddict);
+  ZSTD_freeDCtx(dctx);
+}
+
+bool BridgeDecoder::decode(const char *data, size_t size, const std::function<void(const char *, size_t)> &on_message) {
+  if (size < sizeof(bridge_frame_header)) {
+    return false;
+  }
+  bridge_frame_header header;
+  memcpy(&header, data, sizeof(header));
+  data += sizeof(header);
+  size -= sizeof(header);
+
+  if (header.type == BRIDGE_FRAME_DICTIONARY) {
+    if (header.dict_id != dict_id) {
+      ZSTD_freeDDict(ddict);
+      ddict = ZSTD_createDDict(data, size);
+      dict_id = ddict ? header.dict_id : 0;
+    }
+    return ddict != nullptr;
+  } else if (header.type != BRIDGE_FRAME_DATA || (header.dict_id != 0 && header.dict_id != dict_id)) {
+    return false;
+  }
+
+  const unsigned long long window_size = ZSTD_getFrameContentSize(data, size);
+  if (window_size == ZSTD_CONTENTSIZE_ERROR || window_size == ZSTD_CONTENTSIZE_UNKNOWN || window_size > MAX_WINDOW_SIZE) {
+    return false;
+  }
+  window.resize(window_size);
+  size_t ret = header.dict_id != 0 ? ZSTD_decompress_usingDDict(dctx, window.data(), window.size(), data, size, ddict)
+                                   : ZSTD_decompressDCtx(dctx, window.data(), window.size(), data, size);
+  if (ZSTD_isError(ret) || ret != window.size()) {
+    return false;
+  }
+
+  prev.clear();
+  size_t pos = 0;
+  while (pos < window.size()) {
+    bridge_msg_header msg_header;
+    if (pos + sizeof(msg_header) > window.size()) return false;
+    memcpy(&msg_header, &window[pos], sizeof(msg_header));
+    pos += sizeof(msg_header);
+    if (pos + msg_header.packed_size > window.size() || msg_header.size % sizeof(uint64_t) != 0) return false;
+    // the size comes from the network, don't allocate more than a window for it
+    if (msg_header.size > MAX_WINDOW_SIZE) return false;
+
+    msg.resize(msg_header.size);
+    try {
+      kj::ArrayInputStream packed_in(kj::arrayPtr((const kj::byte *)&window[pos], msg_header.packed_size));
+      capnp::_::PackedInputStream unpacked(packed_in);
+      unpacked.read(msg.data(), msg.size());
+    } catch (const kj::Exception &) {
+      return false;
+    }
+    pos += msg_header.packed_size;
+
+    if (msg_header.delta) {
+      if (prev.size() != msg.size()) return false;
+      xor_words(msg.data(), prev.data(), msg.size());
+    }
+    prev = msg;
+    on_message(msg.data(), msg.size());
+  }
+  return true;
+}
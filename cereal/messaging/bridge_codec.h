@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <zstd.h>
+
+// Compressed transport for the bridge, used with BRIDGE_COMPRESS=1 on both ends.
+// A service's messages are sent in windows, one frame per window. Each message is XORed
+// with the previous one in the window if they're the same size, so unchanged fields turn
+// into zero words, then capnp packed, and the window is zstd compressed with a dictionary
+// trained on the service's first messages. Windows don't depend on each other, so frames
+// dropped by ZMQ don't break the stream. The dictionary is sent in-band, and repeated for
+// subscribers that connect later.
+
+enum BridgeFrameType : uint8_t {
+  BRIDGE_FRAME_DATA = 0,
+  BRIDGE_FRAME_DICTIONARY = 1,
+};
+
+struct __attribute__((packed)) bridge_frame_header {
+  uint8_t type;
+  uint32_t dict_id;  // 0 if the frame isn't compressed with a dictionary
+};
+
+struct __attribute__((packed)) bridge_msg_header {
+  uint32_t size;
+  uint8_t delta;
+  uint32_t packed_size;
+};
+
+class BridgeEncoder {
+public:
+  BridgeEncoder(int level = 3);
+  ~BridgeEncoder();
+  BridgeEncoder(const BridgeEncoder&) = delete;
+  BridgeEncoder& operator=(const BridgeEncoder&) = delete;
+  void add(const char *data, size_t size);
+  // finishes the window, empty if nothing was added
+  std::string encode();
+  // empty until enough messages were seen to train the dictionary
+  const std::string &dictionaryFrame() const { return dict_frame; }
+
+private:
+  void train();
+
+  const int level;
+  ZSTD_CCtx *cctx = nullptr;
+  ZSTD_CDict *cdict = nullptr;
+  uint32_t dict_id = 0;
+  std::string dict_frame;
+
+  std::string window;
+  std::string prev;
+  std::string scratch;
+
+  bool training_done = false;
+  std::string samples;
+  std::vector<size_t> sample_sizes;
+};
+
+class BridgeDecoder {
+public:
+  BridgeDecoder();
+  ~BridgeDecoder();
+  BridgeDecoder(const BridgeDecoder&) = delete;
+  BridgeDecoder& operator=(const BridgeDecoder&) = delete;
+  // calls on_message for every message in a data frame, returns false if the
+  // frame is corrupt or its dictionary hasn't been received yet
+  bool decode(const char *data, size_t size, const std::function<void(const char *, size_t)> &on_message);
+
+private:
+  ZSTD_DCtx *dctx = nullptr;
+  ZSTD_DDict *ddict = nullptr;
+  uint32_t dict_id = 0;
+
+  std::string window;
+  std::string msg;
+  std::string prev;
+};
@@ -2,6 +2,7 @@
 
 #include <cstddef>
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 #include <utility>
@@ -17,32 +18,48 @@ public:
   SubMaster(const std::vector<const char *> &service_list, const std::vector<const char *> &poll = {},
             const char *address = nullptr, const std::vector<const char *> &ignore_alive = {});
   void update(int timeout = 1000);
-  void update_msgs(uint64_t current_time, const std::vector<std::pair<std::string, cereal::Event::Reader>> &messages);
+  void update_msgs(uint64_t current_time, const std::vector<std::pair<const char *, cereal::Event::Reader>> &messages);
   inline bool allAlive(const std::vector<const char *> &service_list = {}) { return all_(service_list, false, true); }
   inline bool allValid(const std::vector<const char *> &service_list = {}) { return all_(service_list, true, false); }
   inline bool allAliveAndValid(const std::vector<const char *> &service_list = {}) { return all_(service_list, true, true); }
   void drain();
   ~SubMaster();
 
+  // index of a service, for the accessors below. resolve it once instead of
+  // looking the service up by name every update
+  int index(const char *name) const;
+
   uint64_t frame = 0;
-  bool updated(const char *name) const;
-  bool alive(const char *name) const;
-  bool valid(const char *name) const;
-  uint64_t rcv_frame(const char *name) const;
-  uint64_t rcv_time(const char *name) const;
-  cereal::Event::Reader &operator[](const char *name) const;
+  bool updated(int i) const;
+  bool alive(int i) const;
+  bool valid(int i) const;
+  uint64_t rcv_frame(int i) const;
+  uint64_t rcv_time(int i) const;
+  cereal::Event::Reader &operator[](int i) const;
+
+  inline bool updated(const char *name) const { return updated(index(name)); }
+  inline bool alive(const char *name) const { return alive(index(name)); }
+  inline bool valid(const char *name) const { return valid(index(name)); }
+  inline uint64_t rcv_frame(const char *name) const { return rcv_frame(index(name)); }
+  inline uint64_t rcv_time(const char *name) const { return rcv_time(index(name)); }
+  inline cereal::Event::Reader &operator[](const char *name) const { return (*this)[index(name)]; }
 
 private:
   bool all_(const std::vector<const char *> &service_list, bool valid, bool alive);
   Poller *poller_ = nullptr;
   struct SubMessage;
-  std::map<SubSocket *, SubMessage *> messages_;
-  std::map<std::string, SubMessage *> services_;
+  void receive(SubMessage &m, uint64_t current_time);
+  void update_alive(uint64_t current_time);
+  // state of all services, in service_list order
+  std::unique_ptr<SubMessage[]> messages_;
+  int num_messages_ = 0;
 };
 
 class MessageBuilder : public capnp::MallocMessageBuilder {
 public:
   MessageBuilder() = default;
+  // build into caller owned, zeroed memory. it's zeroed again on destruction, so it can be reused
+  MessageBuilder(kj::ArrayPtr<capnp::word> first_segment) : capnp::MallocMessageBuilder(first_segment) {}
 
   cereal::Event::Builder initEvent(bool valid = true) {
     cereal::Event::Builder event = initRoot<cereal::Event>();
@@ -1,13 +1,23 @@
 #include "cereal/messaging/msgq_to_zmq.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cinttypes>
 
+#include "common/timing.h"
 #include "common/util.h"
 
 extern ExitHandler do_exit;
 
 // Max messages to process per socket per poll
 constexpr int MAX_MESSAGES_PER_SOCKET = 50;
+// Max messages coalesced into one multipart send
+constexpr int MAX_BATCH_SIZE = 200;
+constexpr double STATS_INTERVAL_MS = 10000;
+// With compression, messages are collected for at least this long, so there's history to compress against
+constexpr double COMPRESS_WINDOW_MS = 10;
+// How often the dictionary is repeated for subscribers that connected later
+constexpr double DICT_INTERVAL_MS = 1000;
 
 static std::string recv_zmq_msg(void *sock) {
   zmq_msg_t msg;
@@ -28,6 +38,15 @@ void MsgqToZmq::run(const std::vector<std::string> &endpoints, const std::string
   for (const auto &endpoint : endpoints) {
     auto &socket_pair = socket_pairs.emplace_back();
     socket_pair.endpoint = endpoint;
+    if (auto it = max_rate.find(endpoint); it != max_rate.end() && it->second > 0) {
+      socket_pair.min_send_interval_ms = 1000.0 / it->second;
+      socket_pair.latest_only = true;
+    }
+    if (compress) {
+      // only batches the messages, none are skipped unless the service has a max rate
+      socket_pair.min_send_interval_ms = std::max(socket_pair.min_send_interval_ms, COMPRESS_WINDOW_MS);
+      socket_pair.encoder = std::make_unique<BridgeEncoder>();
+    }
     socket_pair.pub_sock = std::make_unique<ZMQPubSocket>();
     int ret = socket_pair.pub_sock->connect(zmq_context.get(), endpoint);
     if (ret != 0) {
@@ -39,25 +58,53 @@ void MsgqToZmq::run(const std::vector<std::string> &endpoints, const std::string
   // Start ZMQ monitoring thread to monitor socket events
   std::thread thread(&MsgqToZmq::zmqMonitorThread, this);
 
+  // BRIDGE_STATS=1 prints the send rate and compression ratio of each service
+  const bool print_stats = util::getenv("BRIDGE_STATS", 0) != 0;
+
   // Main loop for processing messages
+  double last_stats_ms = millis_since_boot();
   while (!do_exit) {
     {
       std::unique_lock lk(mutex);
-      cv.wait(lk, [this]() { return do_exit || !sub2pub.empty(); });
+      cv.wait(lk, [this]() { return do_exit || !sub2pair.empty(); });
       if (do_exit) break;
 
-      for (auto sub_sock : msgq_poller->poll(100)) {
-        // Process messages for each socket
-        ZMQPubSocket *pub_sock = sub2pub.at(sub_sock);
-        for (int i = 0; i < MAX_MESSAGES_PER_SOCKET; ++i) {
-          auto msg = std::unique_ptr<Message>(sub_sock->receive(true));
+      // don't sleep on the poll while rate capped messages are waiting
+      bool has_pending = false;
+      for (auto &[sub_sock, pair] : sub2pair) {
+        has_pending |= !pair->pending.empty();
+      }
+
+      for (auto sub_sock : msgq_poller->poll(has_pending ? 1 : 100)) {
+        // Coalesce the available messages of each socket, taking over the
+        // msgq buffers so they can be handed to zmq without a copy
+        SocketPair *pair = sub2pair.at(sub_sock);
+        for (int i = 0; i < MAX_MESSAGES_PER_SOCKET && pair->pending.size() < MAX_BATCH_SIZE; ++i) {
+          auto msg = std::unique_ptr<MSGQMessage>((MSGQMessage *)sub_sock->receive(true));
           if (!msg) break;
 
-          while (pub_sock->sendMessage(msg.get()) == -1) {
-            if (errno != EINTR) break;
+          pair->add({std::unique_ptr<char[]>(msg->data), msg->size});
+          msg->data = nullptr;
+          msg->size = 0;
+        }
+      }
+
+      const double now = millis_since_boot();
+      for (auto &[sub_sock, pair] : sub2pair) {
+        if (pair->ready(now)) {
+          if (pair->encoder) {
+            flushCompressed(*pair, now);
+          } else {
+            flush(*pair);
           }
+          pair->last_send_ms = now;
         }
       }
+
+      if (print_stats && now - last_stats_ms >= STATS_INTERVAL_MS) {
+        printStats();
+        last_stats_ms = now;
+      }
     }
     util::sleep_for(1);  // Give zmqMonitorThread a chance to acquire the mutex
   }
@@ -65,6 +112,88 @@ void MsgqToZmq::run(const std::vector<std::string> &endpoints, const std::string
   thread.join();
 }
 
+void MsgqToZmq::SocketPair::add(PendingMessage msg) {
+  if (latest_only && !pending.empty()) {
+    pending.back() = std::move(msg);
+    ++skipped;
+  } else {
+    pending.push_back(std::move(msg));
+  }
+}
+
+bool MsgqToZmq::SocketPair::ready(double now) const {
+  return !pending.empty() && (now - last_send_ms >= min_send_interval_ms || pending.size() >= MAX_BATCH_SIZE);
+}
+
+void MsgqToZmq::flush(SocketPair &pair) {
+  for (size_t i = 0; i < pair.pending.size(); ++i) {
+    const size_t size = pair.pending[i].size;
+    zmq_msg_t zmsg;
+    zmq_msg_init_data(&zmsg, pair.pending[i].data.release(), size, [](void *data, void *) { delete[] (char *)data; }, nullptr);
+
+    // each part is received as one message, so this works with any subscriber
+    const int flags = ZMQ_DONTWAIT | (i + 1 < pair.pending.size() ? ZMQ_SNDMORE : 0);
+    int ret;
+    while ((ret = zmq_msg_send(&zmsg, pair.pub_sock->sock, flags)) == -1 && errno == EINTR) {}
+
+    if (ret == -1) {
+      zmq_msg_close(&zmsg);
+      ++pair.send_errors;
+    } else {
+      ++pair.msgs;
+      pair.bytes += size;
+      pair.raw_bytes += size;
+    }
+  }
+  ++pair.batches;
+  pair.pending.clear();
+}
+
+static bool send_frame(void *sock, const std::string &frame) {
+  int ret;
+  while ((ret = zmq_send(sock, frame.data(), frame.size(), ZMQ_DONTWAIT)) == -1 && errno == EINTR) {}
+  return ret != -1;
+}
+
+void MsgqToZmq::flushCompressed(SocketPair &pair, double now) {
+  size_t raw_bytes = 0;
+  for (auto &msg : pair.pending) {
+    pair.encoder->add(msg.data.get(), msg.size);
+    raw_bytes += msg.size;
+  }
+  const std::string frame = pair.encoder->encode();
+
+  const std::string &dict_frame = pair.encoder->dictionaryFrame();
+  if (!dict_frame.empty() && now - pair.last_dict_ms >= DICT_INTERVAL_MS) {
+    if (send_frame(pair.pub_sock->sock, dict_frame)) {
+      pair.bytes += dict_frame.size();
+      pair.last_dict_ms = now;
+    }
+  }
+
+  if (send_frame(pair.pub_sock->sock, frame)) {
+    pair.msgs += pair.pending.size();
+    pair.bytes += frame.size();
+    pair.raw_bytes += raw_bytes;
+  } else {
+    pair.send_errors += pair.pending.size();
+  }
+  ++pair.batches;
+  pair.pending.clear();
+}
+
+void MsgqToZmq::printStats() {
+  for (auto &pair : socket_pairs) {
+    if (pair.batches == 0) continue;
+
+    printf("[%s] %.1f msgs/s, %.1f kB/s (%.2fx), %.1f msgs/batch, %" PRIu64 " skipped, %" PRIu64 " send errors\n",
+           pair.endpoint.c_str(), pair.msgs * 1000.0 / STATS_INTERVAL_MS, pair.bytes / STATS_INTERVAL_MS,
+           pair.bytes > 0 ? (double)pair.raw_bytes / pair.bytes : 0.0,
+           (double)(pair.msgs + pair.send_errors) / pair.batches, pair.skipped, pair.send_errors);
+    pair.msgs = pair.bytes = pair.raw_bytes = pair.batches = pair.skipped = pair.send_errors = 0;
+  }
+}
+
 void MsgqToZmq::zmqMonitorThread() {
   std::vector<zmq_pollitem_t> pollitems;
 
@@ -109,15 +238,16 @@ void MsgqToZmq::zmqMonitorThread() {
             // Create new MSGQ subscriber socket and map to ZMQ publisher
             pair.sub_sock = std::make_unique<MSGQSubSocket>();
             pair.sub_sock->connect(msgq_context.get(), pair.endpoint, "127.0.0.1");
-            sub2pub[pair.sub_sock.get()] = pair.pub_sock.get();
+            sub2pair[pair.sub_sock.get()] = &pair;
             registerSockets();
           }
         } else if (event_type & ZMQ_EVENT_DISCONNECTED) {
           printf("socket [%s] disconnected\n", pair.endpoint.c_str());
           if (pair.connected_clients == 0 || --pair.connected_clients == 0) {
             // Remove MSGQ subscriber socket from mapping and reset it
-            sub2pub.erase(pair.sub_sock.get());
+            sub2pair.erase(pair.sub_sock.get());
             pair.sub_sock.reset(nullptr);
+            pair.pending.clear();
             registerSockets();
           }
         }
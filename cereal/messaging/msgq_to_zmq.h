@@ -11,27 +11,61 @@
 #include "msgq/impl_msgq.h"
 #include "msgq/impl_zmq.h"
 
+#include "cereal/messaging/bridge_codec.h"
+
 class MsgqToZmq {
 public:
-  MsgqToZmq() {}
+  // max_rate caps how often a service is sent, in Hz. Only the latest message of each
+  // interval is sent, the ones it replaced are skipped.
+  // compress sends each window of messages as one BridgeEncoder frame
+  MsgqToZmq(const std::map<std::string, float> &max_rate = {}, bool compress = false) : max_rate(max_rate), compress(compress) {}
   void run(const std::vector<std::string> &endpoints, const std::string &ip);
 
 protected:
+  struct SocketPair;
   void registerSockets();
   void zmqMonitorThread();
+  void flush(SocketPair &pair);
+  void flushCompressed(SocketPair &pair, double now);
+  void printStats();
+
+  struct PendingMessage {
+    std::unique_ptr<char[]> data;
+    size_t size;
+  };
 
   struct SocketPair {
     std::string endpoint;
     std::unique_ptr<ZMQPubSocket> pub_sock;
     std::unique_ptr<MSGQSubSocket> sub_sock;
     int connected_clients = 0;
+
+    // messages received since the last send, they go out together as one multipart message
+    std::vector<PendingMessage> pending;
+    // set for services with a max rate, a new message replaces the pending one
+    bool latest_only = false;
+    double min_send_interval_ms = 0;
+    double last_send_ms = 0;
+
+    std::unique_ptr<BridgeEncoder> encoder;
+    double last_dict_ms = 0;
+
+    // skipped counts messages replaced because of the max rate. PUB sockets drop messages
+    // silently at the high water mark, so send_errors only counts sends zmq refused
+    uint64_t msgs = 0, bytes = 0, raw_bytes = 0, batches = 0, skipped = 0, send_errors = 0;
+
+    void add(PendingMessage msg);
+    // true once the interval has passed, or a full batch is waiting
+    bool ready(double now) const;
   };
 
+  std::map<std::string, float> max_rate;
+  bool compress;
   std::unique_ptr<MSGQContext> msgq_context;
   std::unique_ptr<ZMQContext> zmq_context;
   std::mutex mutex;
   std::condition_variable cv;
   std::unique_ptr<MSGQPoller> msgq_poller;
-  std::map<SubSocket *, ZMQPubSocket *> sub2pub;
+  std::map<SubSocket *, SocketPair *> sub2pair;
   std::vector<SocketPair> socket_pairs;
 };
@@ -1,7 +1,10 @@
 #include <assert.h>
+#include <string.h>
 #include <stdlib.h>
-#include <string>
+#include <algorithm>
 #include <mutex>
+#include <stdexcept>
+#include <string>
 
 #include "cereal/services.h"
 #include "cereal/messaging/messaging.h"
@@ -46,7 +49,10 @@ struct SubMaster::SubMessage {
 SubMaster::SubMaster(const std::vector<const char *> &service_list, const std::vector<const char *> &poll,
                      const char *address, const std::vector<const char *> &ignore_alive) {
   poller_ = Poller::create();
-  for (auto name : service_list) {
+  messages_ = std::make_unique<SubMessage[]>(service_list.size());
+  num_messages_ = service_list.size();
+  for (int i = 0; i < num_messages_; ++i) {
+    const char *name = service_list[i];
     assert(services.count(std::string(name)) > 0);
 
     service serv = services.at(std::string(name));
@@ -54,86 +60,101 @@ SubMaster::SubMaster(const std::vector<const char *> &service_list, const std::v
     assert(socket != 0);
     bool is_polled = inList(poll, name) || poll.empty();
     if (is_polled) poller_->registerSocket(socket);
-    SubMessage *m = new SubMessage{
-      .name = name,
-      .socket = socket,
-      .freq = serv.frequency,
-      .ignore_alive = inList(ignore_alive, name),
-      .allocated_msg_reader = malloc(sizeof(capnp::FlatArrayMessageReader)),
-      .is_polled = is_polled};
-    m->msg_reader = new (m->allocated_msg_reader) capnp::FlatArrayMessageReader({});
-    messages_[socket] = m;
-    services_[name] = m;
+    SubMessage &m = messages_[i];
+    m.name = name;
+    m.socket = socket;
+    m.freq = serv.frequency;
+    m.ignore_alive = inList(ignore_alive, name);
+    m.allocated_msg_reader = malloc(sizeof(capnp::FlatArrayMessageReader));
+    m.is_polled = is_polled;
+    m.msg_reader = new (m.allocated_msg_reader) capnp::FlatArrayMessageReader({});
   }
 }
 
-void SubMaster::update(int timeout) {
-  for (auto &kv : messages_) kv.second->updated = false;
+int SubMaster::index(const char *name) const {
+  for (int i = 0; i < num_messages_; ++i) {
+    if (strcmp(messages_[i].name.c_str(), name) == 0) return i;
+  }
+  // like the std::map::at this replaced, so a typo doesn't index out of bounds in release builds
+  throw std::out_of_range(std::string("service not subscribed: ") + name);
+}
 
-  auto sockets = poller_->poll(timeout);
+void SubMaster::receive(SubMessage &m, uint64_t current_time) {
+  Message *msg = m.socket->receive(true);
+  if (msg == nullptr) return;
 
-  // add non-polled sockets for non-blocking receive
-  for (auto &kv : messages_) {
-    SubMessage *m = kv.second;
-    SubSocket *s = kv.first;
-    if (!m->is_polled) sockets.push_back(s);
-  }
+  m.msg_reader->~FlatArrayMessageReader();
+  capnp::ReaderOptions options;
+  options.traversalLimitInWords = kj::maxValue; // Don't limit
+  m.msg_reader = new (m.allocated_msg_reader) capnp::FlatArrayMessageReader(m.aligned_buf.align(msg), options);
+  delete msg;
 
-  uint64_t current_time = nanos_since_boot();
+  m.event = m.msg_reader->getRoot<cereal::Event>();
+  m.updated = true;
+  m.rcv_time = current_time;
+  m.rcv_frame = frame;
+  m.valid = m.event.getValid();
+  if (SIMULATION) m.alive = true;
+}
 
-  std::vector<std::pair<std::string, cereal::Event::Reader>> messages;
+void SubMaster::update(int timeout) {
+  for (int i = 0; i < num_messages_; ++i) messages_[i].updated = false;
 
-  for (auto s : sockets) {
-    Message *msg = s->receive(true);
-    if (msg == nullptr) continue;
+  auto sockets = poller_->poll(timeout);
 
-    SubMessage *m = messages_.at(s);
+  uint64_t current_time = nanos_since_boot();
+  if (++frame == UINT64_MAX) frame = 1;
 
-    m->msg_reader->~FlatArrayMessageReader();
-    capnp::ReaderOptions options;
-    options.traversalLimitInWords = kj::maxValue; // Don't limit
-    m->msg_reader = new (m->allocated_msg_reader) capnp::FlatArrayMessageReader(m->aligned_buf.align(msg), options);
-    delete msg;
-    messages.push_back({m->name, m->msg_reader->getRoot<cereal::Event>()});
+  for (int i = 0; i < num_messages_; ++i) {
+    SubMessage &m = messages_[i];
+    // non-polled sockets are always read, without blocking
+    if (!m.is_polled || std::find(sockets.begin(), sockets.end(), m.socket) != sockets.end()) {
+      receive(m, current_time);
+    }
   }
 
-  update_msgs(current_time, messages);
+  update_alive(current_time);
 }
 
-void SubMaster::update_msgs(uint64_t current_time, const std::vector<std::pair<std::string, cereal::Event::Reader>> &messages){
+void SubMaster::update_msgs(uint64_t current_time, const std::vector<std::pair<const char *, cereal::Event::Reader>> &messages){
   if (++frame == UINT64_MAX) frame = 1;
 
-  for (auto &kv : messages) {
-    auto m_find = services_.find(kv.first);
-    if (m_find == services_.end()){
+  for (auto &[name, event] : messages) {
+    int i = 0;
+    while (i < num_messages_ && strcmp(messages_[i].name.c_str(), name) != 0) ++i;
+    if (i == num_messages_) {
       continue;
     }
-    SubMessage *m = m_find->second;
-    m->event = kv.second;
-    m->updated = true;
-    m->rcv_time = current_time;
-    m->rcv_frame = frame;
-    m->valid = m->event.getValid();
-    if (SIMULATION) m->alive = true;
+    SubMessage &m = messages_[i];
+    m.event = event;
+    m.updated = true;
+    m.rcv_time = current_time;
+    m.rcv_frame = frame;
+    m.valid = m.event.getValid();
+    if (SIMULATION) m.alive = true;
   }
 
+  update_alive(current_time);
+}
+
+void SubMaster::update_alive(uint64_t current_time) {
   if (!SIMULATION) {
-    for (auto &kv : messages_) {
-      SubMessage *m = kv.second;
-      m->alive = (m->freq <= (1e-5) || ((current_time - m->rcv_time) * (1e-9)) < (10.0 / m->freq));
+    for (int i = 0; i < num_messages_; ++i) {
+      SubMessage &m = messages_[i];
+      m.alive = (m.freq <= (1e-5) || ((current_time - m.rcv_time) * (1e-9)) < (10.0 / m.freq));
     }
   }
 }
 
 bool SubMaster::all_(const std::vector<const char *> &service_list, bool valid, bool alive) {
   int found = 0;
-  for (auto &kv : messages_) {
-    SubMessage *m = kv.second;
-    if (service_list.size() == 0 || inList(service_list, m->name.c_str())) {
-      found += (!valid || m->valid) && (!alive || (m->alive || m->ignore_alive));
+  for (int i = 0; i < num_messages_; ++i) {
+    SubMessage &m = messages_[i];
+    if (service_list.size() == 0 || inList(service_list, m.name.c_str())) {
+      found += (!valid || m.valid) && (!alive || (m.alive || m.ignore_alive));
     }
   }
-  return service_list.size() == 0 ? found == messages_.size() : found == service_list.size();
+  return service_list.size() == 0 ? found == num_messages_ : found == service_list.size();
 }
 
 void SubMaster::drain() {
@@ -149,38 +170,37 @@ void SubMaster::drain() {
   }
 }
 
-bool SubMaster::updated(const char *name) const {
-  return services_.at(name)->updated;
+bool SubMaster::updated(int i) const {
+  return messages_[i].updated;
 }
 
-bool SubMaster::alive(const char *name) const {
-  return services_.at(name)->alive;
+bool SubMaster::alive(int i) const {
+  return messages_[i].alive;
 }
 
-bool SubMaster::valid(const char *name) const {
-  return services_.at(name)->valid;
+bool SubMaster::valid(int i) const {
+  return messages_[i].valid;
 }
 
-uint64_t SubMaster::rcv_frame(const char *name) const {
-  return services_.at(name)->rcv_frame;
+uint64_t SubMaster::rcv_frame(int i) const {
+  return messages_[i].rcv_frame;
 }
 
-uint64_t SubMaster::rcv_time(const char *name) const {
-  return services_.at(name)->rcv_time;
+uint64_t SubMaster::rcv_time(int i) const {
+  return messages_[i].rcv_time;
 }
 
-cereal::Event::Reader &SubMaster::operator[](const char *name) const {
-  return services_.at(name)->event;
+cereal::Event::Reader &SubMaster::operator[](int i) const {
+  return messages_[i].event;
 }
 
 SubMaster::~SubMaster() {
   delete poller_;
-  for (auto &kv : messages_) {
-    SubMessage *m = kv.second;
-    m->msg_reader->~FlatArrayMessageReader();
-    free(m->allocated_msg_reader);
-    delete m->socket;
-    delete m;
+  for (int i = 0; i < num_messages_; ++i) {
+    SubMessage &m = messages_[i];
+    m.msg_reader->~FlatArrayMessageReader();
+    free(m.allocated_msg_reader);
+    delete m.socket;
   }
 }
 
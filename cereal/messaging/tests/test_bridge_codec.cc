@@ -0,0 +1,120 @@
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "cereal/messaging/bridge_codec.h"
+
+// Messages look like capnp events: whole words, mostly zeros, with a few fields that change.
+// Sizes alternate now and then, so windows mix delta and full messages.
+
+static std::mt19937 rng(1234);
+
+static std::string message(int i) {
+  const size_t words = (i % 7 == 0) ? 24 : 16;
+  std::string msg(words * sizeof(uint64_t), '\0');
+  const uint64_t counter = i, value = rng();
+  memcpy(&msg[8], &counter, sizeof(counter));
+  memcpy(&msg[24 + (i % 4) * 8], &value, sizeof(value));
+  return msg;
+}
+
+static std::vector<std::string> decode(BridgeDecoder &decoder, const std::string &frame, bool expect_ok = true) {
+  std::vector<std::string> msgs;
+  bool ok = decoder.decode(frame.data(), frame.size(), [&](const char *data, size_t size) {
+    msgs.emplace_back(data, size);
+  });
+  REQUIRE(ok == expect_ok);
+  return msgs;
+}
+
+// encodes windows of messages and checks they come back unchanged
+static void round_trip(BridgeEncoder &encoder, BridgeDecoder &decoder, int start, int count, int window) {
+  for (int i = start; i < start + count; i += window) {
+    std::vector<std::string> sent;
+    for (int j = i; j < i + window; j++) {
+      sent.push_back(message(j));
+      encoder.add(sent.back().data(), sent.back().size());
+    }
+    REQUIRE(decode(decoder, encoder.encode()) == sent);
+  }
+}
+
+TEST_CASE("bridge_codec round trip") {
+  BridgeEncoder encoder;
+  BridgeDecoder decoder;
+  REQUIRE(encoder.encode().empty());
+
+  // a single message, and windows where most messages are deltas of the previous one
+  round_trip(encoder, decoder, 0, 1, 1);
+  round_trip(encoder, decoder, 1, 100, 10);
+  REQUIRE(encoder.dictionaryFrame().empty());
+}
+
+TEST_CASE("bridge_codec dictionary") {
+  BridgeEncoder encoder;
+  BridgeDecoder decoder;
+  round_trip(encoder, decoder, 0, 490, 10);
+  REQUIRE(encoder.dictionaryFrame().empty());
+
+  // the dictionary is trained on the 500th message, and used for the window it's in.
+  // The frame can't be decoded before the dictionary arrives
+  std::vector<std::string> sent;
+  for (int i = 490; i < 500; i++) {
+    sent.push_back(message(i));
+    encoder.add(sent.back().data(), sent.back().size());
+  }
+  const std::string frame = encoder.encode();
+  const std::string dict_frame = encoder.dictionaryFrame();
+  REQUIRE(!dict_frame.empty());
+  REQUIRE(decode(decoder, frame, false).empty());
+
+  REQUIRE(decode(decoder, dict_frame).empty());
+  REQUIRE(decode(decoder, frame) == sent);
+  round_trip(encoder, decoder, 500, 200, 20);
+
+  // the repeated dictionary frame doesn't reset the decoder
+  REQUIRE(decode(decoder, dict_frame).empty());
+  round_trip(encoder, decoder, 700, 20, 20);
+}
+
+TEST_CASE("bridge_codec corrupt frames") {
+  BridgeEncoder encoder;
+  BridgeDecoder decoder;
+  for (int i = 0; i < 10; i++) {
+    const std::string msg = message(i);
+    encoder.add(msg.data(), msg.size());
+  }
+  const std::string frame = encoder.encode();
+
+  SECTION("truncated") {
+    for (size_t len = 0; len < frame.size(); len++) {
+      INFO("length " << len << " of " << frame.size());
+      REQUIRE(decode(decoder, frame.substr(0, len), false).empty());
+    }
+  }
+
+  SECTION("unknown frame type") {
+    std::string bad = frame;
+    bad[0] = 2;
+    decode(decoder, bad, false);
+  }
+
+  SECTION("message larger than a window") {
+    // a valid zstd frame holding a header that claims a huge message
+    bridge_msg_header header = {.size = 0xFFFFFFF8, .delta = 0, .packed_size = 0};
+    std::string compressed(ZSTD_compressBound(sizeof(header)), '\0');
+    const size_t size = ZSTD_compress(compressed.data(), compressed.size(), &header, sizeof(header), 1);
+    REQUIRE(!ZSTD_isError(size));
+
+    bridge_frame_header frame_header = {.type = BRIDGE_FRAME_DATA, .dict_id = 0};
+    std::string bad((const char *)&frame_header, sizeof(frame_header));
+    bad.append(compressed, 0, size);
+    decode(decoder, bad, false);
+  }
+
+  // the decoder still works after rejecting a frame
+  std::vector<std::string> msgs = decode(decoder, frame);
+  REQUIRE(msgs.size() == 10);
+}
@@ -0,0 +1,66 @@
+#include <cstring>
+
+#include "catch2/catch.hpp"
+#include "cereal/messaging/msgq_to_zmq.h"
+#include "common/util.h"
+
+ExitHandler do_exit;
+
+// exposes the send decision of a socket pair, no sockets are created
+class TestMsgqToZmq : public MsgqToZmq {
+public:
+  using MsgqToZmq::PendingMessage;
+  using MsgqToZmq::SocketPair;
+};
+
+static TestMsgqToZmq::PendingMessage message(char value) {
+  auto data = std::make_unique<char[]>(8);
+  memset(data.get(), value, 8);
+  return {std::move(data), 8};
+}
+
+TEST_CASE("msgq_to_zmq sends every message without a max rate") {
+  TestMsgqToZmq::SocketPair pair;
+  REQUIRE_FALSE(pair.ready(0));
+  for (int i = 0; i < 10; ++i) {
+    pair.add(message(i));
+  }
+  REQUIRE(pair.pending.size() == 10);
+  REQUIRE(pair.skipped == 0);
+  REQUIRE(pair.ready(0));
+}
+
+TEST_CASE("msgq_to_zmq sends the latest message with a max rate") {
+  TestMsgqToZmq::SocketPair pair;
+  pair.latest_only = true;
+  pair.min_send_interval_ms = 100;
+  pair.last_send_ms = 1000;
+
+  for (int i = 0; i < 500; ++i) {
+    pair.add(message(i));
+  }
+  REQUIRE(pair.pending.size() == 1);
+  REQUIRE(pair.pending[0].data[0] == (char)499);
+  REQUIRE(pair.skipped == 499);
+
+  // a full interval has to pass, however many messages arrived
+  REQUIRE_FALSE(pair.ready(1050));
+  REQUIRE(pair.ready(1100));
+}
+
+TEST_CASE("msgq_to_zmq batches messages in the compression window") {
+  TestMsgqToZmq::SocketPair pair;
+  pair.min_send_interval_ms = 10;
+  pair.last_send_ms = 1000;
+
+  pair.add(message(0));
+  REQUIRE_FALSE(pair.ready(1005));
+  REQUIRE(pair.ready(1010));
+
+  // a full batch goes out before the window ends
+  while (!pair.ready(1005)) {
+    pair.add(message(1));
+  }
+  REQUIRE(pair.pending.size() == 200);  // MAX_BATCH_SIZE
+  REQUIRE(pair.skipped == 0);
+}
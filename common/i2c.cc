@@ -16,11 +16,12 @@
 #ifdef QCOM2
 // TODO: decide if we want to install libi2c-dev everywhere
 extern "C" {
+  #include <linux/i2c.h>
   #include <linux/i2c-dev.h>
   #include <i2c/smbus.h>
 }
 
-I2CBus::I2CBus(uint8_t bus_id) {
+I2CDevBus::I2CDevBus(uint8_t bus_id) {
   char bus_name[20];
   snprintf(bus_name, 20, "/dev/i2c-%d", bus_id);
 
@@ -30,13 +31,13 @@ I2CBus::I2CBus(uint8_t bus_id) {
   }
 }
 
-I2CBus::~I2CBus() {
+I2CDevBus::~I2CDevBus() {
   if (i2c_fd >= 0) {
     close(i2c_fd);
   }
 }
 
-int I2CBus::read_register(uint8_t device_address, uint register_address, uint8_t *buffer, uint8_t len) {
+int I2CDevBus::read_register(uint8_t device_address, uint register_address, uint8_t *buffer, uint8_t len) {
   std::lock_guard lk(m);
 
   int ret = 0;
@@ -51,7 +52,7 @@ fail:
   return ret;
 }
 
-int I2CBus::set_register(uint8_t device_address, uint register_address, uint8_t data) {
+int I2CDevBus::set_register(uint8_t device_address, uint register_address, uint8_t data) {
   std::lock_guard lk(m);
 
   int ret = 0;
@@ -66,16 +67,30 @@ fail:
   return ret;
 }
 
+int I2CDevBus::read_burst(uint8_t device_address, uint register_address, uint8_t *buffer, uint16_t len) {
+  std::lock_guard lk(m);
+
+  uint8_t reg = register_address;
+  struct i2c_msg msgs[2] = {
+    {.addr = device_address, .flags = 0, .len = 1, .buf = &reg},
+    {.addr = device_address, .flags = I2C_M_RD, .len = len, .buf = buffer},
+  };
+  struct i2c_rdwr_ioctl_data data = {.msgs = msgs, .nmsgs = 2};
+
+  int ret = HANDLE_EINTR(ioctl(i2c_fd, I2C_RDWR, &data));
+  return ret < 0 ? ret : len;
+}
+
 #else
 
-I2CBus::I2CBus(uint8_t bus_id) {
+I2CDevBus::I2CDevBus(uint8_t bus_id) {
   UNUSED(bus_id);
   i2c_fd = -1;
 }
 
-I2CBus::~I2CBus() {}
+I2CDevBus::~I2CDevBus() {}
 
-int I2CBus::read_register(uint8_t device_address, uint register_address, uint8_t *buffer, uint8_t len) {
+int I2CDevBus::read_register(uint8_t device_address, uint register_address, uint8_t *buffer, uint8_t len) {
   UNUSED(device_address);
   UNUSED(register_address);
   UNUSED(buffer);
@@ -83,10 +98,18 @@ int I2CBus::read_register(uint8_t device_address, uint register_address, uint8_t
   return -1;
 }
 
-int I2CBus::set_register(uint8_t device_address, uint register_address, uint8_t data) {
+int I2CDevBus::set_register(uint8_t device_address, uint register_address, uint8_t data) {
   UNUSED(device_address);
   UNUSED(register_address);
   UNUSED(data);
   return -1;
 }
+
+int I2CDevBus::read_burst(uint8_t device_address, uint register_address, uint8_t *buffer, uint16_t len) {
+  UNUSED(device_address);
+  UNUSED(register_address);
+  UNUSED(buffer);
+  UNUSED(len);
+  return -1;
+}
 #endif
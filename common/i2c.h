@@ -5,15 +5,28 @@
 
 #include <sys/types.h>
 
+// Register access to the devices on an I2C bus
 class I2CBus {
+  public:
+    virtual ~I2CBus() {}
+
+    virtual int read_register(uint8_t device_address, uint register_address, uint8_t *buffer, uint8_t len) = 0;
+    virtual int set_register(uint8_t device_address, uint register_address, uint8_t data) = 0;
+    // one combined write/read transaction, not limited to the 32 byte SMBus block size
+    virtual int read_burst(uint8_t device_address, uint register_address, uint8_t *buffer, uint16_t len) = 0;
+};
+
+// The bus at /dev/i2c-<bus_id>
+class I2CDevBus : public I2CBus {
   private:
     int i2c_fd;
     std::mutex m;
 
   public:
-    I2CBus(uint8_t bus_id);
-    ~I2CBus();
+    I2CDevBus(uint8_t bus_id);
+    ~I2CDevBus();
 
-    int read_register(uint8_t device_address, uint register_address, uint8_t *buffer, uint8_t len);
-    int set_register(uint8_t device_address, uint register_address, uint8_t data);
+    int read_register(uint8_t device_address, uint register_address, uint8_t *buffer, uint8_t len) override;
+    int set_register(uint8_t device_address, uint register_address, uint8_t data) override;
+    int read_burst(uint8_t device_address, uint register_address, uint8_t *buffer, uint16_t len) override;
 };
@@ -0,0 +1,114 @@
+#include "common/i2c_sim.h"
+
+#include <fstream>
+#include <sstream>
+
+#include "common/swaglog.h"
+#include "common/timing.h"
+
+I2CSimBus::I2CSimBus(uint64_t latency_ns, double error_rate, uint32_t seed)
+    : latency_ns(latency_ns), error_rate(error_rate), rng(seed) {}
+
+void I2CSimBus::set_registers(uint8_t device_address, uint register_address, const std::vector<uint8_t> &values) {
+  std::lock_guard lk(m);
+  auto &regs = registers.try_emplace(device_address).first->second;
+  for (size_t i = 0; i < values.size(); i++) {
+    regs[(register_address + i) & 0xFF] = values[i];
+  }
+}
+
+void I2CSimBus::add_sample(uint8_t device_address, uint register_address, const std::vector<uint8_t> &sample) {
+  std::lock_guard lk(m);
+  registers.try_emplace(device_address);
+  auto &data = streams[{device_address, register_address & 0xFF}].data;
+  data.insert(data.end(), sample.begin(), sample.end());
+}
+
+bool I2CSimBus::load(const std::string &path) {
+  std::ifstream f(path);
+  if (!f) {
+    LOGE("can't open %s", path.c_str());
+    return false;
+  }
+
+  std::string line;
+  for (int line_nr = 1; std::getline(f, line); line_nr++) {
+    std::istringstream ss(line.substr(0, line.find('#')));
+    std::string kind;
+    if (!(ss >> kind)) continue;
+
+    unsigned int device, reg, value;
+    std::vector<uint8_t> bytes;
+    if (!(ss >> std::hex >> device >> reg)) {
+      LOGE("%s:%d: expected <device> <register>", path.c_str(), line_nr);
+      return false;
+    }
+    while (ss >> value) {
+      bytes.push_back(value);
+    }
+
+    if (kind == "reg") {
+      set_registers(device, reg, bytes);
+    } else if (kind == "sample") {
+      add_sample(device, reg, bytes);
+    } else {
+      LOGE("%s:%d: unknown entry %s", path.c_str(), line_nr, kind.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+bool I2CSimBus::transaction(uint8_t device_address, size_t bytes) {
+  if (latency_ns > 0) {
+    // spin, sleeping overshoots by more than a transaction takes
+    const uint64_t end = nanos_since_boot() + latency_ns;
+    while (nanos_since_boot() < end) {}
+  }
+
+  transactions++;
+  if (registers.count(device_address) == 0 || (error_rate > 0 && std::uniform_real_distribution<>()(rng) < error_rate)) {
+    errors++;
+    return false;
+  }
+  bytes_transferred += bytes;
+  return true;
+}
+
+int I2CSimBus::read(uint8_t device_address, uint register_address, uint8_t *buffer, size_t len) {
+  if (!transaction(device_address, len)) return -1;
+
+  auto stream = streams.find({device_address, register_address & 0xFF});
+  if (stream != streams.end() && !stream->second.data.empty()) {
+    Stream &s = stream->second;
+    for (size_t i = 0; i < len; i++) {
+      buffer[i] = s.data[s.pos];
+      s.pos = (s.pos + 1) % s.data.size();
+    }
+  } else {
+    // auto increment
+    const auto &regs = registers[device_address];
+    for (size_t i = 0; i < len; i++) {
+      buffer[i] = regs[(register_address + i) & 0xFF];
+    }
+  }
+  return len;
+}
+
+int I2CSimBus::read_register(uint8_t device_address, uint register_address, uint8_t *buffer, uint8_t len) {
+  std::lock_guard lk(m);
+  return read(device_address, register_address, buffer, len);
+}
+
+int I2CSimBus::read_burst(uint8_t device_address, uint register_address, uint8_t *buffer, uint16_t len) {
+  std::lock_guard lk(m);
+  return read(device_address, register_address, buffer, len);
+}
+
+int I2CSimBus::set_register(uint8_t device_address, uint register_address, uint8_t data) {
+  std::lock_guard lk(m);
+  if (!transaction(device_address, 1)) return -1;
+
+  registers[device_address][register_address & 0xFF] = data;
+  return 0;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "common/i2c.h"
+
+// An I2C bus in memory, to run the sensor drivers without the hardware. Every device is a
+// register map, and reads starting at a register with a stream take their bytes from the
+// stream instead, so data registers return recorded or synthetic samples. Transactions can
+// be delayed to model bus time, and fail at random to test error handling.
+class I2CSimBus : public I2CBus {
+  public:
+    I2CSimBus(uint64_t latency_ns = 0, double error_rate = 0.0, uint32_t seed = 0);
+
+    void set_registers(uint8_t device_address, uint register_address, const std::vector<uint8_t> &values);
+    // Appends a sample to the stream at a register. A read consumes as many bytes as it's long,
+    // and the stream starts over once it's all read.
+    void add_sample(uint8_t device_address, uint register_address, const std::vector<uint8_t> &sample);
+
+    // Replays a register map and samples from a file, one entry per line, values in hex:
+    //   reg <device> <register> <bytes...>
+    //   sample <device> <register> <bytes...>
+    // anything after # is a comment
+    bool load(const std::string &path);
+
+    int read_register(uint8_t device_address, uint register_address, uint8_t *buffer, uint8_t len) override;
+    int set_register(uint8_t device_address, uint register_address, uint8_t data) override;
+    int read_burst(uint8_t device_address, uint register_address, uint8_t *buffer, uint16_t len) override;
+
+    // bus usage so far
+    uint64_t transactions = 0;
+    uint64_t bytes_transferred = 0;
+    uint64_t errors = 0;
+
+  private:
+    struct Stream {
+      std::vector<uint8_t> data;
+      size_t pos = 0;
+    };
+
+    bool transaction(uint8_t device_address, size_t bytes);
+    int read(uint8_t device_address, uint register_address, uint8_t *buffer, size_t len);
+
+    std::mutex m;
+    uint64_t latency_ns;
+    double error_rate;
+    std::mt19937 rng;
+    std::map<uint8_t, std::array<uint8_t, 256>> registers;
+    std::map<std::pair<uint8_t, uint8_t>, Stream> streams;
+};
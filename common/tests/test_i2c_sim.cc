@@ -0,0 +1,97 @@
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#include "catch2/catch.hpp"
+#include "common/i2c_sim.h"
+
+TEST_CASE("I2CSimBus registers") {
+  I2CSimBus bus;
+  bus.set_registers(0x6a, 0x0f, {0x69});
+  bus.set_registers(0x6a, 0x10, {0x01, 0x02, 0x03});
+
+  uint8_t buf[4] = {};
+  REQUIRE(bus.read_register(0x6a, 0x0f, buf, 4) == 4);
+  REQUIRE(buf[0] == 0x69);
+  REQUIRE(buf[1] == 0x01);
+  REQUIRE(buf[3] == 0x03);
+
+  REQUIRE(bus.set_register(0x6a, 0x11, 0xaa) == 0);
+  REQUIRE(bus.read_register(0x6a, 0x11, buf, 1) == 1);
+  REQUIRE(buf[0] == 0xaa);
+
+  // no device at the address
+  REQUIRE(bus.read_register(0x30, 0x00, buf, 1) < 0);
+  REQUIRE(bus.set_register(0x30, 0x00, 0) < 0);
+  REQUIRE(bus.transactions == 5);
+  REQUIRE(bus.errors == 2);
+}
+
+TEST_CASE("I2CSimBus streams") {
+  I2CSimBus bus;
+  bus.add_sample(0x6a, 0x28, {1, 2, 3});
+  bus.add_sample(0x6a, 0x28, {4, 5, 6});
+
+  uint8_t buf[6] = {};
+  REQUIRE(bus.read_register(0x6a, 0x28, buf, 3) == 3);
+  REQUIRE(buf[0] == 1);
+  REQUIRE(bus.read_register(0x6a, 0x28, buf, 3) == 3);
+  REQUIRE(buf[0] == 4);
+
+  // starts over, and a burst reads across samples
+  REQUIRE(bus.read_burst(0x6a, 0x28, buf, 6) == 6);
+  REQUIRE(buf[0] == 1);
+  REQUIRE(buf[5] == 6);
+
+  // registers after the stream aren't affected
+  REQUIRE(bus.read_register(0x6a, 0x29, buf, 1) == 1);
+  REQUIRE(buf[0] == 0);
+}
+
+TEST_CASE("I2CSimBus errors") {
+  I2CSimBus bus(0, 0.5, 1234);
+  bus.set_registers(0x6a, 0x00, {0});
+
+  uint8_t buf[1];
+  uint64_t failed = 0;
+  for (int i = 0; i < 1000; i++) {
+    failed += bus.read_register(0x6a, 0x00, buf, 1) < 0;
+  }
+  REQUIRE(failed > 400);
+  REQUIRE(failed < 600);
+  REQUIRE(bus.errors == failed);
+}
+
+TEST_CASE("I2CSimBus load") {
+  char path[] = "/tmp/test_i2c_sim_XXXXXX";
+  int fd = mkstemp(path);
+  REQUIRE(fd >= 0);
+  close(fd);
+  {
+    std::ofstream f(path);
+    f << "# lsm6ds3\n"
+      << "reg 6a 0f 69\n"
+      << "sample 6a 28 10 20  # x\n"
+      << "sample 6a 28 30 40\n";
+  }
+
+  I2CSimBus bus;
+  REQUIRE(bus.load(path));
+  uint8_t buf[2];
+  REQUIRE(bus.read_register(0x6a, 0x0f, buf, 1) == 1);
+  REQUIRE(buf[0] == 0x69);
+  REQUIRE(bus.read_register(0x6a, 0x28, buf, 2) == 2);
+  REQUIRE(buf[1] == 0x20);
+  REQUIRE(bus.read_register(0x6a, 0x28, buf, 2) == 2);
+  REQUIRE(buf[0] == 0x30);
+
+  {
+    std::ofstream f(path);
+    f << "write 6a 0f 69\n";
+  }
+  REQUIRE(!bus.load(path));
+  remove(path);
+}
@@ -81,6 +81,7 @@ class ModelState:
 
     if TICI:
       self.tensor_inputs = {k: Tensor(v, device='NPY').realize() for k,v in self.numpy_inputs.items()}
+      self.img_tensors: dict[int, Tensor] = {}
       with open(MODEL_PKL_PATH, "rb") as f:
         self.model_run = pickle.load(f)
     else:
@@ -93,13 +94,17 @@ class ModelState:
 
     input_img_cl = self.frame.prepare(buf, transform.flatten())
     if TICI:
-      # The imgs tensors are backed by opencl memory, only need init once
-      if 'input_img' not in self.tensor_inputs:
-        self.tensor_inputs['input_img'] = qcom_tensor_from_opencl_address(input_img_cl.mem_address, (1, MODEL_WIDTH*MODEL_HEIGHT), dtype=dtypes.uint8)
+      # The imgs tensors are backed by opencl memory, only need init once.
+      # Each frame alternates between two input buffers
+      mem_address = input_img_cl.mem_address
+      if mem_address not in self.img_tensors:
+        self.img_tensors[mem_address] = qcom_tensor_from_opencl_address(mem_address, (1, MODEL_WIDTH*MODEL_HEIGHT), dtype=dtypes.uint8)
+      self.tensor_inputs['input_img'] = self.img_tensors[mem_address]
     else:
       self.numpy_inputs['input_img'] = self.frame.buffer_from_cl(input_img_cl).reshape((1, MODEL_WIDTH*MODEL_HEIGHT))
 
     if TICI:
+      self.frame.wait()
       output = self.model_run(**self.tensor_inputs).numpy().flatten()
     else:
       output = self.onnx_cpu_runner.run(None, self.numpy_inputs)[0].flatten()
@@ -80,6 +80,7 @@ class ModelState:
 
     if TICI:
       self.tensor_inputs = {k: Tensor(v, device='NPY').realize() for k,v in self.numpy_inputs.items()}
+      self.img_tensors: dict[int, Tensor] = {}
       with open(MODEL_PKL_PATH, "rb") as f:
         self.model_run = pickle.load(f)
     else:
@@ -107,10 +108,13 @@ class ModelState:
                'big_input_imgs': self.frames['big_input_imgs'].prepare(wbuf, transform_wide.flatten())}
 
     if TICI:
-      # The imgs tensors are backed by opencl memory, only need init once
+      # The imgs tensors are backed by opencl memory, only need init once.
+      # Each frame rotates through three input buffers
       for key in imgs_cl:
-        if key not in self.tensor_inputs:
-          self.tensor_inputs[key] = qcom_tensor_from_opencl_address(imgs_cl[key].mem_address, self.input_shapes[key], dtype=dtypes.uint8)
+        mem_address = imgs_cl[key].mem_address
+        if mem_address not in self.img_tensors:
+          self.img_tensors[mem_address] = qcom_tensor_from_opencl_address(mem_address, self.input_shapes[key], dtype=dtypes.uint8)
+        self.tensor_inputs[key] = self.img_tensors[mem_address]
     else:
       for key in imgs_cl:
         self.numpy_inputs[key] = self.frames[key].buffer_from_cl(imgs_cl[key]).reshape(self.input_shapes[key]).astype(dtype=np.float32)
@@ -119,6 +123,9 @@ class ModelState:
       return None
 
     if TICI:
+      # prepare only queued the transforms, the model runs on another queue
+      for frame in self.frames.values():
+        frame.wait()
       self.output = self.model_run(**self.tensor_inputs).numpy().flatten()
     else:
       self.output = self.onnx_cpu_runner.run(None, self.numpy_inputs)[0].flatten()
@@ -7,37 +7,48 @@
 
 DrivingModelFrame::DrivingModelFrame(cl_device_id device_id, cl_context context) : ModelFrame(device_id, context) {
   input_frames = std::make_unique<uint8_t[]>(buf_size);
-  input_frames_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, buf_size, NULL, &err));
-  img_buffer_20hz_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, 2*frame_size_bytes, NULL, &err));
-  region.origin = 1 * frame_size_bytes;
-  region.size = frame_size_bytes;
-  last_img_cl = CL_CHECK_ERR(clCreateSubBuffer(img_buffer_20hz_cl, CL_MEM_READ_WRITE, CL_BUFFER_CREATE_TYPE_REGION, &region, &err));
+  for (int i = 0; i < INPUT_COUNT; i++) {
+    input_frames_cl[i] = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, buf_size, NULL, &err));
+    for (int j = 0; j < HISTORY_FRAMES; j++) {
+      cl_buffer_region region = {.origin = j * frame_size_bytes, .size = frame_size_bytes};
+      input_slots_cl[i][j] = CL_CHECK_ERR(clCreateSubBuffer(input_frames_cl[i], CL_MEM_READ_WRITE, CL_BUFFER_CREATE_TYPE_REGION, &region, &err));
+    }
+  }
 
-  loadyuv_init(&loadyuv, context, device_id, MODEL_WIDTH, MODEL_HEIGHT);
-  init_transform(device_id, context, MODEL_WIDTH, MODEL_HEIGHT);
+  transform_init(&transform, context, device_id);
 }
 
 cl_mem* DrivingModelFrame::prepare(cl_mem yuv_cl, int frame_width, int frame_height, int frame_stride, int frame_uv_offset, const mat3& projection) {
-  run_transform(yuv_cl, MODEL_WIDTH, MODEL_HEIGHT, frame_width, frame_height, frame_stride, frame_uv_offset, projection);
+  static_assert(HISTORY_FRAMES == 2, "warpPerspectivePacked writes two slots");
+  const int cur = input_idx;
+  input_idx = (input_idx + 1) % INPUT_COUNT;
 
-  for (int i = 0; i < 1; i++) {
-    CL_CHECK(clEnqueueCopyBuffer(q, img_buffer_20hz_cl, img_buffer_20hz_cl, (i+1)*frame_size_bytes, i*frame_size_bytes, frame_size_bytes, 0, nullptr, nullptr));
+  if (cpu_transform) {
+    // shift the 20Hz history and transform the new frame into the last slot
+    memmove(&input_frames[0], &input_frames[frame_size_bytes], frame_size_bytes);
+    const uint8_t *yuv = map_frame(yuv_cl, frame_height, frame_stride, frame_uv_offset);
+    transform_loadyuv_cpu(yuv, frame_width, frame_height, frame_stride, frame_uv_offset,
+                          &input_frames[frame_size_bytes], MODEL_WIDTH, MODEL_HEIGHT, projection);
+    unmap_frame(yuv_cl, yuv);
+    CL_CHECK(clEnqueueWriteBuffer(q, input_frames_cl[cur], CL_TRUE, 0, buf_size, &input_frames[0], 0, nullptr, nullptr));
+    return &input_frames_cl[cur];
   }
-  loadyuv_queue(&loadyuv, q, y_cl, u_cl, v_cl, last_img_cl);
 
-  copy_queue(&loadyuv, q, img_buffer_20hz_cl, input_frames_cl, 0, 0, frame_size_bytes);
-  copy_queue(&loadyuv, q, last_img_cl, input_frames_cl, 0, frame_size_bytes, frame_size_bytes);
-
-  // NOTE: Since thneed is using a different command queue, this clFinish is needed to ensure the image is ready.
-  clFinish(q);
-  return &input_frames_cl;
+  // writes the newest slot of this frame's input and the oldest slot of the next frame's
+  transform_packed_queue(&transform, q, yuv_cl, frame_width, frame_height, frame_stride, frame_uv_offset,
+                         input_slots_cl[cur][1], input_slots_cl[input_idx][0], MODEL_WIDTH, MODEL_HEIGHT, projection, prepare_event());
+  CL_CHECK(clFlush(q));
+  return &input_frames_cl[cur];
 }
 
 DrivingModelFrame::~DrivingModelFrame() {
-  deinit_transform();
-  loadyuv_destroy(&loadyuv);
-  CL_CHECK(clReleaseMemObject(img_buffer_20hz_cl));
-  CL_CHECK(clReleaseMemObject(last_img_cl));
+  transform_destroy(&transform);
+  for (int i = 0; i < INPUT_COUNT; i++) {
+    for (int j = 0; j < HISTORY_FRAMES; j++) {
+      CL_CHECK(clReleaseMemObject(input_slots_cl[i][j]));
+    }
+    CL_CHECK(clReleaseMemObject(input_frames_cl[i]));
+  }
   CL_CHECK(clReleaseCommandQueue(q));
 }
 
@@ -50,12 +61,25 @@ MonitoringModelFrame::MonitoringModelFrame(cl_device_id device_id, cl_context co
 }
 
 cl_mem* MonitoringModelFrame::prepare(cl_mem yuv_cl, int frame_width, int frame_height, int frame_stride, int frame_uv_offset, const mat3& projection) {
-  run_transform(yuv_cl, MODEL_WIDTH, MODEL_HEIGHT, frame_width, frame_height, frame_stride, frame_uv_offset, projection);
-  clFinish(q);
-  return &y_cl;
+  cl_mem *input = input_idx == 0 ? &y_cl : &input_frame_cl;
+  input_idx ^= 1;
+
+  if (cpu_transform) {
+    const uint8_t *yuv = map_frame(yuv_cl, frame_height, frame_stride, frame_uv_offset);
+    warp_perspective_cpu(yuv, frame_stride, 1, 0, frame_height, frame_width,
+                         &input_frames[0], MODEL_WIDTH, MODEL_HEIGHT, MODEL_WIDTH, projection);
+    unmap_frame(yuv_cl, yuv);
+    CL_CHECK(clEnqueueWriteBuffer(q, *input, CL_TRUE, 0, buf_size, &input_frames[0], 0, nullptr, nullptr));
+    return input;
+  }
+
+  run_transform(yuv_cl, *input, MODEL_WIDTH, MODEL_HEIGHT, frame_width, frame_height, frame_stride, frame_uv_offset, projection);
+  CL_CHECK(clFlush(q));
+  return input;
 }
 
 MonitoringModelFrame::~MonitoringModelFrame() {
+  CL_CHECK(clReleaseMemObject(input_frame_cl));
   deinit_transform();
   CL_CHECK(clReleaseCommandQueue(q));
 }
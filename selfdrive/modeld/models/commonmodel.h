@@ -13,20 +13,42 @@
 #include <CL/cl.h>
 #endif
 
+#include "common/clutil.h"
 #include "common/mat.h"
-#include "selfdrive/modeld/transforms/loadyuv.h"
 #include "selfdrive/modeld/transforms/transform.h"
+#include "selfdrive/modeld/transforms/transform_cpu.h"
 
 class ModelFrame {
 public:
   ModelFrame(cl_device_id device_id, cl_context context) {
     q = CL_CHECK_ERR(clCreateCommandQueue(context, device_id, 0, &err));
+
+    // the kernels are slow on a CPU OpenCL device, transform natively instead
+    cl_device_type device_type;
+    CL_CHECK(clGetDeviceInfo(device_id, CL_DEVICE_TYPE, sizeof(device_type), &device_type, NULL));
+    cpu_transform = (device_type & CL_DEVICE_TYPE_CPU) && getenv("MODEL_TRANSFORM_CL") == nullptr;
+  }
+  virtual ~ModelFrame() {
+    if (prepared) CL_CHECK(clReleaseEvent(prepared));
   }
-  virtual ~ModelFrame() {}
+  // queues the transform and returns without waiting for it. It never writes the input of the
+  // last model run, so it can overlap that run as long as no older run is still going
   virtual cl_mem* prepare(cl_mem yuv_cl, int frame_width, int frame_height, int frame_stride, int frame_uv_offset, const mat3& projection) { return NULL; }
+  // waits for the last prepare, needed before the input is used from another queue
+  void wait() {
+    if (prepared) {
+      CL_CHECK(clWaitForEvents(1, &prepared));
+      CL_CHECK(clReleaseEvent(prepared));
+      prepared = nullptr;
+    }
+  }
   uint8_t* buffer_from_cl(cl_mem *in_frames, int buffer_size) {
+    if (cpu_transform) {
+      // prepare already left the input in host memory
+      return &input_frames[0];
+    }
+    // the queue is in order, the blocking read waits for prepare
     CL_CHECK(clEnqueueReadBuffer(q, *in_frames, CL_TRUE, 0, buffer_size, input_frames.get(), 0, nullptr, nullptr));
-    clFinish(q);
     return &input_frames[0];
   }
 
@@ -40,6 +62,25 @@ protected:
   Transform transform;
   cl_command_queue q;
   std::unique_ptr<uint8_t[]> input_frames;
+  bool cpu_transform = false;
+  cl_event prepared = nullptr;
+
+  // event for the prepare being queued
+  cl_event *prepare_event() {
+    if (prepared) CL_CHECK(clReleaseEvent(prepared));
+    prepared = nullptr;
+    return &prepared;
+  }
+
+  // the camera buffers are host memory, mapping them doesn't copy
+  const uint8_t *map_frame(cl_mem yuv_cl, int frame_height, int frame_stride, int frame_uv_offset) {
+    const size_t size = frame_uv_offset + frame_stride * (frame_height / 2);
+    return (const uint8_t *)CL_CHECK_ERR(clEnqueueMapBuffer(q, yuv_cl, CL_TRUE, CL_MAP_READ, 0, size, 0, nullptr, nullptr, &err));
+  }
+
+  void unmap_frame(cl_mem yuv_cl, const uint8_t *yuv) {
+    CL_CHECK(clEnqueueUnmapMemObject(q, yuv_cl, (void *)yuv, 0, nullptr, nullptr));
+  }
 
   void init_transform(cl_device_id device_id, cl_context context, int model_width, int model_height) {
     y_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, model_width * model_height, NULL, &err));
@@ -55,10 +96,10 @@ protected:
     CL_CHECK(clReleaseMemObject(y_cl));
   }
 
-  void run_transform(cl_mem yuv_cl, int model_width, int model_height, int frame_width, int frame_height, int frame_stride, int frame_uv_offset, const mat3& projection) {
+  void run_transform(cl_mem yuv_cl, cl_mem out_y, int model_width, int model_height, int frame_width, int frame_height, int frame_stride, int frame_uv_offset, const mat3& projection) {
     transform_queue(&transform, q,
         yuv_cl, frame_width, frame_height, frame_stride, frame_uv_offset,
-        y_cl, u_cl, v_cl, model_width, model_height, projection);
+        out_y, u_cl, v_cl, model_width, model_height, projection, prepare_event());
   }
 };
 
@@ -73,11 +114,16 @@ public:
   const int MODEL_FRAME_SIZE = MODEL_WIDTH * MODEL_HEIGHT * 3 / 2;
   const int buf_size = MODEL_FRAME_SIZE * 2;
   const size_t frame_size_bytes = MODEL_FRAME_SIZE * sizeof(uint8_t);
+  static constexpr int HISTORY_FRAMES = 2;
+  static constexpr int INPUT_COUNT = HISTORY_FRAMES + 1;
 
 private:
-  LoadYUVState loadyuv;
-  cl_mem img_buffer_20hz_cl, last_img_cl, input_frames_cl;
-  cl_buffer_region region;
+  // Model inputs used in turn. Frame n is the newest frame of input n % 3 and the oldest of
+  // input (n+1) % 3, the transform writes it to both slots so the history is never shifted.
+  // The third input keeps the transform off input (n-1) % 3, which the previous model run reads.
+  cl_mem input_frames_cl[INPUT_COUNT];
+  cl_mem input_slots_cl[INPUT_COUNT][HISTORY_FRAMES];
+  int input_idx = 0;
 };
 
 class MonitoringModelFrame : public ModelFrame {
@@ -92,5 +138,7 @@ public:
   const int buf_size = MODEL_FRAME_SIZE;
 
 private:
+  // the transform alternates between y_cl and this, the previous model run reads the other one
   cl_mem input_frame_cl;
+  int input_idx = 0;
 };
@@ -17,6 +17,7 @@ cdef extern from "selfdrive/modeld/models/commonmodel.h":
     int buf_size
     unsigned char * buffer_from_cl(cl_mem*, int);
     cl_mem * prepare(cl_mem, int, int, int, int, mat3)
+    void wait()
 
   cppclass DrivingModelFrame:
     int buf_size
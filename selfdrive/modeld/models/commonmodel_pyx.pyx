@@ -50,6 +50,9 @@ cdef class ModelFrame:
     data = self.frame.prepare(buf.buf.buf_cl, buf.width, buf.height, buf.stride, buf.uv_offset, cprojection)
     return CLMem.create(data)
 
+  def wait(self):
+    self.frame.wait()
+
   def buffer_from_cl(self, CLMem in_frames):
     cdef unsigned char * data2
     data2 = self.frame.buffer_from_cl(in_frames.mem, self.buf_size)
@@ -0,0 +1,357 @@
+// Benchmarks the model input transforms at the real camera sizes and checks them against golden outputs.
+// ./bench_transform [iterations] [--update-golden] [--frames <camera> <nv12 file>]
+//
+// The kernels section compares the OpenCL transform, the fused kernel and the native transform.
+// The model frames section runs DrivingModelFrame and MonitoringModelFrame like modeld does,
+// with per stage timings, and hashes their output after two synthetic frames. The hashes are
+// compared to transform_golden.txt, which holds for the native transform and the kernels alike, --update-golden rewrites it.
+// --frames feeds recorded frames instead, e.g. ffmpeg -i fcamera.hevc -f rawvideo -pix_fmt nv12 road.nv12
+// MODEL_TRANSFORM_CL=1 uses the OpenCL kernels on a CPU OpenCL device as well.
+
+#include <algorithm>
+#include <cassert>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "common/clutil.h"
+#include "common/timing.h"
+#include "common/util.h"
+#include "selfdrive/modeld/models/commonmodel.h"
+#include "selfdrive/modeld/transforms/loadyuv.h"
+#include "selfdrive/modeld/transforms/transform.h"
+#include "selfdrive/modeld/transforms/transform_cpu.h"
+
+// NV12 buffers as camerad allocates them
+struct CameraConfig {
+  const char *name;
+  int width, height, stride, uv_offset, yuv_size;
+  // calibrated warps from get_warp_matrix with rpy (0, 0.02, -0.01), and the driver camera warp from dmonitoringmodeld
+  mat3 road, wide, driver;
+};
+
+const CameraConfig cameras[] = {
+  {"ar0231", 1928, 1208, 2048, 2048 * 1216, 2048 * 1216 + 2048 * 608,
+   {{2.92033792f, 0.0206024125f, 188.697586f, 0.00663725194f, 2.92258143f, 410.078522f, 1.09888279e-05f, 2.19754584e-05f, 0.995890856f}},
+   {{1.26727796f, 0.0421194732f, 627.273315f, 0.0132745039f, 1.27245092f, 395.95343f, 2.19776557e-05f, 4.39509167e-05f, 0.987451971f}},
+   {{1.0f, 0.0f, 244.0f, 0.0f, 1.0f, 248.0f, 0.0f, 0.0f, 1.0f}}},
+  {"os04c10", 1344, 760, 1408, 1408 * 768, 1408 * 768 + 1408 * 384,
+   {{1.26171732f, 0.0145166498f, 336.728851f, 0.00417575473f, 1.2624954f, 295.91275f, 1.09888279e-05f, 2.19754584e-05f, 0.995890856f}},
+   {{0.949337661f, 0.0293481089f, 420.09494f, 0.00835150946f, 0.951129794f, 224.881088f, 2.19776557e-05f, 4.39509167e-05f, 0.987451971f}},
+   {{0.75f, 0.0f, 132.0f, 0.0f, 0.75f, 113.0f, 0.0f, 0.0f, 1.0f}}},
+};
+
+// modeld alternates between the buffers of the vipc ring, two are enough to change the input every frame
+const int NUM_FRAMES = 2;
+
+struct Frames {
+  const CameraConfig *cam;
+  std::vector<std::vector<uint8_t>> data;
+  std::vector<cl_mem> cl;
+  bool synthetic = true;
+};
+
+static void report(const char *name, const char *impl, double total_ms, int iterations) {
+  printf("%-16s %-8s %8.3f ms/frame %8.1f fps\n", name, impl, total_ms / iterations, iterations * 1000.0 / total_ms);
+}
+
+// the kernels and the native transform are bit exact, any difference fails
+static bool compare(const char *name, const uint8_t *a, const uint8_t *b, size_t size) {
+  size_t mismatched = 0;
+  int max_diff = 0;
+  for (size_t i = 0; i < size; ++i) {
+    int diff = abs(a[i] - b[i]);
+    mismatched += diff != 0;
+    max_diff = std::max(max_diff, diff);
+  }
+  const bool ok = mismatched == 0;
+  printf("%-16s %zu/%zu bytes differ, max diff %d%s\n", name, mismatched, size, max_diff, ok ? "" : "  FAIL");
+  return ok;
+}
+
+// FNV-1a
+static uint64_t hash_tensor(const uint8_t *data, size_t size) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < size; ++i) {
+    h = (h ^ data[i]) * 0x100000001b3ULL;
+  }
+  return h;
+}
+
+static std::vector<uint8_t> synthetic_frame(const CameraConfig &cam, int seed) {
+  std::vector<uint8_t> frame(cam.yuv_size);
+  std::mt19937 rng(seed);
+  for (int y = 0; y < cam.height * 3 / 2; ++y) {
+    uint8_t *row = &frame[y < cam.height ? y * cam.stride : cam.uv_offset + (y - cam.height) * cam.stride];
+    for (int x = 0; x < cam.width; ++x) {
+      // smooth gradients with noise, so interpolation errors show up
+      row[x] = (x / 4 + y / 3 + seed * 7 + rng() % 16) & 0xff;
+    }
+  }
+  return frame;
+}
+
+static bool load_frames(Frames &frames, const char *path) {
+  const CameraConfig &cam = *frames.cam;
+  const size_t frame_size = cam.width * cam.height * 3 / 2;
+  std::string raw = util::read_file(path);
+  if (raw.empty() || raw.size() % frame_size != 0) {
+    fprintf(stderr, "%s is not a sequence of %dx%d NV12 frames\n", path, cam.width, cam.height);
+    return false;
+  }
+  for (size_t offset = 0; offset < raw.size(); offset += frame_size) {
+    std::vector<uint8_t> frame(cam.yuv_size);
+    for (int y = 0; y < cam.height * 3 / 2; ++y) {
+      uint8_t *row = &frame[y < cam.height ? y * cam.stride : cam.uv_offset + (y - cam.height) * cam.stride];
+      memcpy(row, &raw[offset + y * cam.width], cam.width);
+    }
+    frames.data.push_back(std::move(frame));
+  }
+  frames.synthetic = false;
+  return true;
+}
+
+static std::map<std::string, uint64_t> read_golden() {
+  std::map<std::string, uint64_t> golden;
+  std::istringstream lines(util::read_file(GOLDEN_PATH));
+  std::string line;
+  while (std::getline(lines, line)) {
+    if (line.empty() || line[0] == '#') continue;
+    char camera[32], model[32];
+    uint64_t hash;
+    if (sscanf(line.c_str(), "%31s %31s %" SCNx64, camera, model, &hash) == 3) {
+      golden[std::string(camera) + " " + model] = hash;
+    }
+  }
+  return golden;
+}
+
+static void write_golden(const std::map<std::string, uint64_t> &golden) {
+  std::ofstream f(GOLDEN_PATH);
+  f << "# model input hashes (64-bit FNV-1a of buffer_from_cl after two synthetic frames)\n";
+  f << "# the native transform and the kernels are bit exact, so these hold with MODEL_TRANSFORM_CL=1 and on a GPU too\n";
+  f << "# regenerate with ./bench_transform --update-golden\n";
+  for (const auto &[key, hash] : golden) {
+    f << key << " " << util::string_format("%016" PRIx64, hash) << "\n";
+  }
+}
+
+static bool bench_kernels(cl_device_id device_id, cl_context context, cl_command_queue q, Transform *transform,
+                          const Frames &frames, int iterations) {
+  const CameraConfig &cam = *frames.cam;
+  bool ok = true;
+  struct KernelCase {
+    const char *name;
+    int width, height;
+    bool loadyuv;  // packed into the driving model layout, or only the warped Y plane
+    mat3 projection;
+  } cases[] = {
+    {"road", 512, 256, true, cam.road},
+    {"driver", 1440, 960, false, cam.driver},
+  };
+
+  for (const auto &c : cases) {
+    const std::string name = std::string(cam.name) + " " + c.name;
+    const int uv_size = (c.width / 2) * (c.height / 2);
+    const size_t out_size = c.loadyuv ? c.width * c.height * 3 / 2 : c.width * c.height;
+    cl_mem y_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, c.width * c.height, NULL, &err));
+    cl_mem u_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, uv_size, NULL, &err));
+    cl_mem v_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, uv_size, NULL, &err));
+    cl_mem out_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, out_size, NULL, &err));
+    LoadYUVState loadyuv;
+    loadyuv_init(&loadyuv, context, device_id, c.width, c.height);
+
+    // OpenCL, including reading back the result like buffer_from_cl
+    std::vector<uint8_t> out_ocl(out_size), out_cpu(out_size);
+    double start = millis_since_boot();
+    for (int i = 0; i < iterations; ++i) {
+      transform_queue(transform, q, frames.cl[0], cam.width, cam.height, cam.stride, cam.uv_offset,
+                      y_cl, u_cl, v_cl, c.width, c.height, c.projection);
+      if (c.loadyuv) {
+        loadyuv_queue(&loadyuv, q, y_cl, u_cl, v_cl, out_cl);
+      }
+      CL_CHECK(clEnqueueReadBuffer(q, c.loadyuv ? out_cl : y_cl, CL_TRUE, 0, out_size, out_ocl.data(), 0, nullptr, nullptr));
+    }
+    report(name.c_str(), "opencl", millis_since_boot() - start, iterations);
+
+    if (c.loadyuv) {
+      // the fused kernel, writing both slots of the history like DrivingModelFrame
+      cl_mem out2_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, out_size, NULL, &err));
+      std::vector<uint8_t> out_packed(out_size);
+      start = millis_since_boot();
+      for (int i = 0; i < iterations; ++i) {
+        transform_packed_queue(transform, q, frames.cl[0], cam.width, cam.height, cam.stride, cam.uv_offset,
+                               out_cl, out2_cl, c.width, c.height, c.projection);
+        CL_CHECK(clEnqueueReadBuffer(q, out_cl, CL_TRUE, 0, out_size, out_packed.data(), 0, nullptr, nullptr));
+      }
+      report(name.c_str(), "packed", millis_since_boot() - start, iterations);
+      ok &= compare(name.c_str(), out_ocl.data(), out_packed.data(), out_size);
+      CL_CHECK(clReleaseMemObject(out2_cl));
+    }
+
+    start = millis_since_boot();
+    for (int i = 0; i < iterations; ++i) {
+      if (c.loadyuv) {
+        transform_loadyuv_cpu(frames.data[0].data(), cam.width, cam.height, cam.stride, cam.uv_offset,
+                              out_cpu.data(), c.width, c.height, c.projection);
+      } else {
+        warp_perspective_cpu(frames.data[0].data(), cam.stride, 1, 0, cam.height, cam.width,
+                             out_cpu.data(), c.width, c.height, c.width, c.projection);
+      }
+    }
+    report(name.c_str(), "native", millis_since_boot() - start, iterations);
+    ok &= compare(name.c_str(), out_ocl.data(), out_cpu.data(), out_size);
+
+    loadyuv_destroy(&loadyuv);
+    CL_CHECK(clReleaseMemObject(out_cl));
+    CL_CHECK(clReleaseMemObject(v_cl));
+    CL_CHECK(clReleaseMemObject(u_cl));
+    CL_CHECK(clReleaseMemObject(y_cl));
+  }
+  return ok;
+}
+
+// the model input for frames[0..n], computed with the native transform
+static std::vector<uint8_t> reference_input(const Frames &frames, int n, bool driving, int width, int height, const mat3 &projection) {
+  const CameraConfig &cam = *frames.cam;
+  if (driving) {
+    // the newest two frames, oldest first
+    const int frame_size = width * height * 3 / 2;
+    std::vector<uint8_t> out(frame_size * 2);
+    for (int i = 0; i < 2; ++i) {
+      const auto &frame = frames.data[std::max(n - 1 + i, 0) % frames.data.size()];
+      transform_loadyuv_cpu(frame.data(), cam.width, cam.height, cam.stride, cam.uv_offset,
+                            &out[i * frame_size], width, height, projection);
+    }
+    return out;
+  }
+  std::vector<uint8_t> out(width * height);
+  warp_perspective_cpu(frames.data[n % frames.data.size()].data(), cam.stride, 1, 0, cam.height, cam.width,
+                       out.data(), width, height, width, projection);
+  return out;
+}
+
+template <class Frame>
+static bool bench_model_frame(cl_device_id device_id, cl_context context, const Frames &frames, const char *model,
+                              const mat3 &projection, std::map<std::string, uint64_t> &golden, bool update_golden, int iterations) {
+  const CameraConfig &cam = *frames.cam;
+  const std::string name = std::string(cam.name) + " " + model;
+  const bool driving = std::is_same<Frame, DrivingModelFrame>::value;
+  Frame frame(device_id, context);
+  bool ok = true;
+
+  // the first two frames on a fresh frame fill the driving history
+  uint8_t *out = nullptr;
+  for (int i = 0; i < 2; ++i) {
+    cl_mem *input = frame.prepare(frames.cl[i % frames.cl.size()], cam.width, cam.height, cam.stride, cam.uv_offset, projection);
+    frame.wait();
+    out = frame.buffer_from_cl(input, frame.buf_size);
+  }
+  std::vector<uint8_t> reference = reference_input(frames, 1, driving, frame.MODEL_WIDTH, frame.MODEL_HEIGHT, projection);
+  assert(reference.size() == (size_t)frame.buf_size);
+  // the frame uses the kernels on a GPU, or with MODEL_TRANSFORM_CL=1
+  ok &= compare(name.c_str(), reference.data(), out, frame.buf_size);
+
+  if (frames.synthetic) {
+    const uint64_t hash = hash_tensor(out, frame.buf_size);
+    if (update_golden) {
+      golden[name] = hash;
+    } else if (golden.count(name) == 0) {
+      printf("%-16s no golden output\n", name.c_str());
+      ok = false;
+    } else if (golden[name] != hash) {
+      printf("%-16s output %016" PRIx64 " doesn't match golden %016" PRIx64 "\n", name.c_str(), hash, golden[name]);
+      ok = false;
+    }
+  }
+
+  // per stage, like modeld: queue the transform, wait before the model runs, and read back for a CPU model
+  double prepare_ms = 0, wait_ms = 0, read_ms = 0;
+  for (int i = 0; i < iterations; ++i) {
+    double t0 = millis_since_boot();
+    cl_mem *input = frame.prepare(frames.cl[i % frames.cl.size()], cam.width, cam.height, cam.stride, cam.uv_offset, projection);
+    double t1 = millis_since_boot();
+    frame.wait();
+    double t2 = millis_since_boot();
+    frame.buffer_from_cl(input, frame.buf_size);
+    double t3 = millis_since_boot();
+    prepare_ms += t1 - t0;
+    wait_ms += t2 - t1;
+    read_ms += t3 - t2;
+  }
+  report(name.c_str(), "prepare", prepare_ms, iterations);
+  report(name.c_str(), "wait", wait_ms, iterations);
+  report(name.c_str(), "readback", read_ms, iterations);
+  report(name.c_str(), "total", prepare_ms + wait_ms + read_ms, iterations);
+  return ok;
+}
+
+int main(int argc, char *argv[]) {
+  int iterations = 100;
+  bool update_golden = false;
+  const char *recorded_camera = nullptr, *recorded_path = nullptr;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--update-golden") == 0) {
+      update_golden = true;
+    } else if (strcmp(argv[i], "--frames") == 0 && i + 2 < argc) {
+      recorded_camera = argv[++i];
+      recorded_path = argv[++i];
+    } else {
+      iterations = atoi(argv[i]);
+    }
+  }
+
+  cl_device_id device_id = cl_get_device_id(CL_DEVICE_TYPE_DEFAULT);
+  cl_context context = cl_create_context(device_id);
+  cl_command_queue q = CL_CHECK_ERR(clCreateCommandQueue(context, device_id, 0, &err));
+
+  Transform transform;
+  transform_init(&transform, context, device_id);
+
+  std::map<std::string, uint64_t> golden = read_golden();
+  bool ok = true;
+
+  for (const auto &cam : cameras) {
+    Frames frames;
+    frames.cam = &cam;
+    if (recorded_camera) {
+      if (strcmp(recorded_camera, cam.name) != 0) continue;
+      if (!load_frames(frames, recorded_path)) return 1;
+    } else {
+      for (int i = 0; i < NUM_FRAMES; ++i) {
+        frames.data.push_back(synthetic_frame(cam, i));
+      }
+    }
+    for (auto &data : frames.data) {
+      frames.cl.push_back(CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, cam.yuv_size, data.data(), &err)));
+    }
+    printf("%s %dx%d, %zu %s frames\n", cam.name, cam.width, cam.height, frames.data.size(), frames.synthetic ? "synthetic" : "recorded");
+
+    ok &= bench_kernels(device_id, context, q, &transform, frames, iterations);
+    ok &= bench_model_frame<DrivingModelFrame>(device_id, context, frames, "road", cam.road, golden, update_golden, iterations);
+    ok &= bench_model_frame<DrivingModelFrame>(device_id, context, frames, "wide", cam.wide, golden, update_golden, iterations);
+    ok &= bench_model_frame<MonitoringModelFrame>(device_id, context, frames, "driver", cam.driver, golden, update_golden, iterations);
+
+    for (cl_mem m : frames.cl) {
+      CL_CHECK(clReleaseMemObject(m));
+    }
+  }
+
+  if (update_golden) {
+    write_golden(golden);
+    printf("wrote %s\n", GOLDEN_PATH);
+  }
+
+  transform_destroy(&transform);
+  CL_CHECK(clReleaseCommandQueue(q));
+  cl_release_context(context);
+  return ok ? 0 : 1;
+}
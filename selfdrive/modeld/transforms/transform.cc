@@ -8,27 +8,33 @@
 void transform_init(Transform* s, cl_context ctx, cl_device_id device_id) {
   memset(s, 0, sizeof(*s));
 
-  cl_program prg = cl_program_from_file(ctx, device_id, TRANSFORM_PATH, "");
+  // the division in the coordinates may be off by up to 2.5 ulp otherwise, the native transform rounds it correctly
+  cl_device_fp_config fp_config;
+  CL_CHECK(clGetDeviceInfo(device_id, CL_DEVICE_SINGLE_FP_CONFIG, sizeof(fp_config), &fp_config, NULL));
+  const char *args = (fp_config & CL_FP_CORRECTLY_ROUNDED_DIVIDE_SQRT) ? "-cl-fp32-correctly-rounded-divide-sqrt" : "";
+
+  cl_program prg = cl_program_from_file(ctx, device_id, TRANSFORM_PATH, args);
   s->krnl = CL_CHECK_ERR(clCreateKernel(prg, "warpPerspective", &err));
+  s->packed_krnl = CL_CHECK_ERR(clCreateKernel(prg, "warpPerspectivePacked", &err));
   // done with this
   CL_CHECK(clReleaseProgram(prg));
-
-  s->m_y_cl = CL_CHECK_ERR(clCreateBuffer(ctx, CL_MEM_READ_WRITE, 3*3*sizeof(float), NULL, &err));
-  s->m_uv_cl = CL_CHECK_ERR(clCreateBuffer(ctx, CL_MEM_READ_WRITE, 3*3*sizeof(float), NULL, &err));
 }
 
 void transform_destroy(Transform* s) {
-  CL_CHECK(clReleaseMemObject(s->m_y_cl));
-  CL_CHECK(clReleaseMemObject(s->m_uv_cl));
   CL_CHECK(clReleaseKernel(s->krnl));
+  CL_CHECK(clReleaseKernel(s->packed_krnl));
 }
 
+// the matrices are kernel arguments, copied when they're set
+static_assert(sizeof(mat3) == 3*3*sizeof(float));
+
 void transform_queue(Transform* s,
                      cl_command_queue q,
                      cl_mem in_yuv, int in_width, int in_height, int in_stride, int in_uv_offset,
                      cl_mem out_y, cl_mem out_u, cl_mem out_v,
                      int out_width, int out_height,
-                     const mat3& projection) {
+                     const mat3& projection,
+                     cl_event *event) {
   const int zero = 0;
 
   // sampled using pixel center origin
@@ -39,9 +45,6 @@ void transform_queue(Transform* s,
   // in and out uv is half the size of y.
   mat3 projection_uv = transform_scale_buffer(projection, 0.5);
 
-  CL_CHECK(clEnqueueWriteBuffer(q, s->m_y_cl, CL_TRUE, 0, 3*3*sizeof(float), (void*)projection_y.v, 0, NULL, NULL));
-  CL_CHECK(clEnqueueWriteBuffer(q, s->m_uv_cl, CL_TRUE, 0, 3*3*sizeof(float), (void*)projection_uv.v, 0, NULL, NULL));
-
   const int in_y_width = in_width;
   const int in_y_height = in_height;
   const int in_y_px_stride = 1;
@@ -67,7 +70,7 @@ void transform_queue(Transform* s,
   CL_CHECK(clSetKernelArg(s->krnl, 8, sizeof(cl_int), &zero));  // dst_offset
   CL_CHECK(clSetKernelArg(s->krnl, 9, sizeof(cl_int), &out_y_height));  // dst_rows
   CL_CHECK(clSetKernelArg(s->krnl, 10, sizeof(cl_int), &out_y_width));  // dst_cols
-  CL_CHECK(clSetKernelArg(s->krnl, 11, sizeof(cl_mem), &s->m_y_cl));  // M
+  CL_CHECK(clSetKernelArg(s->krnl, 11, sizeof(mat3), &projection_y));  // M
 
   const size_t work_size_y[2] = {(size_t)out_y_width, (size_t)out_y_height};
 
@@ -85,7 +88,7 @@ void transform_queue(Transform* s,
   CL_CHECK(clSetKernelArg(s->krnl, 8, sizeof(cl_int), &zero));  // dst_offset
   CL_CHECK(clSetKernelArg(s->krnl, 9, sizeof(cl_int), &out_uv_height));  // dst_rows
   CL_CHECK(clSetKernelArg(s->krnl, 10, sizeof(cl_int), &out_uv_width));  // dst_cols
-  CL_CHECK(clSetKernelArg(s->krnl, 11, sizeof(cl_mem), &s->m_uv_cl));  // M
+  CL_CHECK(clSetKernelArg(s->krnl, 11, sizeof(mat3), &projection_uv));  // M
 
   CL_CHECK(clEnqueueNDRangeKernel(q, s->krnl, 2, NULL,
                               (const size_t*)&work_size_uv, NULL, 0, 0, NULL));
@@ -93,5 +96,30 @@ void transform_queue(Transform* s,
   CL_CHECK(clSetKernelArg(s->krnl, 6, sizeof(cl_mem), &out_v));  // dst
 
   CL_CHECK(clEnqueueNDRangeKernel(q, s->krnl, 2, NULL,
-                              (const size_t*)&work_size_uv, NULL, 0, 0, NULL));
+                              (const size_t*)&work_size_uv, NULL, 0, 0, event));
+}
+
+void transform_packed_queue(Transform* s, cl_command_queue q,
+                            cl_mem in_yuv, int in_width, int in_height, int in_stride, int in_uv_offset,
+                            cl_mem out0, cl_mem out1,
+                            int out_width, int out_height,
+                            const mat3& projection,
+                            cl_event *event) {
+  mat3 projection_uv = transform_scale_buffer(projection, 0.5);
+
+  CL_CHECK(clSetKernelArg(s->packed_krnl, 0, sizeof(cl_mem), &in_yuv));  // src
+  CL_CHECK(clSetKernelArg(s->packed_krnl, 1, sizeof(cl_int), &in_stride));  // src_row_stride
+  CL_CHECK(clSetKernelArg(s->packed_krnl, 2, sizeof(cl_int), &in_uv_offset));  // src_uv_offset
+  CL_CHECK(clSetKernelArg(s->packed_krnl, 3, sizeof(cl_int), &in_height));  // src_rows
+  CL_CHECK(clSetKernelArg(s->packed_krnl, 4, sizeof(cl_int), &in_width));  // src_cols
+  CL_CHECK(clSetKernelArg(s->packed_krnl, 5, sizeof(cl_mem), &out0));  // dst0
+  CL_CHECK(clSetKernelArg(s->packed_krnl, 6, sizeof(cl_mem), &out1));  // dst1
+  CL_CHECK(clSetKernelArg(s->packed_krnl, 7, sizeof(cl_int), &out_height));  // dst_rows
+  CL_CHECK(clSetKernelArg(s->packed_krnl, 8, sizeof(cl_int), &out_width));  // dst_cols
+  CL_CHECK(clSetKernelArg(s->packed_krnl, 9, sizeof(mat3), &projection));  // M_y
+  CL_CHECK(clSetKernelArg(s->packed_krnl, 10, sizeof(mat3), &projection_uv));  // M_uv
+
+  const size_t work_size[2] = {(size_t)out_width/2, (size_t)out_height/2};
+  CL_CHECK(clEnqueueNDRangeKernel(q, s->packed_krnl, 2, NULL,
+                              (const size_t*)&work_size, NULL, 0, 0, event));
 }
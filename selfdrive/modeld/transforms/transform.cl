@@ -1,3 +1,6 @@
+// contracting a * b + c would round differently than transform_cpu.cc
+#pragma OPENCL FP_CONTRACT OFF
+
 #define INTER_BITS 5
 #define INTER_TAB_SIZE (1 << INTER_BITS)
 #define INTER_SCALE 1.f / INTER_TAB_SIZE
@@ -5,50 +8,95 @@
 #define INTER_REMAP_COEF_BITS 15
 #define INTER_REMAP_COEF_SCALE (1 << INTER_REMAP_COEF_BITS)
 
+// passed by value, so queueing a transform doesn't wait for a buffer write
+typedef struct {
+    float v[9];
+} mat3;
+
+uchar warp_pixel(__global const uchar * src,
+                 int src_row_stride, int src_px_stride, int src_offset, int src_rows, int src_cols,
+                 const mat3 * M, int dx, int dy)
+{
+    float X0 = M->v[0] * dx + M->v[1] * dy + M->v[2];
+    float Y0 = M->v[3] * dx + M->v[4] * dy + M->v[5];
+    float W = M->v[6] * dx + M->v[7] * dy + M->v[8];
+    W = W != 0.0f ? INTER_TAB_SIZE / W : 0.0f;
+    int X = rint(X0 * W), Y = rint(Y0 * W);
+
+    int sx = convert_short_sat(X >> INTER_BITS);
+    int sy = convert_short_sat(Y >> INTER_BITS);
+
+    short sx_clamp = clamp(sx, 0, src_cols - 1);
+    short sx_p1_clamp = clamp(sx + 1, 0, src_cols - 1);
+    short sy_clamp = clamp(sy, 0, src_rows - 1);
+    short sy_p1_clamp = clamp(sy + 1, 0, src_rows - 1);
+    int v0 = convert_int(src[mad24(sy_clamp, src_row_stride, src_offset + sx_clamp*src_px_stride)]);
+    int v1 = convert_int(src[mad24(sy_clamp, src_row_stride, src_offset + sx_p1_clamp*src_px_stride)]);
+    int v2 = convert_int(src[mad24(sy_p1_clamp, src_row_stride, src_offset + sx_clamp*src_px_stride)]);
+    int v3 = convert_int(src[mad24(sy_p1_clamp, src_row_stride, src_offset + sx_p1_clamp*src_px_stride)]);
+
+    short ay = (short)(Y & (INTER_TAB_SIZE - 1));
+    short ax = (short)(X & (INTER_TAB_SIZE - 1));
+    float taby = 1.f/INTER_TAB_SIZE*ay;
+    float tabx = 1.f/INTER_TAB_SIZE*ax;
+
+    int itab0 = convert_short_sat_rte( (1.0f-taby)*(1.0f-tabx) * INTER_REMAP_COEF_SCALE );
+    int itab1 = convert_short_sat_rte( (1.0f-taby)*tabx * INTER_REMAP_COEF_SCALE );
+    int itab2 = convert_short_sat_rte( taby*(1.0f-tabx) * INTER_REMAP_COEF_SCALE );
+    int itab3 = convert_short_sat_rte( taby*tabx * INTER_REMAP_COEF_SCALE );
+
+    int val = v0 * itab0 +  v1 * itab1 + v2 * itab2 + v3 * itab3;
+
+    return convert_uchar_sat((val + (1 << (INTER_REMAP_COEF_BITS-1))) >> INTER_REMAP_COEF_BITS);
+}
+
 __kernel void warpPerspective(__global const uchar * src,
                               int src_row_stride, int src_px_stride, int src_offset, int src_rows, int src_cols,
                               __global uchar * dst,
                               int dst_row_stride, int dst_offset, int dst_rows, int dst_cols,
-                              __constant float * M)
+                              mat3 M)
 {
     int dx = get_global_id(0);
     int dy = get_global_id(1);
 
     if (dx < dst_cols && dy < dst_rows)
     {
-        float X0 = M[0] * dx + M[1] * dy + M[2];
-        float Y0 = M[3] * dx + M[4] * dy + M[5];
-        float W = M[6] * dx + M[7] * dy + M[8];
-        W = W != 0.0f ? INTER_TAB_SIZE / W : 0.0f;
-        int X = rint(X0 * W), Y = rint(Y0 * W);
-
-        int sx = convert_short_sat(X >> INTER_BITS);
-        int sy = convert_short_sat(Y >> INTER_BITS);
-
-        short sx_clamp = clamp(sx, 0, src_cols - 1);
-        short sx_p1_clamp = clamp(sx + 1, 0, src_cols - 1);
-        short sy_clamp = clamp(sy, 0, src_rows - 1);
-        short sy_p1_clamp = clamp(sy + 1, 0, src_rows - 1);
-        int v0 = convert_int(src[mad24(sy_clamp, src_row_stride, src_offset + sx_clamp*src_px_stride)]);
-        int v1 = convert_int(src[mad24(sy_clamp, src_row_stride, src_offset + sx_p1_clamp*src_px_stride)]);
-        int v2 = convert_int(src[mad24(sy_p1_clamp, src_row_stride, src_offset + sx_clamp*src_px_stride)]);
-        int v3 = convert_int(src[mad24(sy_p1_clamp, src_row_stride, src_offset + sx_p1_clamp*src_px_stride)]);
-
-        short ay = (short)(Y & (INTER_TAB_SIZE - 1));
-        short ax = (short)(X & (INTER_TAB_SIZE - 1));
-        float taby = 1.f/INTER_TAB_SIZE*ay;
-        float tabx = 1.f/INTER_TAB_SIZE*ax;
-
         int dst_index = mad24(dy, dst_row_stride, dst_offset + dx);
+        dst[dst_index] = warp_pixel(src, src_row_stride, src_px_stride, src_offset, src_rows, src_cols, &M, dx, dy);
+    }
+}
 
-        int itab0 = convert_short_sat_rte( (1.0f-taby)*(1.0f-tabx) * INTER_REMAP_COEF_SCALE );
-        int itab1 = convert_short_sat_rte( (1.0f-taby)*tabx * INTER_REMAP_COEF_SCALE );
-        int itab2 = convert_short_sat_rte( taby*(1.0f-tabx) * INTER_REMAP_COEF_SCALE );
-        int itab3 = convert_short_sat_rte( taby*tabx * INTER_REMAP_COEF_SCALE );
+// warpPerspective of Y, U and V followed by loadys/loaduv in one pass. Each work item
+// warps a 2x2 block of Y and one pixel of U and V, which all land at the same index of
+// the six planes of the model input. The frame is stored to two outputs, so each slot of
+// the frame history is written directly and never copied.
+__kernel void warpPerspectivePacked(__global const uchar * src,
+                                    int src_row_stride, int src_uv_offset, int src_rows, int src_cols,
+                                    __global uchar * dst0, __global uchar * dst1,
+                                    int dst_rows, int dst_cols,
+                                    mat3 M_y, mat3 M_uv)
+{
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+    int uv_cols = dst_cols / 2;
+    int uv_rows = dst_rows / 2;
 
-        int val = v0 * itab0 +  v1 * itab1 + v2 * itab2 + v3 * itab3;
+    if (x < uv_cols && y < uv_rows)
+    {
+        // planes: y of even rows/even cols, odd rows/even cols, even rows/odd cols, odd rows/odd cols, u, v
+        uchar pix[6];
+        pix[0] = warp_pixel(src, src_row_stride, 1, 0, src_rows, src_cols, &M_y, 2*x, 2*y);
+        pix[1] = warp_pixel(src, src_row_stride, 1, 0, src_rows, src_cols, &M_y, 2*x, 2*y + 1);
+        pix[2] = warp_pixel(src, src_row_stride, 1, 0, src_rows, src_cols, &M_y, 2*x + 1, 2*y);
+        pix[3] = warp_pixel(src, src_row_stride, 1, 0, src_rows, src_cols, &M_y, 2*x + 1, 2*y + 1);
+        pix[4] = warp_pixel(src, src_row_stride, 2, src_uv_offset, src_rows / 2, src_cols / 2, &M_uv, x, y);
+        pix[5] = warp_pixel(src, src_row_stride, 2, src_uv_offset + 1, src_rows / 2, src_cols / 2, &M_uv, x, y);
 
-        uchar pix = convert_uchar_sat((val + (1 << (INTER_REMAP_COEF_BITS-1))) >> INTER_REMAP_COEF_BITS);
-        dst[dst_index] = pix;
+        int uv_size = uv_cols * uv_rows;
+        int index = mad24(y, uv_cols, x);
+        for (int i = 0; i < 6; i++) {
+            dst0[mad24(i, uv_size, index)] = pix[i];
+            dst1[mad24(i, uv_size, index)] = pix[i];
+        }
     }
 }
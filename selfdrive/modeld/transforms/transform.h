@@ -10,8 +10,7 @@
 #include "common/mat.h"
 
 typedef struct {
-  cl_kernel krnl;
-  cl_mem m_y_cl, m_uv_cl;
+  cl_kernel krnl, packed_krnl;
 } Transform;
 
 void transform_init(Transform* s, cl_context ctx, cl_device_id device_id);
@@ -22,4 +21,14 @@ void transform_queue(Transform* s, cl_command_queue q,
                      cl_mem yuv, int in_width, int in_height, int in_stride, int in_uv_offset,
                      cl_mem out_y, cl_mem out_u, cl_mem out_v,
                      int out_width, int out_height,
-                     const mat3& projection);
+                     const mat3& projection,
+                     cl_event *event = nullptr);
+
+// transform_queue followed by loadyuv_queue in one kernel, the packed frame is written to both out0 and out1.
+// Nothing blocks, event (if given) completes when the frame is written
+void transform_packed_queue(Transform* s, cl_command_queue q,
+                            cl_mem yuv, int in_width, int in_height, int in_stride, int in_uv_offset,
+                            cl_mem out0, cl_mem out1,
+                            int out_width, int out_height,
+                            const mat3& projection,
+                            cl_event *event = nullptr);
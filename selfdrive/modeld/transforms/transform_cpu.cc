@@ -0,0 +1,234 @@
+#include "selfdrive/modeld/transforms/transform_cpu.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// contracting a * b + c would round differently than transform.cl
+#pragma STDC FP_CONTRACT OFF
+
+#define INTER_BITS 5
+#define INTER_TAB_SIZE (1 << INTER_BITS)
+
+#define INTER_REMAP_COEF_BITS 15
+#define INTER_REMAP_COEF_SCALE (1 << INTER_REMAP_COEF_BITS)
+
+// pixels whose coordinates are computed at once
+#define WARP_BLOCK 64
+
+// float to int conversion is saturated on the GPU, clamp to the largest floats that convert exactly
+#define COORD_MIN -2147483648.0f
+#define COORD_MAX 2147483520.0f
+
+struct InterTab {
+  int16_t coef[INTER_TAB_SIZE * INTER_TAB_SIZE][4];
+
+  InterTab() {
+    auto convert_short_sat_rte = [](float v) -> int16_t { return std::clamp(std::nearbyint(v), -32768.0f, 32767.0f); };
+
+    for (int ay = 0; ay < INTER_TAB_SIZE; ++ay) {
+      for (int ax = 0; ax < INTER_TAB_SIZE; ++ax) {
+        float taby = 1.f/INTER_TAB_SIZE*ay;
+        float tabx = 1.f/INTER_TAB_SIZE*ax;
+        int16_t *c = coef[ay * INTER_TAB_SIZE + ax];
+        c[0] = convert_short_sat_rte((1.0f-taby)*(1.0f-tabx) * INTER_REMAP_COEF_SCALE);
+        c[1] = convert_short_sat_rte((1.0f-taby)*tabx * INTER_REMAP_COEF_SCALE);
+        c[2] = convert_short_sat_rte(taby*(1.0f-tabx) * INTER_REMAP_COEF_SCALE);
+        c[3] = convert_short_sat_rte(taby*tabx * INTER_REMAP_COEF_SCALE);
+      }
+    }
+  }
+};
+
+static const InterTab inter_tab;
+
+// fixed point source coordinates of the pixels dx0..dx0+n on row dy
+typedef void (*CoordsFunc)(const float *M, int dy, int dx0, int n, int32_t *X, int32_t *Y);
+
+static inline int32_t round_coord(float v) {
+  v = v > COORD_MIN ? v : COORD_MIN;
+  v = v < COORD_MAX ? v : COORD_MAX;
+  return lrintf(v);
+}
+
+static void coords_scalar(const float *M, int dy, int dx0, int n, int32_t *X, int32_t *Y) {
+  for (int i = 0; i < n; ++i) {
+    const int dx = dx0 + i;
+    float X0 = M[0] * dx + M[1] * dy + M[2];
+    float Y0 = M[3] * dx + M[4] * dy + M[5];
+    float W = M[6] * dx + M[7] * dy + M[8];
+    W = W != 0.0f ? INTER_TAB_SIZE / W : 0.0f;
+    X[i] = round_coord(X0 * W);
+    Y[i] = round_coord(Y0 * W);
+  }
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2")))
+static void coords_avx2(const float *M, int dy, int dx0, int n, int32_t *X, int32_t *Y) {
+  const float fdy = dy;
+  const __m256 m0 = _mm256_set1_ps(M[0]), m3 = _mm256_set1_ps(M[3]), m6 = _mm256_set1_ps(M[6]);
+  const __m256 m1dy = _mm256_set1_ps(M[1] * fdy), m4dy = _mm256_set1_ps(M[4] * fdy), m7dy = _mm256_set1_ps(M[7] * fdy);
+  const __m256 m2 = _mm256_set1_ps(M[2]), m5 = _mm256_set1_ps(M[5]), m8 = _mm256_set1_ps(M[8]);
+  const __m256 tab_size = _mm256_set1_ps(INTER_TAB_SIZE), zero = _mm256_setzero_ps();
+  const __m256 coord_min = _mm256_set1_ps(COORD_MIN), coord_max = _mm256_set1_ps(COORD_MAX);
+  const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256 dx = _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(dx0 + i), lanes));
+    __m256 X0 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m0, dx), m1dy), m2);
+    __m256 Y0 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m3, dx), m4dy), m5);
+    __m256 W = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m6, dx), m7dy), m8);
+    W = _mm256_and_ps(_mm256_cmp_ps(W, zero, _CMP_NEQ_UQ), _mm256_div_ps(tab_size, W));
+
+    // max/min return the second operand for NaN, like the scalar comparisons
+    __m256 xf = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(X0, W), coord_min), coord_max);
+    __m256 yf = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(Y0, W), coord_min), coord_max);
+    _mm256_storeu_si256((__m256i *)&X[i], _mm256_cvtps_epi32(xf));
+    _mm256_storeu_si256((__m256i *)&Y[i], _mm256_cvtps_epi32(yf));
+  }
+  coords_scalar(M, dy, dx0 + i, n - i, X + i, Y + i);
+}
+#endif
+
+#if defined(__aarch64__)
+static void coords_neon(const float *M, int dy, int dx0, int n, int32_t *X, int32_t *Y) {
+  const float fdy = dy;
+  const float32x4_t m1dy = vdupq_n_f32(M[1] * fdy), m4dy = vdupq_n_f32(M[4] * fdy), m7dy = vdupq_n_f32(M[7] * fdy);
+  const float32x4_t tab_size = vdupq_n_f32(INTER_TAB_SIZE), zero = vdupq_n_f32(0.0f);
+  const float32x4_t coord_min = vdupq_n_f32(COORD_MIN), coord_max = vdupq_n_f32(COORD_MAX);
+  const int32_t lane_init[4] = {0, 1, 2, 3};
+  const int32x4_t lanes = vld1q_s32(lane_init);
+
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const float32x4_t dx = vcvtq_f32_s32(vaddq_s32(vdupq_n_s32(dx0 + i), lanes));
+    float32x4_t X0 = vaddq_f32(vaddq_f32(vmulq_n_f32(dx, M[0]), m1dy), vdupq_n_f32(M[2]));
+    float32x4_t Y0 = vaddq_f32(vaddq_f32(vmulq_n_f32(dx, M[3]), m4dy), vdupq_n_f32(M[5]));
+    float32x4_t W = vaddq_f32(vaddq_f32(vmulq_n_f32(dx, M[6]), m7dy), vdupq_n_f32(M[8]));
+    const uint32x4_t nonzero = vmvnq_u32(vceqq_f32(W, zero));
+    W = vreinterpretq_f32_u32(vandq_u32(nonzero, vreinterpretq_u32_f32(vdivq_f32(tab_size, W))));
+
+    // vmaxnmq/vminnmq return the number for NaN, like the scalar comparisons
+    float32x4_t xf = vminnmq_f32(vmaxnmq_f32(vmulq_f32(X0, W), coord_min), coord_max);
+    float32x4_t yf = vminnmq_f32(vmaxnmq_f32(vmulq_f32(Y0, W), coord_min), coord_max);
+    vst1q_s32(&X[i], vcvtnq_s32_f32(xf));
+    vst1q_s32(&Y[i], vcvtnq_s32_f32(yf));
+  }
+  coords_scalar(M, dy, dx0 + i, n - i, X + i, Y + i);
+}
+#endif
+
+static CoordsFunc get_coords_func() {
+#if defined(__x86_64__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return coords_avx2;
+#elif defined(__aarch64__)
+  return coords_neon;
+#endif
+  return coords_scalar;
+}
+
+static const CoordsFunc coords = get_coords_func();
+
+static inline int sat_short(int v) {
+  return std::clamp(v, -32768, 32767);
+}
+
+// warps row dy of the destination into dst
+static void warp_row(const uint8_t *src, int src_row_stride, int src_px_stride, int src_offset, int src_rows, int src_cols,
+                     uint8_t *dst, int dy, int dst_cols, const float *M) {
+  int32_t X[WARP_BLOCK], Y[WARP_BLOCK];
+
+  for (int dx0 = 0; dx0 < dst_cols; dx0 += WARP_BLOCK) {
+    const int n = std::min(WARP_BLOCK, dst_cols - dx0);
+    coords(M, dy, dx0, n, X, Y);
+
+    // the bilinear sample gathers from two rows at arbitrary columns, it stays scalar
+    for (int i = 0; i < n; ++i) {
+      const int sx = sat_short(X[i] >> INTER_BITS);
+      const int sy = sat_short(Y[i] >> INTER_BITS);
+      const int sx_clamp = std::clamp(sx, 0, src_cols - 1) * src_px_stride;
+      const int sx_p1_clamp = std::clamp(sx + 1, 0, src_cols - 1) * src_px_stride;
+      const uint8_t *row0 = src + std::clamp(sy, 0, src_rows - 1) * src_row_stride + src_offset;
+      const uint8_t *row1 = src + std::clamp(sy + 1, 0, src_rows - 1) * src_row_stride + src_offset;
+
+      const int16_t *c = inter_tab.coef[(Y[i] & (INTER_TAB_SIZE - 1)) * INTER_TAB_SIZE + (X[i] & (INTER_TAB_SIZE - 1))];
+      int val = row0[sx_clamp] * c[0] + row0[sx_p1_clamp] * c[1] + row1[sx_clamp] * c[2] + row1[sx_p1_clamp] * c[3];
+      dst[dx0 + i] = std::clamp((val + (1 << (INTER_REMAP_COEF_BITS-1))) >> INTER_REMAP_COEF_BITS, 0, 255);
+    }
+  }
+}
+
+void warp_perspective_cpu(const uint8_t *src, int src_row_stride, int src_px_stride, int src_offset, int src_rows, int src_cols,
+                          uint8_t *dst, int dst_row_stride, int dst_rows, int dst_cols,
+                          const mat3 &M) {
+  for (int dy = 0; dy < dst_rows; ++dy) {
+    warp_row(src, src_row_stride, src_px_stride, src_offset, src_rows, src_cols, dst + dy * dst_row_stride, dy, dst_cols, M.v);
+  }
+}
+
+void transform_cpu(const uint8_t *yuv, int in_width, int in_height, int in_stride, int in_uv_offset,
+                   uint8_t *out_y, uint8_t *out_u, uint8_t *out_v,
+                   int out_width, int out_height,
+                   const mat3 &projection) {
+  // in and out uv is half the size of y.
+  const mat3 projection_uv = transform_scale_buffer(projection, 0.5);
+
+  warp_perspective_cpu(yuv, in_stride, 1, 0, in_height, in_width,
+                       out_y, out_width, out_height, out_width, projection);
+  warp_perspective_cpu(yuv, in_stride, 2, in_uv_offset, in_height / 2, in_width / 2,
+                       out_u, out_width / 2, out_height / 2, out_width / 2, projection_uv);
+  warp_perspective_cpu(yuv, in_stride, 2, in_uv_offset + 1, in_height / 2, in_width / 2,
+                       out_v, out_width / 2, out_height / 2, out_width / 2, projection_uv);
+}
+
+// splits row y of the Y plane into the four subsampled planes of the model input.
+// even rows go to planes 0 and 2, odd rows to 1 and 3, even columns to the lower one
+static inline void pack_y_row(const uint8_t *row, uint8_t *out, int y, int width, int height) {
+  const int uv_size = (width / 2) * (height / 2);
+  uint8_t *even = out + (y & 1) * uv_size + (y / 2) * (width / 2);
+  uint8_t *odd = even + 2 * uv_size;
+  for (int x = 0; x < width / 2; ++x) {
+    even[x] = row[2 * x];
+    odd[x] = row[2 * x + 1];
+  }
+}
+
+void loadyuv_cpu(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *out, int width, int height) {
+  assert(width % 2 == 0 && height % 2 == 0);
+  const int uv_size = (width / 2) * (height / 2);
+
+  for (int row = 0; row < height; ++row) {
+    pack_y_row(y + row * width, out, row, width, height);
+  }
+  memcpy(out + 4 * uv_size, u, uv_size);
+  memcpy(out + 5 * uv_size, v, uv_size);
+}
+
+void transform_loadyuv_cpu(const uint8_t *yuv, int in_width, int in_height, int in_stride, int in_uv_offset,
+                           uint8_t *out, int out_width, int out_height,
+                           const mat3 &projection) {
+  assert(out_width % 2 == 0 && out_height % 2 == 0);
+  const int uv_size = (out_width / 2) * (out_height / 2);
+  const mat3 projection_uv = transform_scale_buffer(projection, 0.5);
+
+  std::vector<uint8_t> row(out_width);
+  for (int dy = 0; dy < out_height; ++dy) {
+    warp_row(yuv, in_stride, 1, 0, in_height, in_width, row.data(), dy, out_width, projection.v);
+    pack_y_row(row.data(), out, dy, out_width, out_height);
+  }
+  warp_perspective_cpu(yuv, in_stride, 2, in_uv_offset, in_height / 2, in_width / 2,
+                       out + 4 * uv_size, out_width / 2, out_height / 2, out_width / 2, projection_uv);
+  warp_perspective_cpu(yuv, in_stride, 2, in_uv_offset + 1, in_height / 2, in_width / 2,
+                       out + 5 * uv_size, out_width / 2, out_height / 2, out_width / 2, projection_uv);
+}
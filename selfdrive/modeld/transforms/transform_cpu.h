@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+
+#include "common/mat.h"
+
+// Native implementation of transform.cl and loadyuv.cl, used when the OpenCL device is a CPU.
+// The warp uses the kernel's fixed point bilinear interpolation, and its coordinate
+// math is done in the same order in single precision without fused multiply-adds,
+// so the output matches the kernels bit for bit on devices that don't contract them either.
+
+void warp_perspective_cpu(const uint8_t *src, int src_row_stride, int src_px_stride, int src_offset, int src_rows, int src_cols,
+                          uint8_t *dst, int dst_row_stride, int dst_rows, int dst_cols,
+                          const mat3 &M);
+
+// same as transform_queue
+void transform_cpu(const uint8_t *yuv, int in_width, int in_height, int in_stride, int in_uv_offset,
+                   uint8_t *out_y, uint8_t *out_u, uint8_t *out_v,
+                   int out_width, int out_height,
+                   const mat3 &projection);
+
+// same as loadyuv_queue
+void loadyuv_cpu(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *out, int width, int height);
+
+// transform_cpu followed by loadyuv_cpu, writing the warped frame straight into the model input layout
+void transform_loadyuv_cpu(const uint8_t *yuv, int in_width, int in_height, int in_stride, int in_uv_offset,
+                           uint8_t *out, int out_width, int out_height,
+                           const mat3 &projection);
@@ -0,0 +1,117 @@
+#include "selfdrive/pandad/can_ring.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+#include "common/util.h"
+#include "system/hardware/hw.h"
+
+std::string can_ring_path() {
+  const std::string prefix = Path::openpilot_prefix();
+  return Path::shm_path() + (prefix.empty() ? "" : "/" + prefix) + "/can_ring";
+}
+
+// maps the ring, creating it if neither side has yet
+static can_ring_shm *map_ring() {
+  const std::string path = can_ring_path();
+  int fd = open(path.c_str(), O_RDWR | O_CREAT, 0664);
+  if (fd < 0) {
+    throw std::runtime_error("failed to open " + path);
+  }
+
+  struct stat st = {};
+  int ret = fstat(fd, &st);
+  if (ret == 0 && st.st_size != sizeof(can_ring_shm)) {
+    ret = ftruncate(fd, sizeof(can_ring_shm));
+  }
+  void *mem = ret == 0 ? mmap(NULL, sizeof(can_ring_shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+  close(fd);
+  if (mem == MAP_FAILED) {
+    throw std::runtime_error("failed to map " + path);
+  }
+  return (can_ring_shm *)mem;
+}
+
+CanRingWriter::CanRingWriter() {
+  shm = map_ring();
+  if (shm->magic != CAN_RING_MAGIC || shm->size != CAN_RING_SIZE) {
+    for (auto &slot : shm->slots) {
+      slot.seq.store(UINT64_MAX, std::memory_order_relaxed);
+    }
+    shm->size = CAN_RING_SIZE;
+    shm->magic = CAN_RING_MAGIC;
+  }
+  // continue the sequence of a previous pandad, so attached readers keep their place
+  seq = shm->write_seq.load(std::memory_order_acquire);
+}
+
+CanRingWriter::~CanRingWriter() {
+  munmap(shm, sizeof(can_ring_shm));
+}
+
+void CanRingWriter::push(uint64_t mono_time, uint32_t address, uint8_t src, const uint8_t *dat, uint8_t len) {
+  assert(len <= sizeof(can_ring_frame::dat));
+  can_ring_slot &slot = shm->slots[seq % CAN_RING_SIZE];
+
+  // invalidate first, so a reader copying the old frame sees it changed
+  slot.seq.store(UINT64_MAX, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  slot.frame.mono_time = mono_time;
+  slot.frame.address = address;
+  slot.frame.src = src;
+  slot.frame.len = len;
+  memcpy(slot.frame.dat, dat, len);
+
+  slot.seq.store(seq, std::memory_order_release);
+  ++seq;
+}
+
+void CanRingWriter::publish() {
+  shm->write_seq.store(seq, std::memory_order_release);
+}
+
+CanRingReader::CanRingReader() {
+  shm = map_ring();
+  cursor = shm->write_seq.load(std::memory_order_acquire);
+}
+
+CanRingReader::~CanRingReader() {
+  munmap(shm, sizeof(can_ring_shm));
+}
+
+size_t CanRingReader::read(can_ring_frame *out, size_t max) {
+  const uint64_t write_seq = shm->write_seq.load(std::memory_order_acquire);
+  if (cursor > write_seq) {
+    // the ring was recreated
+    cursor = write_seq;
+  } else if (write_seq - cursor > CAN_RING_SIZE) {
+    dropped += write_seq - CAN_RING_SIZE - cursor;
+    cursor = write_seq - CAN_RING_SIZE;
+  }
+
+  size_t cnt = 0;
+  while (cnt < max && cursor < write_seq) {
+    const can_ring_slot &slot = shm->slots[cursor % CAN_RING_SIZE];
+    if (slot.seq.load(std::memory_order_acquire) == cursor) {
+      memcpy(&out[cnt], &slot.frame, sizeof(can_ring_frame));
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot.seq.load(std::memory_order_relaxed) == cursor) {
+        ++cnt;
+        ++cursor;
+        continue;
+      }
+    }
+
+    // the writer lapped us and overwrote this frame
+    ++dropped;
+    ++cursor;
+  }
+  return cnt;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Shared memory ring of raw CAN frames, written by pandad next to the can service.
+// C++ consumers read fixed-size records with their own cursor, without any capnp decoding.
+// There's a single writer, readers never block it, a reader that falls more than
+// the ring size behind skips ahead and counts the frames it lost.
+
+#define CAN_RING_SIZE (1 << 16)  // frames, a power of 2
+#define CAN_RING_MAGIC 0x474e4952u
+
+struct can_ring_frame {
+  uint64_t mono_time;  // nanos_since_boot() when the frame was read from the panda
+  uint32_t address;
+  uint8_t src;
+  uint8_t len;
+  uint8_t dat[64];
+};
+
+struct can_ring_slot {
+  std::atomic<uint64_t> seq;  // sequence number of the frame in the slot, UINT64_MAX while it's written
+  can_ring_frame frame;
+};
+
+struct can_ring_shm {
+  uint32_t magic;
+  uint32_t size;
+  std::atomic<uint64_t> write_seq;  // sequence number of the next frame
+  can_ring_slot slots[CAN_RING_SIZE];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free);
+
+std::string can_ring_path();
+
+class CanRingWriter {
+public:
+  CanRingWriter();
+  ~CanRingWriter();
+  // frames become visible to the readers on publish()
+  void push(uint64_t mono_time, uint32_t address, uint8_t src, const uint8_t *dat, uint8_t len);
+  void publish();
+
+private:
+  can_ring_shm *shm = nullptr;
+  uint64_t seq = 0;
+};
+
+class CanRingReader {
+public:
+  // starts at the newest frame, only frames written from now on are read
+  CanRingReader();
+  ~CanRingReader();
+  // copies up to max frames after the cursor, returns how many
+  size_t read(can_ring_frame *out, size_t max);
+
+  uint64_t dropped = 0;
+
+private:
+  can_ring_shm *shm = nullptr;
+  uint64_t cursor = 0;
+};
@@ -2,6 +2,7 @@
 
 #include <unistd.h>
 
+#include <algorithm>
 #include <cassert>
 #include <stdexcept>
 #include <vector>
@@ -30,6 +31,11 @@ Panda::Panda(std::string serial, uint32_t bus_offset) : bus_offset(bus_offset) {
   can_reset_communications();
 }
 
+Panda::Panda(std::unique_ptr<PandaCommsHandle> comms_handle, uint32_t bus_offset) : handle(std::move(comms_handle)), bus_offset(bus_offset) {
+  hw_type = get_hw_type();
+  can_reset_communications();
+}
+
 bool Panda::connected() {
   return handle->connected;
 }
@@ -99,6 +105,19 @@ std::optional<can_health_t> Panda::get_can_state(uint16_t can_number) {
   return err >= 0 ? std::make_optional(can_health) : std::nullopt;
 }
 
+// health and every bus's CAN health, read straight into the caller's structs
+bool Panda::get_states(health_t &health, std::array<can_health_t, PANDA_CAN_CNT> &can_health) {
+  bool ok = handle->control_read(0xd2, 0, 0, (unsigned char*)&health, sizeof(health)) >= 0;
+  for (uint16_t i = 0; i < PANDA_CAN_CNT; i++) {
+    ok &= handle->control_read(0xc2, i, 0, (unsigned char*)&can_health[i], sizeof(can_health_t)) >= 0;
+  }
+  return ok;
+}
+
+std::string Panda::comms_latency() {
+  return "control [" + handle->control_latency.to_string() + "] bulk [" + handle->bulk_latency.to_string() + "]";
+}
+
 void Panda::set_loopback(bool loopback) {
   handle->control_write(0xe5, loopback, 0);
 }
@@ -168,6 +187,60 @@ static uint8_t len_to_dlc(uint8_t len) {
   }
 }
 
+uint32_t Panda::pack_can_frame(uint8_t *dst, uint32_t address, uint8_t bus, const uint8_t *dat, uint8_t len) {
+  uint8_t data_len_code = len_to_dlc(len);
+  assert(len <= 64);
+  assert(len == dlc_to_len[data_len_code]);
+
+  can_header header = {};
+  header.addr = address;
+  header.extended = (address >= 0x800) ? 1 : 0;
+  header.data_len_code = data_len_code;
+  header.bus = bus;
+  header.checksum = 0;
+
+  memcpy(dst, (uint8_t *)&header, sizeof(can_header));
+  memcpy(dst + sizeof(can_header), dat, len);
+  uint32_t msg_size = sizeof(can_header) + len;
+
+  // set checksum
+  ((can_header *)dst)->checksum = calculate_checksum(dst, msg_size);
+  return msg_size;
+}
+
+// Packs the frames of every panda in a single pass over the list, frames on bus b go to
+// out[b / PANDA_BUS_OFFSET]. The chunks end on frame boundaries, like pack_can_buffer's.
+void Panda::pack_can_buffers(const capnp::List<cereal::CanData>::Reader &can_data_list, std::vector<can_send_buffer> &out) {
+  for (auto &buf : out) {
+    buf.data.clear();
+    buf.chunk_ends.clear();
+  }
+
+  for (const auto &cmsg : can_data_list) {
+    const uint8_t bus = cmsg.getSrc();
+    if (bus / PANDA_BUS_OFFSET >= out.size()) {
+      continue;
+    }
+
+    can_send_buffer &buf = out[bus / PANDA_BUS_OFFSET];
+    auto can_data = cmsg.getDat();
+    const size_t pos = buf.data.size();
+    buf.data.resize(pos + sizeof(can_header) + can_data.size());
+    pack_can_frame(&buf.data[pos], cmsg.getAddress(), bus % PANDA_BUS_OFFSET, can_data.begin(), can_data.size());
+
+    const uint32_t chunk_start = buf.chunk_ends.empty() ? 0 : buf.chunk_ends.back();
+    if (buf.data.size() - chunk_start >= USB_TX_SOFT_LIMIT) {
+      buf.chunk_ends.push_back(buf.data.size());
+    }
+  }
+
+  for (auto &buf : out) {
+    if (buf.data.size() > (buf.chunk_ends.empty() ? 0 : buf.chunk_ends.back())) {
+      buf.chunk_ends.push_back(buf.data.size());
+    }
+  }
+}
+
 void Panda::pack_can_buffer(const capnp::List<cereal::CanData>::Reader &can_data_list,
                             std::function<void(uint8_t *, size_t)> write_func) {
   int32_t pos = 0;
@@ -180,25 +253,7 @@ void Panda::pack_can_buffer(const capnp::List<cereal::CanData>::Reader &can_data
       continue;
     }
     auto can_data = cmsg.getDat();
-    uint8_t data_len_code = len_to_dlc(can_data.size());
-    assert(can_data.size() <= 64);
-    assert(can_data.size() == dlc_to_len[data_len_code]);
-
-    can_header header = {};
-    header.addr = cmsg.getAddress();
-    header.extended = (cmsg.getAddress() >= 0x800) ? 1 : 0;
-    header.data_len_code = data_len_code;
-    header.bus = bus - bus_offset;
-    header.checksum = 0;
-
-    memcpy(&send_buf[pos], (uint8_t *)&header, sizeof(can_header));
-    memcpy(&send_buf[pos + sizeof(can_header)], (uint8_t *)can_data.begin(), can_data.size());
-    uint32_t msg_size = sizeof(can_header) + can_data.size();
-
-    // set checksum
-    ((can_header *) &send_buf[pos])->checksum = calculate_checksum(&send_buf[pos], msg_size);
-
-    pos += msg_size;
+    pos += pack_can_frame(&send_buf[pos], cmsg.getAddress(), bus - bus_offset, can_data.begin(), can_data.size());
 
     if (pos >= USB_TX_SOFT_LIMIT) {
       write_func(send_buf, pos);
@@ -216,9 +271,31 @@ void Panda::can_send(const capnp::List<cereal::CanData>::Reader &can_data_list)
   });
 }
 
+void Panda::can_send(can_send_buffer &buf) {
+  uint32_t chunk_start = 0;
+  for (uint32_t chunk_end : buf.chunk_ends) {
+    handle->bulk_write(3, &buf.data[chunk_start], chunk_end - chunk_start, 5);
+    chunk_start = chunk_end;
+  }
+}
+
 bool Panda::can_receive(std::vector<can_frame>& out_vec) {
-  // Check if enough space left in buffer to store RECV_SIZE data
-  assert(receive_buffer_size + RECV_SIZE <= sizeof(receive_buffer));
+  std::vector<can_frame_desc> frames;
+  bool ret = can_receive(frames);
+  for (const auto &f : frames) {
+    out_vec.push_back({f.address, std::string((char *)f.dat, f.len), f.src});
+  }
+  return ret;
+}
+
+bool Panda::can_receive(std::vector<can_frame_desc>& out_vec) {
+  // only the partial frame at the read cursor is kept, so this moves at most one frame
+  if (receive_buffer_size + RECV_SIZE > sizeof(receive_buffer)) {
+    const uint32_t tail = receive_buffer_size - receive_buffer_pos;
+    memmove(receive_buffer, &receive_buffer[receive_buffer_pos], tail);
+    receive_buffer_pos = 0;
+    receive_buffer_size = tail;
+  }
 
   int recv = handle->bulk_read(0x81, &receive_buffer[receive_buffer_size], RECV_SIZE);
   if (!comms_healthy()) {
@@ -230,12 +307,22 @@ bool Panda::can_receive(std::vector<can_frame>& out_vec) {
     handle->bulk_read(0xab, junk, RECV_SIZE - recv);
   }
 
-  bool ret = true;
   if (recv > 0) {
     receive_buffer_size += recv;
-    ret = unpack_can_buffer(receive_buffer, receive_buffer_size, out_vec);
+    int consumed = decode_can_frames(&receive_buffer[receive_buffer_pos], receive_buffer_size - receive_buffer_pos, out_vec);
+    if (consumed < 0) {
+      LOGE("Panda CAN checksum failed");
+      receive_buffer_pos = receive_buffer_size = 0;
+      can_reset_communications();
+      return false;
+    }
+
+    receive_buffer_pos += consumed;
+    if (receive_buffer_pos == receive_buffer_size) {
+      receive_buffer_pos = receive_buffer_size = 0;
+    }
   }
-  return ret;
+  return true;
 }
 
 void Panda::can_reset_communications() {
@@ -243,50 +330,77 @@ void Panda::can_reset_communications() {
 }
 
 bool Panda::unpack_can_buffer(uint8_t *data, uint32_t &size, std::vector<can_frame> &out_vec) {
-  int pos = 0;
+  std::vector<can_frame_desc> frames;
+  int consumed = decode_can_frames(data, size, frames);
+  for (const auto &f : frames) {
+    out_vec.push_back({f.address, std::string((char *)f.dat, f.len), f.src});
+  }
+
+  if (consumed < 0) {
+    LOGE("Panda CAN checksum failed");
+    size = 0;
+    can_reset_communications();
+    return false;
+  }
+
+  // move the overflowing data to the beginning of the buffer for the next round
+  memmove(data, &data[consumed], size - consumed);
+  size -= consumed;
+  return true;
+}
 
-  while (pos <= size - sizeof(can_header)) {
-    can_header header;
-    memcpy(&header, &data[pos], sizeof(can_header));
+// Walks all the complete frames in data once, emitting a descriptor for each. Returns
+// the number of bytes consumed, the rest is a partial frame, or -1 on a bad checksum.
+int Panda::decode_can_frames(const uint8_t *data, uint32_t size, std::vector<can_frame_desc> &out_vec) {
+  uint32_t pos = 0;
 
-    const uint8_t data_len = dlc_to_len[header.data_len_code];
-    if (pos + sizeof(can_header) + data_len > size) {
+  while (pos + sizeof(can_header) <= size) {
+    const can_header *header = (const can_header *)&data[pos];
+    const uint32_t frame_len = sizeof(can_header) + dlc_to_len[header->data_len_code];
+    if (pos + frame_len > size) {
       // we don't have all the data for this message yet
       break;
     }
 
-    if (calculate_checksum(&data[pos], sizeof(can_header) + data_len) != 0) {
-      LOGE("Panda CAN checksum failed");
-      size = 0;
-      can_reset_communications();
-      return false;
+    if (calculate_checksum(&data[pos], frame_len) != 0) {
+      return -1;
     }
 
-    can_frame &canData = out_vec.emplace_back();
-    canData.address = header.addr;
-    canData.src = header.bus + bus_offset;
-    if (header.rejected) {
-      canData.src += CAN_REJECTED_BUS_OFFSET;
+    uint8_t src = header->bus + bus_offset;
+    if (header->rejected) {
+      src += CAN_REJECTED_BUS_OFFSET;
     }
-    if (header.returned) {
-      canData.src += CAN_RETURNED_BUS_OFFSET;
+    if (header->returned) {
+      src += CAN_RETURNED_BUS_OFFSET;
     }
-
-    canData.dat.assign((char *)&data[pos + sizeof(can_header)], data_len);
-
-    pos += sizeof(can_header) + data_len;
+    out_vec.push_back({
+      .dat = &data[pos + sizeof(can_header)],
+      .address = header->addr,
+      .src = src,
+      .len = (uint8_t)(frame_len - sizeof(can_header)),
+    });
+
+    pos += frame_len;
   }
 
-  // move the overflowing data to the beginning of the buffer for the next round
-  memmove(data, &data[pos], size - pos);
-  size -= pos;
-
-  return true;
+  return pos;
 }
 
-uint8_t Panda::calculate_checksum(uint8_t *data, uint32_t len) {
-  uint8_t checksum = 0U;
-  for (uint32_t i = 0U; i < len; i++) {
+// XOR of all bytes, 8 at a time
+uint8_t Panda::calculate_checksum(const uint8_t *data, uint32_t len) {
+  uint64_t lanes = 0;
+  uint32_t i = 0;
+  for (; i + sizeof(lanes) <= len; i += sizeof(lanes)) {
+    uint64_t v;
+    memcpy(&v, &data[i], sizeof(v));
+    lanes ^= v;
+  }
+  lanes ^= lanes >> 32;
+  lanes ^= lanes >> 16;
+  lanes ^= lanes >> 8;
+
+  uint8_t checksum = lanes;
+  for (; i < len; i++) {
     checksum ^= data[i];
   }
   return checksum;
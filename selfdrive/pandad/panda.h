@@ -1,5 +1,6 @@
 #pragma once
 
+#include <array>
 #include <cstdint>
 #include <ctime>
 #include <functional>
@@ -19,6 +20,7 @@
 #define USBPACKET_MAX_SIZE  (0x40)
 
 #define RECV_SIZE (0x4000U)
+#define RECEIVE_BUFFER_SIZE (4 * RECV_SIZE)
 
 #define CAN_REJECTED_BUS_OFFSET   0xC0U
 #define CAN_RETURNED_BUS_OFFSET 0x80U
@@ -42,6 +44,24 @@ struct can_frame {
   long src;
 };
 
+// received frame, the payload points into the panda's receive buffer
+// and stays valid until the next can_receive() on that panda
+struct can_frame_desc {
+  const uint8_t *dat;
+  uint32_t address;
+  uint8_t src;
+  uint8_t len;
+};
+
+// wire format frames for one panda, and the ends of the bulk write chunks to send them in
+struct can_send_buffer {
+  std::vector<uint8_t> data;
+  std::vector<uint32_t> chunk_ends;
+};
+
+// most frames a single receive can produce, a full buffer of empty frames
+#define MAX_RECV_FRAMES ((RECV_SIZE + sizeof(can_header) + 64) / sizeof(can_header))
+
 
 class Panda {
 private:
@@ -49,6 +69,7 @@ private:
 
 public:
   Panda(std::string serial="", uint32_t bus_offset=0);
+  Panda(std::unique_ptr<PandaCommsHandle> comms_handle, uint32_t bus_offset=0);
 
   cereal::PandaState::PandaType hw_type = cereal::PandaState::PandaType::UNKNOWN;
   const uint32_t bus_offset;
@@ -69,6 +90,8 @@ public:
   void set_ir_pwr(uint16_t ir_pwr);
   std::optional<health_t> get_state();
   std::optional<can_health_t> get_can_state(uint16_t can_number);
+  bool get_states(health_t &health, std::array<can_health_t, PANDA_CAN_CNT> &can_health);
+  std::string comms_latency();
   void set_loopback(bool loopback);
   std::optional<std::vector<uint8_t>> get_firmware_version();
   bool up_to_date();
@@ -81,17 +104,23 @@ public:
   void set_data_speed_kbps(uint16_t bus, uint16_t speed);
   void set_canfd_non_iso(uint16_t bus, bool non_iso);
   void can_send(const capnp::List<cereal::CanData>::Reader &can_data_list);
+  void can_send(can_send_buffer &buf);
+  static void pack_can_buffers(const capnp::List<cereal::CanData>::Reader &can_data_list, std::vector<can_send_buffer> &out);
   bool can_receive(std::vector<can_frame>& out_vec);
+  bool can_receive(std::vector<can_frame_desc>& out_vec);
   void can_reset_communications();
 
 protected:
-  // for unit tests
-  uint8_t receive_buffer[RECV_SIZE + sizeof(can_header) + 64];
+  // frames are decoded in place, between the read and write cursors
+  uint8_t receive_buffer[RECEIVE_BUFFER_SIZE];
+  uint32_t receive_buffer_pos = 0;
   uint32_t receive_buffer_size = 0;
 
   Panda(uint32_t bus_offset) : bus_offset(bus_offset) {}
   void pack_can_buffer(const capnp::List<cereal::CanData>::Reader &can_data_list,
                          std::function<void(uint8_t *, size_t)> write_func);
   bool unpack_can_buffer(uint8_t *data, uint32_t &size, std::vector<can_frame> &out_vec);
-  uint8_t calculate_checksum(uint8_t *data, uint32_t len);
+  int decode_can_frames(const uint8_t *data, uint32_t size, std::vector<can_frame_desc> &out_vec);
+  static uint32_t pack_can_frame(uint8_t *dst, uint32_t address, uint8_t bus, const uint8_t *dat, uint8_t len);
+  static uint8_t calculate_checksum(const uint8_t *data, uint32_t len);
 };
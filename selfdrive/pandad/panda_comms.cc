@@ -148,6 +148,7 @@ int PandaUsbHandle::control_write(uint8_t bRequest, uint16_t wValue, uint16_t wI
     return LIBUSB_ERROR_NO_DEVICE;
   }
 
+  TransferTimer timer{control_latency};
   std::lock_guard lk(hw_lock);
   do {
     err = libusb_control_transfer(dev_handle, bmRequestType, bRequest, wValue, wIndex, NULL, 0, timeout);
@@ -165,6 +166,7 @@ int PandaUsbHandle::control_read(uint8_t bRequest, uint16_t wValue, uint16_t wIn
     return LIBUSB_ERROR_NO_DEVICE;
   }
 
+  TransferTimer timer{control_latency};
   std::lock_guard lk(hw_lock);
   do {
     err = libusb_control_transfer(dev_handle, bmRequestType, bRequest, wValue, wIndex, data, wLength, timeout);
@@ -182,6 +184,7 @@ int PandaUsbHandle::bulk_write(unsigned char endpoint, unsigned char* data, int
     return 0;
   }
 
+  TransferTimer timer{bulk_latency};
   std::lock_guard lk(hw_lock);
   do {
     // Try sending can messages. If the receive buffer on the panda is full it will NAK
@@ -207,6 +210,7 @@ int PandaUsbHandle::bulk_read(unsigned char endpoint, unsigned char* data, int l
     return 0;
   }
 
+  TransferTimer timer{bulk_latency};
   std::lock_guard lk(hw_lock);
 
   do {
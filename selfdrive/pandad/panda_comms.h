@@ -1,5 +1,6 @@
 #pragma once
 
+#include <array>
 #include <atomic>
 #include <cstdint>
 #include <mutex>
@@ -12,10 +13,41 @@
 
 #include <libusb-1.0/libusb.h>
 
+#include "common/timing.h"
+
 
 #define TIMEOUT 0
 #define SPI_BUF_SIZE 2048
+#define LATENCY_BUCKETS 16
+
+
+// bucket i counts the transfers that took [2^i, 2^(i+1)) us
+struct latency_histogram {
+  std::array<std::atomic<uint32_t>, LATENCY_BUCKETS> buckets = {};
+
+  void add(double us) {
+    int i = 0;
+    while (i < LATENCY_BUCKETS - 1 && us >= (2 << i)) i++;
+    buckets[i]++;
+  }
+
+  std::string to_string() const {
+    std::string s;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+      if (uint32_t cnt = buckets[i]) {
+        s += (s.empty() ? "" : " ") + std::to_string(1 << i) + "us:" + std::to_string(cnt);
+      }
+    }
+    return s;
+  }
+};
 
+// records the time spent in a transfer, including the wait for the bus
+struct TransferTimer {
+  latency_histogram &latency;
+  const double start = nanos_since_boot();
+  ~TransferTimer() { latency.add((nanos_since_boot() - start) / 1e3); }
+};
 
 // comms base class
 class PandaCommsHandle {
@@ -27,6 +59,8 @@ public:
   std::string hw_serial;
   std::atomic<bool> connected = true;
   std::atomic<bool> comms_healthy = true;
+  latency_histogram control_latency;
+  latency_histogram bulk_latency;
   static std::vector<std::string> list();
 
   // HW communication
@@ -79,15 +113,51 @@ private:
   int spi_fd = -1;
   uint8_t tx_buf[SPI_BUF_SIZE];
   uint8_t rx_buf[SPI_BUF_SIZE];
+  uint8_t poll_buf[4];
   inline static std::recursive_mutex hw_lock;
 
-  int wait_for_ack(uint8_t ack, uint8_t tx, unsigned int timeout, unsigned int length);
+  int wait_for_ack(uint8_t ack, uint8_t tx, unsigned int timeout, unsigned int length, spi_ioc_transfer *prev = nullptr);
   int bulk_transfer(uint8_t endpoint, uint8_t *tx_data, uint16_t tx_len, uint8_t *rx_data, uint16_t rx_len, unsigned int timeout);
   int spi_transfer(uint8_t endpoint, uint8_t *tx_data, uint16_t tx_len, uint8_t *rx_data, uint16_t max_rx_len, unsigned int timeout);
   int spi_transfer_retry(uint8_t endpoint, uint8_t *tx_data, uint16_t tx_len, uint8_t *rx_data, uint16_t max_rx_len, unsigned int timeout);
-  int lltransfer(spi_ioc_transfer &t);
+  int lltransfer(spi_ioc_transfer *t, int n = 1);
 
   spi_header header;
   uint32_t xfer_count = 0;
 };
 #endif
+
+struct PandaSimConfig {
+  double frames_per_sec = 1000;  // summed over all buses
+  int bus_cnt = 3;
+  int data_len = 8;  // at least 8, the first 8 bytes carry the frame's nanos_since_boot() timestamp
+  double checksum_error_prob = 0;
+  uint8_t hw_type = 9;  // cereal::PandaState::PandaType::TRES
+};
+
+// emulates a panda's wire protocol in-process, for running pandad without hardware
+class PandaSimHandle : public PandaCommsHandle {
+public:
+  PandaSimHandle(std::string serial, const PandaSimConfig &config = {});
+  int control_write(uint8_t request, uint16_t param1, uint16_t param2, unsigned int timeout=TIMEOUT);
+  int control_read(uint8_t request, uint16_t param1, uint16_t param2, unsigned char *data, uint16_t length, unsigned int timeout=TIMEOUT);
+  int bulk_write(unsigned char endpoint, unsigned char* data, int length, unsigned int timeout=TIMEOUT);
+  int bulk_read(unsigned char endpoint, unsigned char* data, int length, unsigned int timeout=TIMEOUT);
+  void cleanup() {}
+
+  std::atomic<uint64_t> rx_frames = 0;    // frames sent to pandad
+  std::atomic<uint64_t> rx_dropped = 0;   // frames lost because pandad didn't read fast enough
+  std::atomic<uint64_t> tx_frames = 0;    // frames received from pandad
+  latency_histogram tx_latency;           // timestamp in the frame's payload to bulk write
+
+private:
+  void generate_frames(double now);
+
+  const PandaSimConfig config;
+  uint8_t data_len_code = 0;
+  std::mutex rx_lock;
+  std::vector<uint8_t> rx_stream;
+  size_t rx_pos = 0;
+  double next_frame_ns;
+  uint32_t frame_cnt = 0;
+};
@@ -0,0 +1,131 @@
+#include "selfdrive/pandad/panda.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+#include "common/timing.h"
+
+// the panda's CAN RX queue, frames arriving while it's full are lost
+#define SIM_RX_BUFFER_SIZE (4 * RECV_SIZE)
+
+PandaSimHandle::PandaSimHandle(std::string serial, const PandaSimConfig &config) : PandaCommsHandle(serial), config(config) {
+  assert(config.frames_per_sec > 0);
+  assert(config.bus_cnt > 0 && config.bus_cnt <= PANDA_BUS_OFFSET);
+  assert(config.data_len >= 8 && config.data_len <= 64);
+  while (dlc_to_len[data_len_code] != config.data_len) {
+    data_len_code++;
+    assert(data_len_code < std::size(dlc_to_len));
+  }
+
+  hw_serial = serial;
+  rx_stream.reserve(SIM_RX_BUFFER_SIZE);
+  next_frame_ns = nanos_since_boot();
+}
+
+int PandaSimHandle::control_write(uint8_t request, uint16_t param1, uint16_t param2, unsigned int timeout) {
+  TransferTimer timer{control_latency};
+  if (request == 0xc0) {
+    // reset communications, drop everything in flight
+    std::lock_guard lk(rx_lock);
+    rx_stream.clear();
+    rx_pos = 0;
+  }
+  return 0;
+}
+
+int PandaSimHandle::control_read(uint8_t request, uint16_t param1, uint16_t param2, unsigned char *data, uint16_t length, unsigned int timeout) {
+  TransferTimer timer{control_latency};
+  memset(data, 0, length);
+  if (request == 0xc1) {
+    data[0] = config.hw_type;
+  } else if (request == 0xd2) {
+    health_t health = {};
+    health.voltage_pkt = 12000;
+    memcpy(data, &health, std::min<size_t>(length, sizeof(health)));
+  }
+  return length;
+}
+
+int PandaSimHandle::bulk_write(unsigned char endpoint, unsigned char* data, int length, unsigned int timeout) {
+  TransferTimer timer{bulk_latency};
+  const double now = nanos_since_boot();
+  size_t pos = 0;
+  while (pos + sizeof(can_header) <= (size_t)length) {
+    const can_header *header = (const can_header *)&data[pos];
+    const uint8_t data_len = dlc_to_len[header->data_len_code];
+    if (data_len >= 8) {
+      uint64_t ts;
+      memcpy(&ts, &data[pos + sizeof(can_header)], sizeof(ts));
+      tx_latency.add((now - ts) / 1e3);
+    }
+    pos += sizeof(can_header) + data_len;
+    tx_frames++;
+  }
+  return length;
+}
+
+int PandaSimHandle::bulk_read(unsigned char endpoint, unsigned char* data, int length, unsigned int timeout) {
+  TransferTimer timer{bulk_latency};
+  if (endpoint != 0x81) {
+    return 0;
+  }
+
+  std::lock_guard lk(rx_lock);
+  generate_frames(nanos_since_boot());
+
+  // like USB, frames can be split across reads
+  const int len = std::min<size_t>(length, rx_stream.size() - rx_pos);
+  memcpy(data, &rx_stream[rx_pos], len);
+  rx_pos += len;
+  if (rx_pos == rx_stream.size()) {
+    rx_stream.clear();
+    rx_pos = 0;
+  }
+  return len;
+}
+
+void PandaSimHandle::generate_frames(double now) {
+  const double interval_ns = 1e9 / config.frames_per_sec;
+  const size_t frame_size = sizeof(can_header) + config.data_len;
+
+  if (rx_pos > 0) {
+    rx_stream.erase(rx_stream.begin(), rx_stream.begin() + rx_pos);
+    rx_pos = 0;
+  }
+
+  for (; next_frame_ns <= now; next_frame_ns += interval_ns) {
+    if (rx_stream.size() + frame_size > SIM_RX_BUFFER_SIZE) {
+      rx_dropped++;
+      continue;
+    }
+
+    const size_t pos = rx_stream.size();
+    rx_stream.resize(pos + frame_size);
+    uint8_t *frame = &rx_stream[pos];
+
+    can_header header = {};
+    header.bus = frame_cnt % config.bus_cnt;
+    header.addr = 0x100 + (frame_cnt / config.bus_cnt) % 0x600;
+    header.data_len_code = data_len_code;
+    memcpy(frame, &header, sizeof(header));
+
+    // stamp the frame with the time it was due on the bus
+    const uint64_t ts = next_frame_ns;
+    memcpy(frame + sizeof(can_header), &ts, sizeof(ts));
+    memset(frame + sizeof(can_header) + sizeof(ts), frame_cnt & 0xff, config.data_len - sizeof(ts));
+
+    uint8_t checksum = 0;
+    for (size_t i = 0; i < frame_size; i++) {
+      checksum ^= frame[i];
+    }
+    if (config.checksum_error_prob > 0 && (static_cast<double>(rand()) / RAND_MAX) < config.checksum_error_prob) {
+      checksum ^= 0xff;
+    }
+    ((can_header *)frame)->checksum = checksum;
+
+    frame_cnt++;
+    rx_frames++;
+  }
+}
@@ -6,6 +6,7 @@
 #include <cassert>
 #include <cerrno>
 #include <memory>
+#include <mutex>
 #include <thread>
 #include <utility>
 
@@ -15,6 +16,7 @@
 #include "common/swaglog.h"
 #include "common/timing.h"
 #include "common/util.h"
+#include "selfdrive/pandad/can_ring.h"
 #include "system/hardware/hw.h"
 
 // -- Multi-panda conventions --
@@ -78,9 +80,46 @@ Panda *connect(std::string serial="", uint32_t index=0) {
   return panda.release();
 }
 
-void can_send_thread(std::vector<Panda *> pandas, bool fake_send) {
+// CAN latency of one panda, aggregated until the next pandaState.
+// RX: frames sit on the panda until the next bulk read picks them up, so the oldest
+// frame in a can message was received on the bus right after the previous read started.
+// TX: sendcan publish (logMonoTime) to submitting the frames to the panda.
+struct CanLatency {
+  struct Stats {
+    double sum_ms = 0, max_ms = 0;
+    int cnt = 0;
+  };
+
+  std::mutex lock;
+  double last_read_ms = 0;
+  Stats rx, tx;
+
+  void update(Stats &s, double ms) {
+    std::lock_guard lk(lock);
+    s.sum_ms += ms;
+    s.max_ms = std::max(s.max_ms, ms);
+    ++s.cnt;
+  }
+
+  void fill(cereal::PandaState::Builder &ps) {
+    std::lock_guard lk(lock);
+    ps.setCanRxLatencyMeanMs(rx.cnt > 0 ? rx.sum_ms / rx.cnt : 0);
+    ps.setCanRxLatencyMaxMs(rx.max_ms);
+    ps.setCanTxLatencyMeanMs(tx.cnt > 0 ? tx.sum_ms / tx.cnt : 0);
+    ps.setCanTxLatencyMaxMs(tx.max_ms);
+    rx = tx = {};
+  }
+};
+
+void can_send_thread(std::vector<Panda *> pandas, bool fake_send, std::vector<CanLatency> *latency) {
   util::set_thread_name("pandad_can_send");
 
+  // sendcan is packed for all pandas in one pass, by bus number
+  for (int i = 0; i < pandas.size(); ++i) {
+    assert(pandas[i]->bus_offset == i * PANDA_BUS_OFFSET);
+  }
+  std::vector<can_send_buffer> send_buffers(pandas.size());
+
   AlignedBuffer aligned_buf;
   std::unique_ptr<Context> context(Context::create());
   std::unique_ptr<SubSocket> subscriber(SubSocket::create(context.get(), "sendcan"));
@@ -94,15 +133,26 @@ void can_send_thread(std::vector<Panda *> pandas, bool fake_send) {
       continue;
     }
 
-    capnp::FlatArrayMessageReader cmsg(aligned_buf.align(msg.get()));
+    // msgq messages are word aligned already, only copy the ones that aren't
+    kj::ArrayPtr<const capnp::word> words;
+    if ((uintptr_t)msg->getData() % alignof(capnp::word) == 0) {
+      words = kj::arrayPtr((const capnp::word *)msg->getData(), msg->getSize() / sizeof(capnp::word));
+    } else {
+      words = aligned_buf.align(msg.get());
+    }
+    capnp::FlatArrayMessageReader cmsg(words);
     cereal::Event::Reader event = cmsg.getRoot<cereal::Event>();
 
     // Don't send if older than 1 second
     if ((nanos_since_boot() - event.getLogMonoTime() < 1e9) && !fake_send) {
-      for (const auto& panda : pandas) {
-        LOGT("sending sendcan to panda: %s", (panda->hw_serial()).c_str());
-        panda->can_send(event.getSendcan());
-        LOGT("sendcan sent to panda: %s", (panda->hw_serial()).c_str());
+      Panda::pack_can_buffers(event.getSendcan(), send_buffers);
+      for (int i = 0; i < pandas.size(); ++i) {
+        if (send_buffers[i].data.empty()) continue;
+
+        LOGT("sending sendcan to panda: %s", (pandas[i]->hw_serial()).c_str());
+        pandas[i]->can_send(send_buffers[i]);
+        LOGT("sendcan sent to panda: %s", (pandas[i]->hw_serial()).c_str());
+        (*latency)[i].update((*latency)[i].tx, (nanos_since_boot() - event.getLogMonoTime()) / 1e6);
       }
     } else {
       LOGE("sendcan too old to send: %" PRIu64 ", %" PRIu64, nanos_since_boot(), event.getLogMonoTime());
@@ -110,25 +160,69 @@ void can_send_thread(std::vector<Panda *> pandas, bool fake_send) {
   }
 }
 
-void can_recv(std::vector<Panda *> &pandas, PubMaster *pm) {
-  static std::vector<can_frame> raw_can_data;
+// capnp words for the can message's first segment, enough for a busy 100Hz cycle on three buses
+#define CAN_MSG_FIRST_SEGMENT_WORDS (32 * 1024)
+
+void can_recv(std::vector<Panda *> &pandas, PubMaster *pm, CanRingWriter *can_ring, std::vector<CanLatency> &latency) {
+  // all the buffers are reused every cycle, so the steady state does no heap allocations
+  static std::vector<can_frame_desc> raw_can_data;
+  static capnp::word first_segment[CAN_MSG_FIRST_SEGMENT_WORDS];
+  static std::vector<capnp::byte> msg_buf;
+  static std::vector<double> prev_read_ms;
   {
     bool comms_healthy = true;
     raw_can_data.clear();
-    for (const auto& panda : pandas) {
-      comms_healthy &= panda->can_receive(raw_can_data);
+    raw_can_data.reserve(pandas.size() * MAX_RECV_FRAMES);
+    prev_read_ms.resize(pandas.size());
+    for (int i = 0; i < pandas.size(); ++i) {
+      prev_read_ms[i] = std::exchange(latency[i].last_read_ms, millis_since_boot());
+      comms_healthy &= pandas[i]->can_receive(raw_can_data);
     }
 
-    MessageBuilder msg;
+    MessageBuilder msg(kj::arrayPtr(first_segment, CAN_MSG_FIRST_SEGMENT_WORDS));
     auto evt = msg.initEvent();
     evt.setValid(comms_healthy);
     auto canData = evt.initCan(raw_can_data.size());
+    const uint64_t mono_time = evt.getLogMonoTime();
     for (size_t i = 0; i < raw_can_data.size(); ++i) {
-      canData[i].setAddress(raw_can_data[i].address);
-      canData[i].setDat(kj::arrayPtr((uint8_t*)raw_can_data[i].dat.data(), raw_can_data[i].dat.size()));
-      canData[i].setSrc(raw_can_data[i].src);
+      const can_frame_desc &f = raw_can_data[i];
+      canData[i].setAddress(f.address);
+      canData[i].setDat(kj::arrayPtr(f.dat, f.len));
+      canData[i].setSrc(f.src);
+      can_ring->push(mono_time, f.address, f.src, f.dat, f.len);
     }
-    pm->send("can", msg);
+
+    size_t msg_size = msg.getSerializedSize();
+    if (msg_buf.size() < msg_size) {
+      msg_buf.resize(msg_size);
+    }
+    msg.serializeToBuffer(msg_buf.data(), msg_size);
+    pm->send("can", msg_buf.data(), msg_size);
+    can_ring->publish();
+
+    const double publish_ms = millis_since_boot();
+    for (int i = 0; i < pandas.size(); ++i) {
+      if (prev_read_ms[i] > 0) latency[i].update(latency[i].rx, publish_ms - prev_read_ms[i]);
+    }
+  }
+}
+
+void can_recv_thread(std::vector<Panda *> pandas, std::vector<CanLatency> *latency) {
+  util::set_thread_name("pandad_can_recv");
+
+  // above the health/peripheral loop, which keeps its realtime priority so
+  // it can't cause a priority inversion while holding the comms lock
+  if (!Hardware::PC()) {
+    int ret = util::set_realtime_priority(55);
+    assert(ret == 0);
+  }
+
+  RateKeeper rk("pandad_can_recv", 100);
+  PubMaster pm({"can"});
+  CanRingWriter can_ring;
+  while (!do_exit && check_all_connected(pandas)) {
+    can_recv(pandas, &pm, &can_ring, *latency);
+    rk.keepTime();
   }
 }
 
@@ -188,7 +282,7 @@ void fill_panda_can_state(cereal::PandaState::PandaCanState::Builder &cs, const
   cs.setCanCoreResetCnt(can_health.can_core_reset_cnt);
 }
 
-std::optional<bool> send_panda_states(PubMaster *pm, const std::vector<Panda *> &pandas, bool spoofing_started) {
+std::optional<bool> send_panda_states(PubMaster *pm, const std::vector<Panda *> &pandas, std::vector<CanLatency> &latency, bool spoofing_started) {
   bool ignition_local = false;
   const uint32_t pandas_cnt = pandas.size();
 
@@ -208,20 +302,10 @@ std::optional<bool> send_panda_states(PubMaster *pm, const std::vector<Panda *>
                                      (pandas[1]->hw_type == cereal::PandaState::PandaType::RED_PANDA);
 
   for (const auto& panda : pandas){
-    auto health_opt = panda->get_state();
-    if (!health_opt) {
-      return std::nullopt;
-    }
-
-    health_t health = *health_opt;
-
+    health_t health {0};
     std::array<can_health_t, PANDA_CAN_CNT> can_health{};
-    for (uint32_t i = 0; i < PANDA_CAN_CNT; i++) {
-      auto can_health_opt = panda->get_can_state(i);
-      if (!can_health_opt) {
-        return std::nullopt;
-      }
-      can_health[i] = *can_health_opt;
+    if (!panda->get_states(health, can_health)) {
+      return std::nullopt;
     }
     pandaCanStates.push_back(can_health);
 
@@ -266,6 +350,7 @@ std::optional<bool> send_panda_states(PubMaster *pm, const std::vector<Panda *>
 
     auto ps = pss[i];
     fill_panda_state(ps, panda->hw_type, health);
+    latency[i].fill(ps);
 
     auto cs = std::array{ps.initCanState0(), ps.initCanState1(), ps.initCanState2()};
     for (uint32_t j = 0; j < PANDA_CAN_CNT; j++) {
@@ -323,14 +408,14 @@ void send_peripheral_state(Panda *panda, PubMaster *pm) {
   pm->send("peripheralState", msg);
 }
 
-void process_panda_state(std::vector<Panda *> &pandas, PubMaster *pm, bool engaged, bool spoofing_started) {
+void process_panda_state(std::vector<Panda *> &pandas, PubMaster *pm, std::vector<CanLatency> &latency, bool engaged, bool spoofing_started) {
   std::vector<std::string> connected_serials;
   for (Panda *p : pandas) {
     connected_serials.push_back(p->hw_serial());
   }
 
   {
-    auto ignition_opt = send_panda_states(pm, pandas, spoofing_started);
+    auto ignition_opt = send_panda_states(pm, pandas, latency, spoofing_started);
     if (!ignition_opt) {
       LOGE("Failed to get ignition_opt");
       return;
@@ -367,6 +452,8 @@ void process_panda_state(std::vector<Panda *> &pandas, PubMaster *pm, bool engag
 
 void process_peripheral_state(Panda *panda, PubMaster *pm, bool no_fan_control) {
   static SubMaster sm({"deviceState", "driverCameraState"});
+  static const int device_state = sm.index("deviceState");
+  static const int driver_camera_state = sm.index("driverCameraState");
 
   static uint64_t last_driver_camera_t = 0;
   static uint16_t prev_fan_speed = 999;
@@ -377,17 +464,17 @@ void process_peripheral_state(Panda *panda, PubMaster *pm, bool no_fan_control)
 
   {
     sm.update(0);
-    if (sm.updated("deviceState") && !no_fan_control) {
+    if (sm.updated(device_state) && !no_fan_control) {
       // Fan speed
-      uint16_t fan_speed = sm["deviceState"].getDeviceState().getFanSpeedPercentDesired();
+      uint16_t fan_speed = sm[device_state].getDeviceState().getFanSpeedPercentDesired();
       if (fan_speed != prev_fan_speed || sm.frame % 100 == 0) {
         panda->set_fan_speed(fan_speed);
         prev_fan_speed = fan_speed;
       }
     }
 
-    if (sm.updated("driverCameraState")) {
-      auto event = sm["driverCameraState"];
+    if (sm.updated(driver_camera_state)) {
+      auto event = sm[driver_camera_state];
       int cur_integ_lines = event.getDriverCameraState().getIntegLines();
 
       cur_integ_lines = integ_lines_filter.update(cur_integ_lines);
@@ -420,38 +507,45 @@ void pandad_run(std::vector<Panda *> &pandas) {
   const bool spoofing_started = getenv("STARTED") != nullptr;
   const bool fake_send = getenv("FAKESEND") != nullptr;
 
-  // Start the CAN send thread
-  std::thread send_thread(can_send_thread, pandas, fake_send);
+  // Start the CAN send and receive threads, a slow health or peripheral
+  // round trip in the main loop can't delay CAN publishing
+  std::vector<CanLatency> can_latency(pandas.size());
+  std::thread send_thread(can_send_thread, pandas, fake_send, &can_latency);
+  std::thread recv_thread(can_recv_thread, pandas, &can_latency);
 
-  RateKeeper rk("pandad", 100);
+  RateKeeper rk("pandad", 20);
   SubMaster sm({"selfdriveState"});
-  PubMaster pm({"can", "pandaStates", "peripheralState"});
+  const int selfdrive_state = sm.index("selfdriveState");
+  PubMaster pm({"pandaStates", "peripheralState"});
   PandaSafety panda_safety(pandas);
   Panda *peripheral_panda = pandas[0];
   bool engaged = false;
 
-  // Main loop: receive CAN data and process states
+  // Main loop: process states
   while (!do_exit && check_all_connected(pandas)) {
-    can_recv(pandas, &pm);
-
     // Process peripheral state at 20 Hz
-    if (rk.frame() % 5 == 0) {
-      process_peripheral_state(peripheral_panda, &pm, no_fan_control);
-    }
+    process_peripheral_state(peripheral_panda, &pm, no_fan_control);
 
     // Process panda state at 10 Hz
-    if (rk.frame() % 10 == 0) {
+    if (rk.frame() % 2 == 0) {
       sm.update(0);
-      engaged = sm.allAliveAndValid({"selfdriveState"}) && sm["selfdriveState"].getSelfdriveState().getEnabled();
-      process_panda_state(pandas, &pm, engaged, spoofing_started);
+      engaged = sm.alive(selfdrive_state) && sm.valid(selfdrive_state) && sm[selfdrive_state].getSelfdriveState().getEnabled();
+      process_panda_state(pandas, &pm, can_latency, engaged, spoofing_started);
       panda_safety.configureSafetyMode();
     }
 
     // Send out peripheralState at 2Hz
-    if (rk.frame() % 50 == 0) {
+    if (rk.frame() % 10 == 0) {
       send_peripheral_state(peripheral_panda, &pm);
     }
 
+    // Log the comms latency histograms once a minute
+    if (rk.frame() % (20 * 60) == 0) {
+      for (const auto &panda : pandas) {
+        LOGD("%s comms latency: %s", panda->hw_serial().c_str(), panda->comms_latency().c_str());
+      }
+    }
+
     rk.keepTime();
   }
 
@@ -466,6 +560,7 @@ void pandad_run(std::vector<Panda *> &pandas) {
   }
 
   send_thread.join();
+  recv_thread.join();
 }
 
 void pandad_main_thread(std::vector<std::string> serials) {
@@ -7,6 +7,7 @@
 #include "selfdrive/pandad/panda.h"
 
 void pandad_main_thread(std::vector<std::string> serials);
+void pandad_run(std::vector<Panda *> &pandas);
 
 class PandaSafety {
 public:
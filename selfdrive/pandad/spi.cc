@@ -246,14 +246,16 @@ int PandaSpiHandle::spi_transfer_retry(uint8_t endpoint, uint8_t *tx_data, uint1
     }
   } while (ret < 0 && connected && !timed_out);
 
+  double end_time = millis_since_boot();
+  (endpoint == 0 ? control_latency : bulk_latency).add((end_time - start_time) * 1000.0);
   if (ret < 0) {
-    SPILOG(LOGE, "transfer failed, after %d tries, %.2fms", timeout_count, millis_since_boot() - start_time);
+    SPILOG(LOGE, "transfer failed, after %d tries, %.2fms", timeout_count, end_time - start_time);
   }
 
   return ret;
 }
 
-int PandaSpiHandle::wait_for_ack(uint8_t ack, uint8_t tx, unsigned int timeout, unsigned int length) {
+int PandaSpiHandle::wait_for_ack(uint8_t ack, uint8_t tx, unsigned int timeout, unsigned int length, spi_ioc_transfer *prev) {
   double start_millis = millis_since_boot();
   if (timeout == 0) {
     timeout = SPI_ACK_TIMEOUT;
@@ -265,10 +267,27 @@ int PandaSpiHandle::wait_for_ack(uint8_t ack, uint8_t tx, unsigned int timeout,
     .rx_buf = (uint64_t)rx_buf,
     .len = length,
   };
-  memset(tx_buf, tx, length);
+
+  if (prev == NULL) {
+    memset(tx_buf, tx, length);
+  }
 
   while (true) {
-    int ret = lltransfer(transfer);
+    int ret;
+    if (prev != NULL) {
+      // chain the first poll onto the transfer it's waiting on, CS is still toggled
+      // in between, so on the wire this only removes the gap between the ioctls
+      assert(length <= sizeof(poll_buf));
+      memset(poll_buf, tx, length);
+      spi_ioc_transfer chained[2] = {*prev, transfer};
+      chained[0].cs_change = 1;
+      chained[1].tx_buf = (uint64_t)poll_buf;
+      ret = lltransfer(chained, 2);
+      prev = NULL;
+      memset(tx_buf, tx, length);
+    } else {
+      ret = lltransfer(&transfer);
+    }
     if (ret < 0) {
       SPILOG(LOGE, "SPI: failed to send ACK request");
       return ret;
@@ -291,32 +310,41 @@ int PandaSpiHandle::wait_for_ack(uint8_t ack, uint8_t tx, unsigned int timeout,
   return 0;
 }
 
-int PandaSpiHandle::lltransfer(spi_ioc_transfer &t) {
+int PandaSpiHandle::lltransfer(spi_ioc_transfer *transfers, int n) {
   static const double err_prob = std::stod(util::getenv("SPI_ERR_PROB", "-1"));
+  assert(n == 1 || n == 2);
 
   if (err_prob > 0) {
-    if ((static_cast<double>(rand()) / RAND_MAX) < err_prob) {
-      printf("transfer len error\n");
-      t.len = rand() % SPI_BUF_SIZE;
-    }
-    if ((static_cast<double>(rand()) / RAND_MAX) < err_prob && t.tx_buf != (uint64_t)NULL) {
-      printf("corrupting TX\n");
-      for (int i = 0; i < t.len; i++) {
-        if ((static_cast<double>(rand()) / RAND_MAX) > 0.9) {
-          ((uint8_t*)t.tx_buf)[i] = (uint8_t)(rand() % 256);
+    for (int j = 0; j < n; j++) {
+      spi_ioc_transfer &t = transfers[j];
+      // a chained poll sends from the small poll_buf
+      const int max_len = (t.tx_buf == (uint64_t)poll_buf) ? sizeof(poll_buf) : SPI_BUF_SIZE;
+      if ((static_cast<double>(rand()) / RAND_MAX) < err_prob) {
+        printf("transfer len error\n");
+        t.len = rand() % max_len;
+      }
+      if ((static_cast<double>(rand()) / RAND_MAX) < err_prob && t.tx_buf != (uint64_t)NULL) {
+        printf("corrupting TX\n");
+        for (int i = 0; i < t.len; i++) {
+          if ((static_cast<double>(rand()) / RAND_MAX) > 0.9) {
+            ((uint8_t*)t.tx_buf)[i] = (uint8_t)(rand() % 256);
+          }
         }
       }
     }
   }
 
-  int ret = util::safe_ioctl(spi_fd, SPI_IOC_MESSAGE(1), &t);
+  int ret = util::safe_ioctl(spi_fd, n == 1 ? SPI_IOC_MESSAGE(1) : SPI_IOC_MESSAGE(2), transfers);
 
   if (err_prob > 0) {
-    if ((static_cast<double>(rand()) / RAND_MAX) < err_prob && t.rx_buf != (uint64_t)NULL) {
-      printf("corrupting RX\n");
-      for (int i = 0; i < t.len; i++) {
-        if ((static_cast<double>(rand()) / RAND_MAX) > 0.9) {
-          ((uint8_t*)t.rx_buf)[i] = (uint8_t)(rand() % 256);
+    for (int j = 0; j < n; j++) {
+      spi_ioc_transfer &t = transfers[j];
+      if ((static_cast<double>(rand()) / RAND_MAX) < err_prob && t.rx_buf != (uint64_t)NULL) {
+        printf("corrupting RX\n");
+        for (int i = 0; i < t.len; i++) {
+          if ((static_cast<double>(rand()) / RAND_MAX) > 0.9) {
+            ((uint8_t*)t.rx_buf)[i] = (uint8_t)(rand() % 256);
+          }
         }
       }
     }
@@ -347,36 +375,22 @@ int PandaSpiHandle::spi_transfer(uint8_t endpoint, uint8_t *tx_data, uint16_t tx
     .rx_buf = (uint64_t)rx_buf
   };
 
-  // Send header
+  // Send header and wait for (N)ACK
   memcpy(tx_buf, &header, sizeof(header));
   add_checksum(tx_buf, sizeof(header));
   transfer.len = sizeof(header) + 1;
-  ret = lltransfer(transfer);
-  if (ret < 0) {
-    SPILOG(LOGE, "SPI: failed to send header");
-    goto fail;
-  }
-
-  // Wait for (N)ACK
-  ret = wait_for_ack(SPI_HACK, 0x11, timeout, 1);
+  ret = wait_for_ack(SPI_HACK, 0x11, timeout, 1, &transfer);
   if (ret < 0) {
     goto fail;
   }
 
-  // Send data
+  // Send data and wait for (N)ACK
   if (tx_data != NULL) {
     memcpy(tx_buf, tx_data, tx_len);
   }
   add_checksum(tx_buf, tx_len);
   transfer.len = tx_len + 1;
-  ret = lltransfer(transfer);
-  if (ret < 0) {
-    SPILOG(LOGE, "SPI: failed to send data");
-    goto fail;
-  }
-
-  // Wait for (N)ACK
-  ret = wait_for_ack(SPI_DACK, 0x13, timeout, 3);
+  ret = wait_for_ack(SPI_DACK, 0x13, timeout, 3, &transfer);
   if (ret < 0) {
     goto fail;
   }
@@ -390,7 +404,7 @@ int PandaSpiHandle::spi_transfer(uint8_t endpoint, uint8_t *tx_data, uint16_t tx
 
   transfer.len = rx_data_len + 1;
   transfer.rx_buf = (uint64_t)(rx_buf + 2 + 1);
-  ret = lltransfer(transfer);
+  ret = lltransfer(&transfer);
   if (ret < 0) {
     SPILOG(LOGE, "SPI: failed to read rx data");
     goto fail;
@@ -0,0 +1,115 @@
+// Runs pandad against a simulated panda at increasing CAN loads and reports
+// the throughput and latency seen by a "can" subscriber.
+//
+// usage: bench_pandad [seconds per rate] [checksum error probability]
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cereal/messaging/messaging.h"
+#include "common/timing.h"
+#include "common/util.h"
+#include "selfdrive/pandad/can_ring.h"
+#include "selfdrive/pandad/pandad.h"
+
+extern ExitHandler do_exit;
+
+const int SIM_BUS_CNT = 3;
+
+// sendcan at 100Hz, one frame per bus stamped with its publish time
+void publish_sendcan(PubMaster &pm) {
+  MessageBuilder msg;
+  auto evt = msg.initEvent();
+  auto can_data = evt.initSendcan(SIM_BUS_CNT);
+  const uint64_t ts = nanos_since_boot();
+  for (int i = 0; i < SIM_BUS_CNT; i++) {
+    can_data[i].setAddress(0x200 + i);
+    can_data[i].setSrc(i);
+    can_data[i].setDat(kj::arrayPtr((const capnp::byte *)&ts, sizeof(ts)));
+  }
+  pm.send("sendcan", msg);
+}
+
+void run(double frames_per_sec, double duration, double checksum_error_prob) {
+  PandaSimConfig config = {
+    .frames_per_sec = frames_per_sec,
+    .bus_cnt = SIM_BUS_CNT,
+    .checksum_error_prob = checksum_error_prob,
+  };
+  auto sim = new PandaSimHandle("sim0", config);
+  Panda panda(std::unique_ptr<PandaCommsHandle>(sim));
+  std::vector<Panda *> pandas = {&panda};
+
+  std::unique_ptr<Context> context(Context::create());
+  std::unique_ptr<SubSocket> can_sock(SubSocket::create(context.get(), "can"));
+  assert(can_sock != nullptr);
+  can_sock->setTimeout(5);
+  PubMaster pm({"sendcan"});
+  CanRingReader ring_reader;
+  std::vector<can_ring_frame> ring_frames(1024);
+  uint64_t ring_frame_cnt = 0;
+
+  do_exit = false;
+  std::thread pandad_thread(pandad_run, std::ref(pandas));
+
+  AlignedBuffer aligned_buf;
+  std::vector<double> latency_ms;
+  uint64_t rx_msgs = 0, rx_frames = 0;
+  const double start_ms = millis_since_boot();
+  double last_send_ms = 0;
+  while (millis_since_boot() - start_ms < duration * 1000) {
+    if (millis_since_boot() - last_send_ms >= 10) {
+      publish_sendcan(pm);
+      last_send_ms = millis_since_boot();
+    }
+
+    while (size_t cnt = ring_reader.read(ring_frames.data(), ring_frames.size())) {
+      ring_frame_cnt += cnt;
+    }
+
+    std::unique_ptr<Message> msg(can_sock->receive());
+    if (!msg) continue;
+
+    capnp::FlatArrayMessageReader cmsg(aligned_buf.align(msg.get()));
+    auto can = cmsg.getRoot<cereal::Event>().getCan();
+    const uint64_t now = nanos_since_boot();
+    for (const auto &c : can) {
+      auto dat = c.getDat();
+      if (dat.size() >= 8) {
+        uint64_t ts;
+        memcpy(&ts, dat.begin(), sizeof(ts));
+        latency_ms.push_back((now - ts) / 1e6);
+      }
+    }
+    rx_frames += can.size();
+    rx_msgs++;
+  }
+
+  do_exit = true;
+  pandad_thread.join();
+
+  std::sort(latency_ms.begin(), latency_ms.end());
+  auto percentile = [&](double p) { return latency_ms.empty() ? 0 : latency_ms[(latency_ms.size() - 1) * p]; };
+  printf("%8.0f %10.0f %8lu %8lu %8.2f %8.2f %8.2f %8lu\n", frames_per_sec, rx_frames / duration, rx_msgs,
+         (uint64_t)sim->rx_dropped, percentile(0.5), percentile(0.99), percentile(1.0), (uint64_t)sim->tx_frames);
+  printf("  can ring: %lu frames, %lu dropped\n", ring_frame_cnt, ring_reader.dropped);
+  printf("  tx latency: %s\n", sim->tx_latency.to_string().c_str());
+  printf("  comms latency: %s\n", panda.comms_latency().c_str());
+}
+
+int main(int argc, char *argv[]) {
+  const double duration = argc > 1 ? std::stod(argv[1]) : 5.0;
+  const double checksum_error_prob = argc > 2 ? std::stod(argv[2]) : 0;
+
+  printf("%8s %10s %8s %8s %8s %8s %8s %8s\n", "rate", "rx fps", "msgs", "dropped", "p50 ms", "p99 ms", "max ms", "tx");
+  for (double rate : {1000, 2000, 5000, 10000, 20000}) {
+    run(rate, duration, checksum_error_prob);
+  }
+  return 0;
+}
@@ -0,0 +1,94 @@
+#define CATCH_CONFIG_MAIN
+
+#include <thread>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "common/prefix.h"
+#include "selfdrive/pandad/can_ring.h"
+
+static void write_frames(CanRingWriter &writer, uint64_t start, uint64_t cnt) {
+  for (uint64_t i = start; i < start + cnt; ++i) {
+    uint8_t dat[64];
+    memset(dat, i & 0xff, sizeof(dat));
+    writer.push(i, 0x100 + (i % 0x700), i % 3, dat, 8 + (i % 57));
+  }
+  writer.publish();
+}
+
+static bool frame_ok(const can_ring_frame &f, uint64_t i) {
+  bool ok = f.mono_time == i && f.address == 0x100 + (i % 0x700) && f.src == i % 3 && f.len == 8 + (i % 57);
+  for (int j = 0; ok && j < f.len; ++j) {
+    ok = f.dat[j] == (i & 0xff);
+  }
+  return ok;
+}
+
+TEST_CASE("can_ring") {
+  OpenpilotPrefix prefix;
+  CanRingWriter writer;
+  CanRingReader reader;
+  std::vector<can_ring_frame> frames(CAN_RING_SIZE);
+
+  SECTION("reads frames in order") {
+    write_frames(writer, 0, 1000);
+    REQUIRE(reader.read(frames.data(), 600) == 600);
+    REQUIRE(reader.read(frames.data() + 600, frames.size()) == 400);
+    for (int i = 0; i < 1000; ++i) {
+      REQUIRE(frame_ok(frames[i], i));
+    }
+    REQUIRE(reader.read(frames.data(), frames.size()) == 0);
+    REQUIRE(reader.dropped == 0);
+  }
+
+  SECTION("frames are visible after publish") {
+    uint8_t dat[8] = {};
+    writer.push(0, 0x100, 0, dat, sizeof(dat));
+    REQUIRE(reader.read(frames.data(), frames.size()) == 0);
+    writer.publish();
+    REQUIRE(reader.read(frames.data(), frames.size()) == 1);
+  }
+
+  SECTION("new readers start at the newest frame") {
+    write_frames(writer, 0, 10);
+    CanRingReader late_reader;
+    write_frames(writer, 10, 5);
+    REQUIRE(late_reader.read(frames.data(), frames.size()) == 5);
+    REQUIRE(frame_ok(frames[0], 10));
+  }
+
+  SECTION("slow reader skips overwritten frames") {
+    write_frames(writer, 0, CAN_RING_SIZE + 100);
+    REQUIRE(reader.read(frames.data(), frames.size()) == CAN_RING_SIZE);
+    REQUIRE(reader.dropped == 100);
+    REQUIRE(frame_ok(frames[0], 100));
+  }
+
+  SECTION("restarted writer continues the sequence") {
+    write_frames(writer, 0, 10);
+    CanRingWriter writer2;
+    write_frames(writer2, 10, 10);
+    REQUIRE(reader.read(frames.data(), frames.size()) == 20);
+    REQUIRE(frame_ok(frames[19], 19));
+  }
+
+  SECTION("concurrent reader") {
+    const uint64_t total = 4 * CAN_RING_SIZE;
+    std::thread writer_thread([&]() {
+      for (uint64_t i = 0; i < total; i += 128) {
+        write_frames(writer, i, 128);
+      }
+    });
+
+    uint64_t received = 0;
+    while (received + reader.dropped < total) {
+      size_t cnt = reader.read(frames.data(), frames.size());
+      for (size_t i = 0; i < cnt; ++i) {
+        REQUIRE(frame_ok(frames[i], frames[i].mono_time));
+      }
+      received += cnt;
+    }
+    writer_thread.join();
+    REQUIRE(received + reader.dropped == total);
+  }
+}
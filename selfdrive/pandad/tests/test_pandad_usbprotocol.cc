@@ -9,6 +9,7 @@
 struct PandaTest : public Panda {
   PandaTest(uint32_t bus_offset, int can_list_size, cereal::PandaState::PandaType hw_type);
   void test_can_send();
+  void test_can_send_partitioned();
   void test_can_recv(uint32_t chunk_size = 0);
   void test_chunked_can_recv();
 
@@ -73,6 +74,23 @@ void PandaTest::test_can_send() {
   REQUIRE(cnt == can_list_size);
 }
 
+void PandaTest::test_can_send_partitioned() {
+  std::vector<uint8_t> packed_data;
+  std::vector<size_t> chunk_ends;
+  this->pack_can_buffer(can_data_list, [&](uint8_t *chunk, size_t size) {
+    packed_data.insert(packed_data.end(), chunk, &chunk[size]);
+    chunk_ends.push_back(packed_data.size());
+  });
+
+  // same wire data and chunks as packing for this panda alone, nothing for the other one
+  std::vector<can_send_buffer> buffers(2);
+  Panda::pack_can_buffers(can_data_list, buffers);
+  const can_send_buffer &buf = buffers[bus_offset / PANDA_BUS_OFFSET];
+  REQUIRE(buf.data == packed_data);
+  REQUIRE(std::equal(buf.chunk_ends.begin(), buf.chunk_ends.end(), chunk_ends.begin(), chunk_ends.end()));
+  REQUIRE(buffers[1 - bus_offset / PANDA_BUS_OFFSET].data.empty());
+}
+
 void PandaTest::test_can_recv(uint32_t rx_chunk_size) {
   std::vector<can_frame> frames;
   this->pack_can_buffer(can_data_list, [&](uint8_t *data, uint32_t size) {
@@ -110,6 +128,9 @@ TEST_CASE("send/recv CAN 2.0 packets") {
   SECTION("can_send") {
     test.test_can_send();
   }
+  SECTION("can_send_partitioned") {
+    test.test_can_send_partitioned();
+  }
   SECTION("can_receive") {
     test.test_can_recv();
   }
@@ -126,6 +147,9 @@ TEST_CASE("send/recv CAN FD packets") {
   SECTION("can_send") {
     test.test_can_send();
   }
+  SECTION("can_send_partitioned") {
+    test.test_can_send_partitioned();
+  }
   SECTION("can_receive") {
     test.test_can_recv();
   }
@@ -1,5 +1,6 @@
 #include "system/camerad/cameras/camera_common.h"
 
+#include <algorithm>
 #include <cassert>
 #include <string>
 
@@ -8,54 +9,72 @@
 #include "common/clutil.h"
 #include "common/swaglog.h"
 
+#include "system/camerad/cameras/process_raw_cpu.h"
 #include "system/camerad/cameras/spectra.h"
 
 
-class ImgProc {
-public:
-  ImgProc(cl_device_id device_id, cl_context context, const CameraBuf *b, const SensorInfo *sensor, int camera_num, int buf_width, int uv_offset) {
-    char args[4096];
-    snprintf(args, sizeof(args),
-             "-cl-fast-relaxed-math -cl-denorms-are-zero -Isensors "
-             "-DFRAME_WIDTH=%d -DFRAME_HEIGHT=%d -DFRAME_STRIDE=%d -DFRAME_OFFSET=%d "
-             "-DRGB_WIDTH=%d -DRGB_HEIGHT=%d -DYUV_STRIDE=%d -DUV_OFFSET=%d "
-             "-DSENSOR_ID=%hu -DHDR_OFFSET=%d -DVIGNETTING=%d ",
-             sensor->frame_width, sensor->frame_height, sensor->hdr_offset > 0 ? sensor->frame_stride * 2 : sensor->frame_stride, sensor->frame_offset,
-             b->out_img_width, b->out_img_height, buf_width, uv_offset,
-             static_cast<unsigned short>(sensor->image_sensor), sensor->hdr_offset, camera_num == 1);
-    const char *cl_file = "cameras/process_raw.cl";
-    cl_program prg_imgproc = cl_program_from_file(context, device_id, cl_file, args);
-    krnl_ = CL_CHECK_ERR(clCreateKernel(prg_imgproc, "process_raw", &err));
-    CL_CHECK(clReleaseProgram(prg_imgproc));
-
-    const cl_queue_properties props[] = {0};  //CL_QUEUE_PRIORITY_KHR, CL_QUEUE_PRIORITY_HIGH_KHR, 0};
-    queue = CL_CHECK_ERR(clCreateCommandQueueWithProperties(context, device_id, props, &err));
+// ISP_CPU_THREADS=<n> runs process_raw natively on n threads instead of with OpenCL
+const int env_isp_cpu_threads = util::getenv("ISP_CPU_THREADS", 0);
+
+ImgProc::ImgProc(cl_device_id device_id, cl_context context, const CameraBuf *b, const SensorInfo *sensor, int camera_num, int buf_width, int uv_offset, int threads)
+    : cpu_threads(threads) {
+  if (cpu_threads > 0) {
+    cpu = std::make_unique<ProcessRawCpu>(sensor, camera_num == 1, b->out_img_width, b->out_img_height, buf_width, uv_offset);
+    return;
   }
 
-  void runKernel(cl_mem cam_buf_cl, cl_mem buf_cl, int width, int height, int expo_time) {
-    CL_CHECK(clSetKernelArg(krnl_, 0, sizeof(cl_mem), &cam_buf_cl));
-    CL_CHECK(clSetKernelArg(krnl_, 1, sizeof(cl_mem), &buf_cl));
-    CL_CHECK(clSetKernelArg(krnl_, 2, sizeof(cl_int), &expo_time));
+  char args[4096];
+  snprintf(args, sizeof(args),
+           "-cl-fast-relaxed-math -cl-denorms-are-zero -Isensors "
+           "-DFRAME_WIDTH=%d -DFRAME_HEIGHT=%d -DFRAME_STRIDE=%d -DFRAME_OFFSET=%d "
+           "-DRGB_WIDTH=%d -DRGB_HEIGHT=%d -DYUV_STRIDE=%d -DUV_OFFSET=%d "
+           "-DSENSOR_ID=%hu -DHDR_OFFSET=%d -DVIGNETTING=%d ",
+           sensor->frame_width, sensor->frame_height, sensor->hdr_offset > 0 ? sensor->frame_stride * 2 : sensor->frame_stride, sensor->frame_offset,
+           b->out_img_width, b->out_img_height, buf_width, uv_offset,
+           static_cast<unsigned short>(sensor->image_sensor), sensor->hdr_offset, camera_num == 1);
+  const char *cl_file = "cameras/process_raw.cl";
+  cl_program prg_imgproc = cl_program_from_file(context, device_id, cl_file, args);
+  krnl_ = CL_CHECK_ERR(clCreateKernel(prg_imgproc, "process_raw", &err));
+  CL_CHECK(clReleaseProgram(prg_imgproc));
+
+  const cl_queue_properties props[] = {0};  //CL_QUEUE_PRIORITY_KHR, CL_QUEUE_PRIORITY_HIGH_KHR, 0};
+  queue = CL_CHECK_ERR(clCreateCommandQueueWithProperties(context, device_id, props, &err));
+}
+
+void ImgProc::queueKernel(VisionBuf *cam_buf, VisionBuf *yuv_buf, int width, int height, int expo_time, cl_event *event) {
+  if (cpu) {
+    cam_buf->sync(VISIONBUF_SYNC_FROM_DEVICE);
+    cpu->process((const uint8_t *)cam_buf->addr, (uint8_t *)yuv_buf->addr, expo_time, cpu_threads);
+    yuv_buf->sync(VISIONBUF_SYNC_TO_DEVICE);
+    *event = nullptr;
+    return;
+  }
 
-    const size_t globalWorkSize[] = {size_t(width / 2), size_t(height / 2)};
-    const int imgproc_local_worksize = 16;
-    const size_t localWorkSize[] = {imgproc_local_worksize, imgproc_local_worksize};
+  CL_CHECK(clSetKernelArg(krnl_, 0, sizeof(cl_mem), &cam_buf->buf_cl));
+  CL_CHECK(clSetKernelArg(krnl_, 1, sizeof(cl_mem), &yuv_buf->buf_cl));
+  CL_CHECK(clSetKernelArg(krnl_, 2, sizeof(cl_int), &expo_time));
+
+  const size_t globalWorkSize[] = {size_t(width / 2), size_t(height / 2)};
+  const int imgproc_local_worksize = 16;
+  const size_t localWorkSize[] = {imgproc_local_worksize, imgproc_local_worksize};
+
+  CL_CHECK(clEnqueueNDRangeKernel(queue, krnl_, 2, NULL, globalWorkSize, localWorkSize, 0, 0, event));
+  CL_CHECK(clFlush(queue));
+}
 
-    cl_event event;
-    CL_CHECK(clEnqueueNDRangeKernel(queue, krnl_, 2, NULL, globalWorkSize, localWorkSize, 0, 0, &event));
+void ImgProc::runKernel(VisionBuf *cam_buf, VisionBuf *yuv_buf, int width, int height, int expo_time) {
+  cl_event event;
+  queueKernel(cam_buf, yuv_buf, width, height, expo_time, &event);
+  if (event) {
     clWaitForEvents(1, &event);
     CL_CHECK(clReleaseEvent(event));
   }
+}
 
-  ~ImgProc() {
-    CL_CHECK(clReleaseKernel(krnl_));
-    CL_CHECK(clReleaseCommandQueue(queue));
-  }
-
-private:
-  cl_kernel krnl_;
-  cl_command_queue queue;
-};
+ImgProc::~ImgProc() {
+  if (krnl_) CL_CHECK(clReleaseKernel(krnl_));
+  if (queue) CL_CHECK(clReleaseCommandQueue(queue));
+}
 
 void CameraBuf::init(cl_device_id device_id, cl_context context, SpectraCamera *cam, VisionIpcServer * v, int frame_cnt, VisionStreamType type) {
   vipc_server = v;
@@ -89,10 +108,19 @@ void CameraBuf::init(cl_device_id device_id, cl_context context, SpectraCamera *
   vipc_server->create_buffers_with_sizes(stream_type, VIPC_BUFFER_COUNT, out_img_width, out_img_height, nv12_size, cam->stride, cam->uv_offset);
   LOGD("created %d YUV vipc buffers with size %dx%d", VIPC_BUFFER_COUNT, cam->stride, cam->y_height);
 
-  if (is_raw) imgproc = new ImgProc(device_id, context, this, sensor, cam->cc.camera_num, cam->stride, cam->uv_offset);
+  if (is_raw) {
+    imgproc = new ImgProc(device_id, context, this, sensor, cam->cc.camera_num, cam->stride, cam->uv_offset, env_isp_cpu_threads);
+    processing_frames = std::make_unique<ProcessingFrame[]>(frame_buf_count);
+  }
 }
 
 CameraBuf::~CameraBuf() {
+  if (processing_frames) {
+    std::unique_lock lk(processing_lock);
+    processing_cv.wait(lk, [this] {
+      return std::all_of(processing.begin(), processing.end(), [this](int i) { return processing_frames[i].done; });
+    });
+  }
   if (camera_bufs_raw != nullptr) {
     for (int i = 0; i < frame_buf_count; i++) {
       camera_bufs_raw[i].free();
@@ -101,35 +129,95 @@ CameraBuf::~CameraBuf() {
   if (imgproc) delete imgproc;
 }
 
-bool CameraBuf::acquire(int expo_time) {
-  if (!safe_queue.try_pop(cur_buf_idx, 50)) return false;
-
-  if (frame_metadata[cur_buf_idx].frame_id == -1) {
-    LOGE("no frame data? wtf");
-    return false;
+void CameraBuf::startProcessing(int buf_idx, int expo_time) {
+  ProcessingFrame &f = processing_frames[buf_idx];
+  f.buf = this;
+  f.yuv_buf = vipc_server->get_buffer(stream_type);
+  f.meta = frame_metadata[buf_idx];
+  f.start_time = millis_since_boot();
+  f.done = false;
+  processing.push_back(buf_idx);
+
+  cl_event event;
+  imgproc->queueKernel(&camera_bufs_raw[buf_idx], f.yuv_buf, out_img_width, out_img_height, expo_time, &event);
+  if (event) {
+    CL_CHECK(clSetEventCallback(event, CL_COMPLETE, processed, &f));
+    CL_CHECK(clReleaseEvent(event));
+  } else {
+    finishProcessing(&f, true);
   }
+}
 
-  cur_frame_data = frame_metadata[cur_buf_idx];
-  cur_camera_buf = &camera_bufs_raw[cur_buf_idx];
-  if (is_raw) {
-    cur_yuv_buf = vipc_server->get_buffer(stream_type);
+void CL_CALLBACK CameraBuf::processed(cl_event event, cl_int status, void *user_data) {
+  ProcessingFrame *f = (ProcessingFrame *)user_data;
+  f->buf->finishProcessing(f, status == CL_COMPLETE);
+}
 
-    double start_time = millis_since_boot();
-    imgproc->runKernel(camera_bufs_raw[cur_buf_idx].buf_cl, cur_yuv_buf->buf_cl, out_img_width, out_img_height, expo_time);
-    cur_frame_data.processing_time = (millis_since_boot() - start_time) / 1000.0;
+void CameraBuf::finishProcessing(ProcessingFrame *f, bool ok) {
+  f->meta.processing_time = (millis_since_boot() - f->start_time) / 1000.0;
+  if (ok) {
+    sendYuv(f->yuv_buf, f->meta);
   } else {
-    cur_yuv_buf = vipc_server->get_buffer(stream_type, cur_buf_idx);
-    cur_frame_data.processing_time = (double)(cur_frame_data.timestamp_end_of_isp - cur_frame_data.timestamp_eof)*1e-9;
+    LOGE("process_raw failed for frame %d", f->meta.frame_id);
+  }
+  {
+    std::scoped_lock lk(processing_lock);
+    f->done = true;
   }
+  processing_cv.notify_all();
+}
 
+void CameraBuf::sendYuv(VisionBuf *yuv_buf, const FrameMetadata &meta) {
   VisionIpcBufExtra extra = {
-    cur_frame_data.frame_id,
-    cur_frame_data.timestamp_sof,
-    cur_frame_data.timestamp_eof,
+    meta.frame_id,
+    meta.timestamp_sof,
+    meta.timestamp_eof,
   };
-  cur_yuv_buf->set_frame_id(cur_frame_data.frame_id);
-  vipc_server->send(cur_yuv_buf, &extra);
+  yuv_buf->set_frame_id(meta.frame_id);
+  vipc_server->send(yuv_buf, &extra);
+}
+
+bool CameraBuf::acquire(int expo_time) {
+  int buf_idx;
+  if (is_raw) {
+    // Queue every raw frame that came in, so a frame is processed and sent to vipc while the
+    // previous one is still being published. The raw buffers are refilled frame_buf_count
+    // frames after they're queued here, so keep a margin for the one being published.
+    while ((int)processing.size() < frame_buf_count - 2 && safe_queue.try_pop(buf_idx, processing.empty() ? 50 : 0)) {
+      if (frame_metadata[buf_idx].frame_id == -1) {
+        LOGE("no frame data? wtf");
+        continue;
+      }
+      startProcessing(buf_idx, expo_time);
+    }
+    if (processing.empty()) return false;
+
+    cur_buf_idx = processing.front();
+    processing.pop_front();
+    ProcessingFrame &f = processing_frames[cur_buf_idx];
+    {
+      std::unique_lock lk(processing_lock);
+      processing_cv.wait(lk, [&f] { return f.done; });
+    }
+    cur_frame_data = f.meta;
+    cur_camera_buf = &camera_bufs_raw[cur_buf_idx];
+    cur_yuv_buf = f.yuv_buf;
+    return true;
+  }
+
+  if (!safe_queue.try_pop(buf_idx, 50)) return false;
+
+  if (frame_metadata[buf_idx].frame_id == -1) {
+    LOGE("no frame data? wtf");
+    return false;
+  }
 
+  cur_buf_idx = buf_idx;
+  cur_frame_data = frame_metadata[cur_buf_idx];
+  cur_camera_buf = &camera_bufs_raw[cur_buf_idx];
+  cur_yuv_buf = vipc_server->get_buffer(stream_type, cur_buf_idx);
+  cur_frame_data.processing_time = (double)(cur_frame_data.timestamp_end_of_isp - cur_frame_data.timestamp_eof)*1e-9;
+  sendYuv(cur_yuv_buf, cur_frame_data);
   return true;
 }
 
@@ -150,6 +238,23 @@ kj::Array<uint8_t> get_raw_frame_image(const CameraBuf *b) {
   return kj::mv(frame_image);
 }
 
+// Subsamples a row of 2x2 pixel blocks, taking the center block of every downscale x downscale area.
+// The pixel pairs are copied with 2 byte memcpys, which compile to 16 bit loads and stores.
+static void subsample_row(const uint8_t *src, uint8_t *dst, int dst_pairs, int downscale) {
+  src += ((downscale - 1) / 2) * 2;
+  for (int i = 0; i < dst_pairs; i++) {
+    memcpy(&dst[i * 2], &src[i * downscale * 2], 2);
+  }
+}
+
+static void deinterleave_uv_row(const uint8_t *src, uint8_t *u, uint8_t *v, int width, int downscale) {
+  src += ((downscale - 1) / 2) * 2;
+  for (int i = 0; i < width; i++) {
+    u[i] = src[i * downscale * 2];
+    v[i] = src[i * downscale * 2 + 1];
+  }
+}
+
 static kj::Array<capnp::byte> yuv420_to_jpeg(const CameraBuf *b, int thumbnail_width, int thumbnail_height) {
   int downscale = b->cur_yuv_buf->width / thumbnail_width;
   assert(downscale * thumbnail_height == b->cur_yuv_buf->height);
@@ -161,18 +266,14 @@ static kj::Array<capnp::byte> yuv420_to_jpeg(const CameraBuf *b, int thumbnail_w
   uint8_t *u_plane = y_plane + thumbnail_width * thumbnail_height;
   uint8_t *v_plane = u_plane + (thumbnail_width * thumbnail_height) / 4;
   {
-    // subsampled conversion from nv12 to yuv
+    // subsampled conversion from nv12 to yuv, row by row so the pointers aren't reloaded per pixel
+    const uint8_t *in_y = b->cur_yuv_buf->y;
+    const uint8_t *in_uv = b->cur_yuv_buf->uv;
     for (int hy = 0; hy < thumbnail_height/2; hy++) {
-      for (int hx = 0; hx < thumbnail_width/2; hx++) {
-        int ix = hx * downscale + (downscale-1)/2;
-        int iy = hy * downscale + (downscale-1)/2;
-        y_plane[(hy*2 + 0)*thumbnail_width + (hx*2 + 0)] = b->cur_yuv_buf->y[(iy*2 + 0) * in_stride + ix*2 + 0];
-        y_plane[(hy*2 + 0)*thumbnail_width + (hx*2 + 1)] = b->cur_yuv_buf->y[(iy*2 + 0) * in_stride + ix*2 + 1];
-        y_plane[(hy*2 + 1)*thumbnail_width + (hx*2 + 0)] = b->cur_yuv_buf->y[(iy*2 + 1) * in_stride + ix*2 + 0];
-        y_plane[(hy*2 + 1)*thumbnail_width + (hx*2 + 1)] = b->cur_yuv_buf->y[(iy*2 + 1) * in_stride + ix*2 + 1];
-        u_plane[hy*thumbnail_width/2 + hx] = b->cur_yuv_buf->uv[iy*in_stride + ix*2 + 0];
-        v_plane[hy*thumbnail_width/2 + hx] = b->cur_yuv_buf->uv[iy*in_stride + ix*2 + 1];
-      }
+      int iy = hy * downscale + (downscale-1)/2;
+      subsample_row(&in_y[(iy*2 + 0) * in_stride], &y_plane[(hy*2 + 0) * thumbnail_width], thumbnail_width/2, downscale);
+      subsample_row(&in_y[(iy*2 + 1) * in_stride], &y_plane[(hy*2 + 1) * thumbnail_width], thumbnail_width/2, downscale);
+      deinterleave_uv_row(&in_uv[iy * in_stride], &u_plane[hy * thumbnail_width/2], &v_plane[hy * thumbnail_width/2], thumbnail_width/2, downscale);
     }
   }
 
@@ -240,23 +341,32 @@ void publish_thumbnail(PubMaster *pm, const CameraBuf *b) {
 }
 
 float set_exposure_target(const CameraBuf *b, Rect ae_xywh, int x_skip, int y_skip) {
-  int lum_med;
-  uint32_t lum_binning[256] = {0};
+  // Four interleaved histograms, so consecutive samples of the same value don't wait on each other's increment
+  uint32_t lum_binning[4][256] = {};
   const uint8_t *pix_ptr = b->cur_yuv_buf->y;
 
+  const int samples_per_row = std::max(0, (ae_xywh.w + x_skip - 1) / x_skip);
   unsigned int lum_total = 0;
   for (int y = ae_xywh.y; y < ae_xywh.y + ae_xywh.h; y += y_skip) {
-    for (int x = ae_xywh.x; x < ae_xywh.x + ae_xywh.w; x += x_skip) {
-      uint8_t lum = pix_ptr[(y * b->out_img_width) + x];
-      lum_binning[lum]++;
-      lum_total += 1;
+    const uint8_t *row = &pix_ptr[(y * b->out_img_width) + ae_xywh.x];
+    int i = 0;
+    for (; i + 4 <= samples_per_row; i += 4) {
+      lum_binning[0][row[(i + 0) * x_skip]]++;
+      lum_binning[1][row[(i + 1) * x_skip]]++;
+      lum_binning[2][row[(i + 2) * x_skip]]++;
+      lum_binning[3][row[(i + 3) * x_skip]]++;
+    }
+    for (; i < samples_per_row; i++) {
+      lum_binning[0][row[i * x_skip]]++;
     }
+    lum_total += samples_per_row;
   }
 
   // Find mean lumimance value
+  int lum_med;
   unsigned int lum_cur = 0;
   for (lum_med = 255; lum_med >= 0; lum_med--) {
-    lum_cur += lum_binning[lum_med];
+    lum_cur += lum_binning[0][lum_med] + lum_binning[1][lum_med] + lum_binning[2][lum_med] + lum_binning[3][lum_med];
 
     if (lum_cur >= lum_total / 2) {
       break;
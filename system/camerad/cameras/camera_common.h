@@ -1,6 +1,9 @@
 #pragma once
 
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
 
 #include "cereal/messaging/messaging.h"
 #include "msgq/visionipc/visionipc_server.h"
@@ -21,7 +24,34 @@ typedef struct FrameMetadata {
 
 class SpectraCamera;
 class CameraState;
-class ImgProc;
+class CameraBuf;
+class SensorInfo;
+class ProcessRawCpu;
+
+// Runs process_raw on the raw frames, with OpenCL or natively with cpu_threads > 0
+class ImgProc {
+public:
+  ImgProc(cl_device_id device_id, cl_context context, const CameraBuf *b, const SensorInfo *sensor, int camera_num, int buf_width, int uv_offset, int cpu_threads = 0);
+  ~ImgProc();
+  // queues the kernel and returns its event, or runs natively and returns no event
+  void queueKernel(VisionBuf *cam_buf, VisionBuf *yuv_buf, int width, int height, int expo_time, cl_event *event);
+  void runKernel(VisionBuf *cam_buf, VisionBuf *yuv_buf, int width, int height, int expo_time);
+
+private:
+  cl_kernel krnl_ = nullptr;
+  cl_command_queue queue = nullptr;
+  std::unique_ptr<ProcessRawCpu> cpu;
+  int cpu_threads;
+};
+
+// a raw frame being processed by the ISP, sent to vipc as soon as it's done
+struct ProcessingFrame {
+  CameraBuf *buf;
+  VisionBuf *yuv_buf;
+  FrameMetadata meta;
+  double start_time;
+  bool done = true;
+};
 
 class CameraBuf {
 private:
@@ -31,6 +61,17 @@ private:
   int frame_buf_count;
   bool is_raw;
 
+  // raw frames queued to the ISP in order, processing_frames is indexed by raw buffer
+  std::deque<int> processing;
+  std::unique_ptr<ProcessingFrame[]> processing_frames;
+  std::mutex processing_lock;
+  std::condition_variable processing_cv;
+
+  void startProcessing(int buf_idx, int expo_time);
+  void finishProcessing(ProcessingFrame *f, bool ok);
+  static void CL_CALLBACK processed(cl_event event, cl_int status, void *user_data);
+  void sendYuv(VisionBuf *yuv_buf, const FrameMetadata &meta);
+
 public:
   VisionIpcServer *vipc_server;
   VisionStreamType stream_type;
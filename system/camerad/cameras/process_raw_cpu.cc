@@ -0,0 +1,325 @@
+#include "system/camerad/cameras/process_raw_cpu.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <thread>
+
+#define RGB_TO_Y(r, g, b) ((((b * 13 + g * 65 + r * 33) + 64) >> 7) + 16)
+#define RGB_TO_U(r, g, b) ((b * 56 - g * 37 - r * 19 + 0x8080) >> 8)
+#define RGB_TO_V(r, g, b) ((r * 56 - g * 47 - b * 9 + 0x8080) >> 8)
+
+// the planes never overlap, but there are too many of them for the vectorizer to check at runtime
+#if defined(__clang__)
+#define VECTORIZE _Pragma("clang loop vectorize(assume_safety)")
+#else
+#define VECTORIZE _Pragma("GCC ivdep")
+#endif
+
+namespace {
+
+float vignetting_4dt6mm(float r) {
+  if (r < 100000) {
+    return 1.0f + 0.0000013f*r;
+  } else if (r < 250000) {
+    return 1.02f + 0.0000011f*r;
+  } else if (r < 400000) {
+    return 0.92f + 0.0000015f*r;
+  } else {
+    return 0.44f + 0.0000027f*r;
+  }
+}
+
+float vignetting_8dt0mm(float r) {
+  if (r < 62500) {
+    return (1.0f + 0.0000008f*r);
+  } else if (r < 490000) {
+    return (0.9625f + 0.0000014f*r);
+  } else if (r < 1102500) {
+    return (1.26434f + 0.0000000000016f*r*r);
+  } else {
+    return (0.53503625f + 0.0000000000022f*r*r);
+  }
+}
+
+// sensors/ar0231_cl.h
+struct AR0231Isp {
+  static constexpr int read_order[4] = {0, 1, 2, 3};
+  static constexpr int write_order[4] = {0, 1, 2, 3};
+  static constexpr float normalize_scale = 1.0f;
+  // one row per input channel
+  static constexpr float ccm[3][3] = {
+    {1.82717181f, -0.31231438f, 0.07307673f},
+    {-0.5743977f, 1.36858544f, -0.53183455f},
+    {-0.25277411f, -0.05627105f, 1.45875782f},
+  };
+
+  static float vignetting(float r) { return vignetting_8dt0mm(r); }
+
+  static float normalize(int pv) {
+    const int BLACK_LVL = 168, PV_MAX = 4096;
+    return ((float)pv - BLACK_LVL) / (PV_MAX - BLACK_LVL);
+  }
+
+  static float gamma(float v) {
+    // tone mapping params
+    const float gamma_k = 0.75f;
+    const float gamma_b = 0.125f;
+    const float mp = 0.01f; // ideally midpoint should be adaptive
+    const float rk = 9 - 100*mp;
+
+    // poly approximation for s curve
+    return (v > mp) ?
+      ((rk * (v-mp) * (1-(gamma_k*mp+gamma_b)) * (1+1/(rk*(1-mp))) / (1+rk*(v-mp))) + gamma_k*mp + gamma_b) :
+      ((rk * (v-mp) * (gamma_k*mp+gamma_b) * (1+1/(rk*mp)) / (1-rk*(v-mp))) + gamma_k*mp + gamma_b);
+  }
+};
+
+// sensors/ox03c10_cl.h
+struct OX03C10Isp {
+  static constexpr int read_order[4] = {0, 1, 2, 3};
+  static constexpr int write_order[4] = {0, 1, 2, 3};
+  static constexpr float normalize_scale = 256.0f;
+  static constexpr float ccm[3][3] = {
+    {1.5664815f, -0.29808738f, -0.03973474f},
+    {-0.48672447f, 1.41914433f, -0.40295248f},
+    {-0.07975703f, -0.12105695f, 1.44268722f},
+  };
+
+  static float vignetting(float r) { return vignetting_8dt0mm(r); }
+
+  // PWL
+  static float normalize(int x) {
+    if (x < 512) {
+      return x * 5.94873e-8f;
+    } else if (x < 768) {
+      return 3.0458e-05f + (x-512) * 1.19913e-7f;
+    } else if (x < 1536) {
+      return 6.1154e-05f + (x-768) * 2.38493e-7f;
+    } else if (x < 1792) {
+      return 0.0002448f + (x-1536) * 9.56930e-7f;
+    } else if (x < 2048) {
+      return 0.00048977f + (x-1792) * 1.91441e-6f;
+    } else if (x < 2304) {
+      return 0.00097984f + (x-2048) * 3.82937e-6f;
+    } else if (x < 2560) {
+      return 0.0019601f + (x-2304) * 7.659055e-6f;
+    } else if (x < 2816) {
+      return 0.0039207f + (x-2560) * 1.525e-5f;
+    } else {
+      return 0.0078421f + (expf((x-2816)/273.0f) - 1) * 0.0092421f;
+    }
+  }
+
+  static float gamma(float v) {
+    return -0.507089f*expf(-12.54124638f*v) + 0.9655f*sqrtf(v) - 0.472597f*v + 0.507089f;
+  }
+};
+
+// sensors/os04c10_cl.h
+struct OS04C10Isp {
+  // BGGR
+  static constexpr int read_order[4] = {3, 2, 1, 0};
+  static constexpr int write_order[4] = {2, 3, 0, 1};
+  static constexpr float normalize_scale = 1.0f;
+  static constexpr float ccm[3][3] = {
+    {1.55361989f, -0.268894615f, -0.000593219f},
+    {-0.421217301f, 1.51883144f, -0.69760146f},
+    {-0.132402589f, -0.249936825f, 1.69819468f},
+  };
+
+  static float vignetting(float r) { return vignetting_4dt6mm(r); }
+
+  static float normalize(int pv) {
+    const int BLACK_LVL = 48, PV_MAX12 = 4095;
+    return ((float)pv - BLACK_LVL) / (PV_MAX12 - BLACK_LVL);
+  }
+
+  static float gamma(float v) {
+    return (10 * v) / (1 + 9 * v);
+  }
+};
+
+inline float get_k(float a, float b, float c, float d) {
+  return 2.0f - (fabsf(a - b) + fabsf(c - d));
+}
+
+// clamp(v, 0.0, 1.0), which is fmin(fmax(v, 0.0), 1.0) and turns NaN into 0
+inline float clamp01(float v) {
+  v = v > 0.0f ? v : 0.0f;
+  return v < 1.0f ? v : 1.0f;
+}
+
+// convert_uchar_sat rounds toward zero, NaN becomes 0
+inline uint8_t convert_uchar_sat(float v) {
+  v = v > 0.0f ? v : 0.0f;
+  return (int)(v < 255.0f ? v : 255.0f);
+}
+
+}  // namespace
+
+ProcessRawCpu::ProcessRawCpu(const SensorInfo *sensor, bool vignette, int out_width, int out_height, int out_stride, int out_uv_offset)
+    : frame_stride(sensor->frame_stride), frame_offset(sensor->frame_offset), width(out_width), height(out_height),
+      yuv_stride(out_stride), uv_offset(out_uv_offset), vignetting(vignette), normalize_lut(1 << 12) {
+  // every sensor runs process_raw.cl with BIT_DEPTH 12, the 10 bit HDR path isn't built
+  assert(sensor->bits_per_pixel == 12 && sensor->hdr_offset <= 0);
+
+  auto init = [&](auto isp) {
+    for (int i = 0; i < (int)normalize_lut.size(); ++i) {
+      normalize_lut[i] = decltype(isp)::normalize(i);
+    }
+    process_rows_func = &ProcessRawCpu::process_rows<decltype(isp)>;
+  };
+  switch (sensor->image_sensor) {
+    case cereal::FrameData::ImageSensor::AR0231: init(AR0231Isp()); break;
+    case cereal::FrameData::ImageSensor::OX03C10: init(OX03C10Isp()); break;
+    case cereal::FrameData::ImageSensor::OS04C10: init(OS04C10Isp()); break;
+    default: assert(false);
+  }
+}
+
+void ProcessRawCpu::process(const uint8_t *raw, uint8_t *yuv, int expo_time, int threads) const {
+  const int rows = height / 2;
+  if (threads <= 1) {
+    (this->*process_rows_func)(raw, yuv, expo_time, 0, rows);
+    return;
+  }
+
+  std::vector<std::thread> workers;
+  for (int i = 0; i < threads; ++i) {
+    workers.emplace_back(process_rows_func, this, raw, yuv, expo_time, rows * i / threads, rows * (i + 1) / threads);
+  }
+  for (auto &t : workers) {
+    t.join();
+  }
+}
+
+// Same as the kernel, with gy the row of 2x2 output blocks. The kernel reads a 4x4 window
+// (the block and its neighbors) per block, here the window's rows are unpacked for the whole
+// row of blocks first, split into odd and even columns so block gx reads them at gx and gx + 1.
+template <class Sensor>
+void ProcessRawCpu::process_rows(const uint8_t *raw, uint8_t *yuv, int expo_time, int gy_begin, int gy_end) const {
+  const int n = width / 2;
+  // pixel 2*i - 1 and 2*i of each row of the window, mirrored at both ends
+  std::vector<float> odd(4 * (n + 1)), even(4 * (n + 1));
+  std::vector<float> vignette(n, 1.0f);
+  // the four debayered pixels of each block, one plane per pixel and channel
+  std::vector<float> rgb(4 * 3 * n);
+  std::vector<uint8_t> rgb_out(4 * 3 * n);
+
+  for (int gy = gy_begin; gy < gy_end; ++gy) {
+    // unpack 12 bit pixels
+    const int rows[4] = {2*gy - 1 + (gy == 0 ? 2 : 0), 2*gy, 2*gy + 1, 2*gy - 1 + (gy == height/2 - 1 ? 1 : 3)};
+    for (int i = 0; i < 4; ++i) {
+      const uint8_t *src = raw + (size_t)(frame_offset + rows[i]) * frame_stride;
+      float *o = &odd[Sensor::read_order[i] * (n + 1)];
+      float *e = &even[Sensor::read_order[i] * (n + 1)];
+      for (int x = 0; x < n; ++x) {
+        const uint8_t *p = &src[x * 3];
+        e[x] = normalize_lut[(p[0] << 4) | (p[2] & 0xF)];
+        o[x + 1] = normalize_lut[(p[1] << 4) | (p[2] >> 4)];
+      }
+      // mirror padding
+      o[0] = o[1];
+      e[n] = e[n - 1];
+    }
+
+    if (vignetting) {
+      const int vy = gy*2 - height/2;
+      for (int gx = 0; gx < n; ++gx) {
+        const int vx = gx*2 - width/2;
+        vignette[gx] = Sensor::vignetting(vx*vx + vy*vy);
+      }
+    }
+
+    // debayering
+    // a simplified version of https://opensignalprocessingjournal.com/contents/volumes/V6/TOSIGPJ-6-1/TOSIGPJ-6-1.pdf
+    float *out[4][3];
+    for (int i = 0; i < 4; ++i) {
+      for (int c = 0; c < 3; ++c) {
+        out[i][c] = &rgb[(i*3 + c) * n];
+      }
+    }
+    const float *o0 = &odd[0], *o1 = o0 + n + 1, *o2 = o1 + n + 1, *o3 = o2 + n + 1;
+    const float *e0 = &even[0], *e1 = e0 + n + 1, *e2 = e1 + n + 1, *e3 = e2 + n + 1;
+    VECTORIZE
+    for (int gx = 0; gx < n; ++gx) {
+      const float s = vignette[gx] * Sensor::normalize_scale;
+      const float v[4][4] = {
+        {clamp01(o0[gx] * s), clamp01(e0[gx] * s), clamp01(o0[gx + 1] * s), clamp01(e0[gx + 1] * s)},
+        {clamp01(o1[gx] * s), clamp01(e1[gx] * s), clamp01(o1[gx + 1] * s), clamp01(e1[gx + 1] * s)},
+        {clamp01(o2[gx] * s), clamp01(e2[gx] * s), clamp01(o2[gx + 1] * s), clamp01(e2[gx + 1] * s)},
+        {clamp01(o3[gx] * s), clamp01(e3[gx] * s), clamp01(o3[gx + 1] * s), clamp01(e3[gx + 1] * s)},
+      };
+
+      const float k01 = get_k(v[0][0], v[1][1], v[0][2], v[1][1]);
+      const float k02 = get_k(v[0][2], v[1][1], v[2][2], v[1][1]);
+      const float k03 = get_k(v[2][0], v[1][1], v[2][2], v[1][1]);
+      const float k04 = get_k(v[0][0], v[1][1], v[2][0], v[1][1]);
+      out[0][0][gx] = clamp01((k02*v[1][2]+k04*v[1][0])/(k02+k04)); // R_G1
+      out[0][1][gx] = v[1][1]; // G1(R)
+      out[0][2][gx] = clamp01((k01*v[0][1]+k03*v[2][1])/(k01+k03)); // B_G1
+
+      const float k11 = get_k(v[0][1], v[2][1], v[0][3], v[2][3]);
+      const float k12 = get_k(v[0][2], v[1][1], v[1][3], v[2][2]);
+      const float k13 = get_k(v[0][1], v[0][3], v[2][1], v[2][3]);
+      const float k14 = get_k(v[0][2], v[1][3], v[2][2], v[1][1]);
+      out[1][0][gx] = v[1][2]; // R
+      out[1][1][gx] = clamp01((k11*(v[0][2]+v[2][2])*0.5f+k13*(v[1][3]+v[1][1])*0.5f)/(k11+k13)); // G_R
+      out[1][2][gx] = clamp01((k12*(v[0][3]+v[2][1])*0.5f+k14*(v[0][1]+v[2][3])*0.5f)/(k12+k14)); // B_R
+
+      const float k21 = get_k(v[1][0], v[3][0], v[1][2], v[3][2]);
+      const float k22 = get_k(v[1][1], v[2][0], v[2][2], v[3][1]);
+      const float k23 = get_k(v[1][0], v[1][2], v[3][0], v[3][2]);
+      const float k24 = get_k(v[1][1], v[2][2], v[3][1], v[2][0]);
+      out[2][0][gx] = clamp01((k22*(v[1][2]+v[3][0])*0.5f+k24*(v[1][0]+v[3][2])*0.5f)/(k22+k24)); // R_B
+      out[2][1][gx] = clamp01((k21*(v[1][1]+v[3][1])*0.5f+k23*(v[2][2]+v[2][0])*0.5f)/(k21+k23)); // G_B
+      out[2][2][gx] = v[2][1]; // B
+
+      const float k31 = get_k(v[1][1], v[2][2], v[1][3], v[2][2]);
+      const float k32 = get_k(v[1][3], v[2][2], v[3][3], v[2][2]);
+      const float k33 = get_k(v[3][1], v[2][2], v[3][3], v[2][2]);
+      const float k34 = get_k(v[1][1], v[2][2], v[3][1], v[2][2]);
+      out[3][0][gx] = clamp01((k31*v[1][2]+k33*v[3][2])/(k31+k33)); // R_G2
+      out[3][1][gx] = v[2][2]; // G2(B)
+      out[3][2][gx] = clamp01((k32*v[2][3]+k34*v[2][1])/(k32+k34)); // B_G2
+    }
+
+    // color correction and gamma
+    for (int i = 0; i < 4; ++i) {
+      const float *r = out[i][0], *g = out[i][1], *b = out[i][2];
+      for (int c = 0; c < 3; ++c) {
+        uint8_t *dst = &rgb_out[(Sensor::write_order[i]*3 + c) * n];
+        VECTORIZE
+        for (int gx = 0; gx < n; ++gx) {
+          const float corrected = r[gx] * Sensor::ccm[0][c] + g[gx] * Sensor::ccm[1][c] + b[gx] * Sensor::ccm[2][c];
+          dst[gx] = convert_uchar_sat(Sensor::gamma(corrected) * 255.0f);
+        }
+      }
+    }
+
+    // rgb2yuv(nv12)
+    uint8_t *y0 = &yuv[(size_t)(gy*2) * yuv_stride];
+    uint8_t *y1 = y0 + yuv_stride;
+    uint8_t *uv = &yuv[uv_offset + (size_t)gy * yuv_stride];
+    const uint8_t *p[4][3];
+    for (int i = 0; i < 4; ++i) {
+      for (int c = 0; c < 3; ++c) {
+        p[i][c] = &rgb_out[(i*3 + c) * n];
+      }
+    }
+    VECTORIZE
+    for (int gx = 0; gx < n; ++gx) {
+      y0[gx*2 + 0] = RGB_TO_Y(p[0][0][gx], p[0][1][gx], p[0][2][gx]);
+      y0[gx*2 + 1] = RGB_TO_Y(p[1][0][gx], p[1][1][gx], p[1][2][gx]);
+      y1[gx*2 + 0] = RGB_TO_Y(p[2][0][gx], p[2][1][gx], p[2][2][gx]);
+      y1[gx*2 + 1] = RGB_TO_Y(p[3][0][gx], p[3][1][gx], p[3][2][gx]);
+
+      const int ar = (p[0][0][gx] + p[1][0][gx] + p[2][0][gx] + p[3][0][gx] + 1) >> 1;
+      const int ag = (p[0][1][gx] + p[1][1][gx] + p[2][1][gx] + p[3][1][gx] + 1) >> 1;
+      const int ab = (p[0][2][gx] + p[1][2][gx] + p[2][2][gx] + p[3][2][gx] + 1) >> 1;
+      uv[gx*2 + 0] = RGB_TO_U(ar, ag, ab);
+      uv[gx*2 + 1] = RGB_TO_V(ar, ag, ab);
+    }
+  }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "system/camerad/sensors/sensor.h"
+
+// Native implementation of process_raw.cl, for running the ISP without a GPU,
+// e.g. to reprocess logged raw frames offline with different parameters.
+// The sensor specific parts mirror sensors/*_cl.h. The kernel is built with
+// -cl-fast-relaxed-math, so the output matches it up to rounding, not bit for bit.
+// test/test_process_raw checks it bit for bit against a transcription of the kernel.
+// Each stage runs over a whole row so the compiler can vectorize it.
+class ProcessRawCpu {
+public:
+  ProcessRawCpu(const SensorInfo *sensor, bool vignetting, int out_width, int out_height, int yuv_stride, int uv_offset);
+
+  // raw frame in, NV12 out, the output rows are split between threads
+  void process(const uint8_t *raw, uint8_t *yuv, int expo_time, int threads = 1) const;
+
+private:
+  template <class Sensor>
+  void process_rows(const uint8_t *raw, uint8_t *yuv, int expo_time, int gy_begin, int gy_end) const;
+
+  typedef void (ProcessRawCpu::*ProcessRowsFunc)(const uint8_t *raw, uint8_t *yuv, int expo_time, int gy_begin, int gy_end) const;
+  ProcessRowsFunc process_rows_func;
+
+  int frame_stride, frame_offset;
+  int width, height;
+  int yuv_stride, uv_offset;
+  bool vignetting;
+  // the sensor's normalization before vignetting, indexed by the 12 bit pixel value
+  std::vector<float> normalize_lut;
+};
@@ -0,0 +1,182 @@
+// Checks the native ISP against process_raw.cl and benchmarks both, for each sensor with and without vignetting.
+// ./bench_process_raw [iterations] [--raw <sensor> <file>]
+//
+// Run from system/camerad, the kernel is loaded from cameras/process_raw.cl. The input is a synthetic
+// 12 bit frame, or a raw frame dumped from camerad with --raw, e.g. --raw ox03c10 frame.raw.
+// The kernel is built with -cl-fast-relaxed-math, so a few pixels may be off by one or two.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/clutil.h"
+#include "common/timing.h"
+#include "system/camerad/cameras/camera_common.h"
+#include "system/camerad/cameras/process_raw_cpu.h"
+#include "system/camerad/sensors/sensor.h"
+
+// fail if more than 0.1% of the bytes are off by more than this
+const int MAX_DIFF = 2;
+
+struct SensorCase {
+  const char *name;
+  std::unique_ptr<SensorInfo> (*create)();
+  // NV12 layout from SpectraCamera::camera_map_bufs
+  int stride, y_height;
+};
+
+template <class T>
+std::unique_ptr<SensorInfo> create_sensor() { return std::make_unique<T>(); }
+
+const SensorCase sensors[] = {
+  {"ar0231", create_sensor<AR0231>, 2048, 1216},
+  {"ox03c10", create_sensor<OX03C10>, 2048, 1216},
+  {"os04c10", create_sensor<OS04C10>, 1408, 768},
+};
+
+// smooth gradients with noise, packed as 12 bit MIPI: two high bytes, then both low nibbles
+static std::vector<uint8_t> synthetic_raw(const SensorInfo *sensor) {
+  std::vector<uint8_t> raw((sensor->frame_height + sensor->extra_height) * sensor->frame_stride);
+  std::mt19937 rng(1234);
+  std::uniform_int_distribution<int> noise(-64, 64);
+  for (uint32_t y = 0; y < sensor->frame_height; ++y) {
+    uint8_t *row = &raw[(sensor->frame_offset + y) * sensor->frame_stride];
+    for (uint32_t x = 0; x < sensor->frame_width; x += 2) {
+      int v[2];
+      for (int i = 0; i < 2; ++i) {
+        v[i] = std::clamp<int>(((x + i) * 4096 / sensor->frame_width + y * 2048 / sensor->frame_height) / 2 + noise(rng), 0, 4095);
+      }
+      uint8_t *p = &row[x / 2 * 3];
+      p[0] = v[0] >> 4;
+      p[1] = v[1] >> 4;
+      p[2] = (v[0] & 0xF) | ((v[1] & 0xF) << 4);
+    }
+  }
+  return raw;
+}
+
+static bool compare(const char *plane, const uint8_t *cl, const uint8_t *cpu, int width, int height, int stride) {
+  size_t diff = 0, over = 0;
+  int max_diff = 0;
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      int d = std::abs(cl[y * stride + x] - cpu[y * stride + x]);
+      diff += d != 0;
+      over += d > MAX_DIFF;
+      max_diff = std::max(max_diff, d);
+    }
+  }
+  const size_t total = (size_t)width * height;
+  const bool ok = over * 1000 <= total;
+  printf("  %s: %zu/%zu bytes differ, %zu by more than %d, max diff %d%s\n", plane, diff, total, over, MAX_DIFF, max_diff, ok ? "" : "  FAIL");
+  return ok;
+}
+
+template <class F>
+static double time_ms(int iterations, F f) {
+  double start = millis_since_boot();
+  for (int i = 0; i < iterations; ++i) f();
+  return (millis_since_boot() - start) / iterations;
+}
+
+int main(int argc, char *argv[]) {
+  int iterations = 20;
+  const char *raw_sensor = nullptr, *raw_path = nullptr;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--raw") == 0 && i + 2 < argc) {
+      raw_sensor = argv[++i];
+      raw_path = argv[++i];
+    } else {
+      iterations = atoi(argv[i]);
+    }
+  }
+
+  cl_device_id device_id = cl_get_device_id(CL_DEVICE_TYPE_DEFAULT);
+  cl_context context = cl_create_context(device_id);
+  const int threads = std::max(1u, std::thread::hardware_concurrency());
+  bool ok = true;
+
+  for (const auto &s : sensors) {
+    if (raw_sensor && strcmp(raw_sensor, s.name) != 0) continue;
+    std::unique_ptr<SensorInfo> sensor = s.create();
+
+    std::vector<uint8_t> raw = synthetic_raw(sensor.get());
+    if (raw_path) {
+      std::ifstream f(raw_path, std::ios::binary);
+      if (!f.read((char *)raw.data(), raw.size())) {
+        printf("%s: can't read %zu bytes\n", raw_path, raw.size());
+        return 1;
+      }
+    }
+
+    CameraBuf b = {};
+    b.out_img_width = sensor->frame_width;
+    b.out_img_height = sensor->frame_height;
+    const int uv_offset = s.stride * s.y_height;
+    const size_t yuv_size = uv_offset + s.stride * (s.y_height / 2);
+
+    VisionBuf raw_buf, cl_buf, cpu_buf;
+    raw_buf.allocate(raw.size());
+    raw_buf.init_cl(device_id, context);
+    memcpy(raw_buf.addr, raw.data(), raw.size());
+    raw_buf.sync(VISIONBUF_SYNC_TO_DEVICE);
+    for (VisionBuf *buf : {&cl_buf, &cpu_buf}) {
+      buf->allocate(yuv_size);
+      buf->init_cl(device_id, context);
+    }
+
+    for (int camera_num : {1, 0}) {
+      const bool vignetting = camera_num == 1;
+      printf("%s %dx%d%s, %s frame\n", s.name, b.out_img_width, b.out_img_height, vignetting ? " with vignetting" : "",
+             raw_path ? "recorded" : "synthetic");
+
+      ImgProc cl_proc(device_id, context, &b, sensor.get(), camera_num, s.stride, uv_offset);
+      ImgProc cpu_proc(device_id, context, &b, sensor.get(), camera_num, s.stride, uv_offset, 1);
+      ImgProc cpu_mt_proc(device_id, context, &b, sensor.get(), camera_num, s.stride, uv_offset, threads);
+      const int expo_time = sensor->exposure_time_max / 2;
+
+      memset(cl_buf.addr, 0, yuv_size);
+      memset(cpu_buf.addr, 0, yuv_size);
+      cl_proc.runKernel(&raw_buf, &cl_buf, b.out_img_width, b.out_img_height, expo_time);
+      cl_buf.sync(VISIONBUF_SYNC_FROM_DEVICE);
+      cpu_proc.runKernel(&raw_buf, &cpu_buf, b.out_img_width, b.out_img_height, expo_time);
+
+      const uint8_t *cl_yuv = (const uint8_t *)cl_buf.addr, *cpu_yuv = (const uint8_t *)cpu_buf.addr;
+      ok &= compare("y", cl_yuv, cpu_yuv, b.out_img_width, b.out_img_height, s.stride);
+      ok &= compare("uv", cl_yuv + uv_offset, cpu_yuv + uv_offset, b.out_img_width, b.out_img_height / 2, s.stride);
+
+      std::vector<uint8_t> mt(yuv_size);
+      cpu_mt_proc.runKernel(&raw_buf, &cpu_buf, b.out_img_width, b.out_img_height, expo_time);
+      memcpy(mt.data(), cpu_buf.addr, yuv_size);
+      cpu_proc.runKernel(&raw_buf, &cpu_buf, b.out_img_width, b.out_img_height, expo_time);
+      if (memcmp(mt.data(), cpu_buf.addr, yuv_size) != 0) {
+        printf("  %d threads: output differs from 1 thread  FAIL\n", threads);
+        ok = false;
+      }
+
+      printf("  opencl %.2f ms\n", time_ms(iterations, [&]() {
+        cl_proc.runKernel(&raw_buf, &cl_buf, b.out_img_width, b.out_img_height, expo_time);
+      }));
+      printf("  native 1 thread %.2f ms\n", time_ms(iterations, [&]() {
+        cpu_proc.runKernel(&raw_buf, &cpu_buf, b.out_img_width, b.out_img_height, expo_time);
+      }));
+      printf("  native %d threads %.2f ms\n", threads, time_ms(iterations, [&]() {
+        cpu_mt_proc.runKernel(&raw_buf, &cpu_buf, b.out_img_width, b.out_img_height, expo_time);
+      }));
+    }
+
+    for (VisionBuf *buf : {&raw_buf, &cl_buf, &cpu_buf}) {
+      buf->free();
+    }
+  }
+
+  cl_release_context(context);
+  return ok ? 0 : 1;
+}
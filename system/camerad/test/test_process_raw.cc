@@ -0,0 +1,311 @@
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "system/camerad/cameras/process_raw_cpu.h"
+#include "system/camerad/sensors/sensor.h"
+
+// ProcessRawCpu against process_raw.cl, transcribed below one work item at a time the way the
+// kernel is written, for the 12 bit path every sensor uses. Literals are single precision, as on
+// the device. The output has to match bit for bit. Against the real kernel it can't, that's
+// built with -cl-fast-relaxed-math, bench_process_raw checks it within a tolerance.
+
+struct float3 {
+  float x, y, z;
+};
+
+// sensors/*_cl.h
+struct AR0231Cl {
+  static constexpr bool bggr = false;
+  static float get_vignetting_s(float r) {
+    if (r < 62500) {
+      return (1.0f + 0.0000008f*r);
+    } else if (r < 490000) {
+      return (0.9625f + 0.0000014f*r);
+    } else if (r < 1102500) {
+      return (1.26434f + 0.0000000000016f*r*r);
+    } else {
+      return (0.53503625f + 0.0000000000022f*r*r);
+    }
+  }
+  static float normalize_pv(int parsed, float vignette_factor) {
+    float pv = ((float)parsed - 168) / (4096 - 168);
+    return std::fmin(std::fmax(pv*vignette_factor, 0.0f), 1.0f);
+  }
+  static float3 color_correct(float3 rgb) {
+    return {rgb.x * 1.82717181f + rgb.y * -0.5743977f + rgb.z * -0.25277411f,
+            rgb.x * -0.31231438f + rgb.y * 1.36858544f + rgb.z * -0.05627105f,
+            rgb.x * 0.07307673f + rgb.y * -0.53183455f + rgb.z * 1.45875782f};
+  }
+  static float apply_gamma(float rgb, int expo_time) {
+    const float gamma_k = 0.75f;
+    const float gamma_b = 0.125f;
+    const float mp = 0.01f;
+    const float rk = 9 - 100*mp;
+    return (rgb > mp) ?
+      ((rk * (rgb-mp) * (1-(gamma_k*mp+gamma_b)) * (1+1/(rk*(1-mp))) / (1+rk*(rgb-mp))) + gamma_k*mp + gamma_b) :
+      ((rk * (rgb-mp) * (gamma_k*mp+gamma_b) * (1+1/(rk*mp)) / (1-rk*(rgb-mp))) + gamma_k*mp + gamma_b);
+  }
+};
+
+struct OX03C10Cl {
+  static constexpr bool bggr = false;
+  static float get_vignetting_s(float r) { return AR0231Cl::get_vignetting_s(r); }
+  static float ox_lut_func(int x) {
+    if (x < 512) {
+      return x * 5.94873e-8f;
+    } else if (512 <= x && x < 768) {
+      return 3.0458e-05f + (x-512) * 1.19913e-7f;
+    } else if (768 <= x && x < 1536) {
+      return 6.1154e-05f + (x-768) * 2.38493e-7f;
+    } else if (1536 <= x && x < 1792) {
+      return 0.0002448f + (x-1536) * 9.56930e-7f;
+    } else if (1792 <= x && x < 2048) {
+      return 0.00048977f + (x-1792) * 1.91441e-6f;
+    } else if (2048 <= x && x < 2304) {
+      return 0.00097984f + (x-2048) * 3.82937e-6f;
+    } else if (2304 <= x && x < 2560) {
+      return 0.0019601f + (x-2304) * 7.659055e-6f;
+    } else if (2560 <= x && x < 2816) {
+      return 0.0039207f + (x-2560) * 1.525e-5f;
+    } else {
+      return 0.0078421f + (expf((x-2816)/273.0f) - 1) * 0.0092421f;
+    }
+  }
+  static float normalize_pv(int parsed, float vignette_factor) {
+    float pv = ox_lut_func(parsed);
+    return std::fmin(std::fmax(pv*vignette_factor*256.0f, 0.0f), 1.0f);
+  }
+  static float3 color_correct(float3 rgb) {
+    return {rgb.x * 1.5664815f + rgb.y * -0.48672447f + rgb.z * -0.07975703f,
+            rgb.x * -0.29808738f + rgb.y * 1.41914433f + rgb.z * -0.12105695f,
+            rgb.x * -0.03973474f + rgb.y * -0.40295248f + rgb.z * 1.44268722f};
+  }
+  // powr(rgb, 0.5) is sqrt, spelled the way the native path computes it
+  static float apply_gamma(float rgb, int expo_time) {
+    return -0.507089f*expf(-12.54124638f*rgb) + 0.9655f*sqrtf(rgb) - 0.472597f*rgb + 0.507089f;
+  }
+};
+
+struct OS04C10Cl {
+  static constexpr bool bggr = true;
+  static float get_vignetting_s(float r) {
+    if (r < 100000) {
+      return 1.0f + 0.0000013f*r;
+    } else if (r < 250000) {
+      return 1.02f + 0.0000011f*r;
+    } else if (r < 400000) {
+      return 0.92f + 0.0000015f*r;
+    } else {
+      return 0.44f + 0.0000027f*r;
+    }
+  }
+  static float normalize_pv(int parsed, float vignette_factor) {
+    float pv = ((float)parsed - 48) / (4095 - 48);
+    return std::fmin(std::fmax(pv*vignette_factor, 0.0f), 1.0f);
+  }
+  static float3 color_correct(float3 rgb) {
+    return {rgb.x * 1.55361989f + rgb.y * -0.421217301f + rgb.z * -0.132402589f,
+            rgb.x * -0.268894615f + rgb.y * 1.51883144f + rgb.z * -0.249936825f,
+            rgb.x * -0.000593219f + rgb.y * -0.69760146f + rgb.z * 1.69819468f};
+  }
+  static float apply_gamma(float rgb, int expo_time) {
+    return (10 * rgb) / (1 + 9 * rgb);
+  }
+};
+
+static float get_k(float a, float b, float c, float d) {
+  return 2.0f - (std::fabs(a - b) + std::fabs(c - d));
+}
+
+// convert_uchar3_sat(apply_gamma(color_correct(clamp(rgb_tmp, 0.0, 1.0)), expo_time) * 255.0)
+template <class Cl>
+static void to_rgb(float3 rgb_tmp, int expo_time, uint8_t out[3]) {
+  rgb_tmp = {std::fmin(std::fmax(rgb_tmp.x, 0.0f), 1.0f), std::fmin(std::fmax(rgb_tmp.y, 0.0f), 1.0f),
+             std::fmin(std::fmax(rgb_tmp.z, 0.0f), 1.0f)};
+  const float3 c = Cl::color_correct(rgb_tmp);
+  const float v[3] = {Cl::apply_gamma(c.x, expo_time) * 255.0f, Cl::apply_gamma(c.y, expo_time) * 255.0f,
+                      Cl::apply_gamma(c.z, expo_time) * 255.0f};
+  for (int i = 0; i < 3; ++i) {
+    out[i] = std::isnan(v[i]) ? 0 : (uint8_t)std::min(std::max(v[i], 0.0f), 255.0f);
+  }
+}
+
+#define RGB_TO_Y(r, g, b) ((((b * 13 + g * 65 + r * 33) + 64) >> 7) + 16)
+#define RGB_TO_U(r, g, b) ((b * 56 - g * 37 - r * 19 + 0x8080) >> 8)
+#define RGB_TO_V(r, g, b) ((r * 56 - g * 47 - b * 9 + 0x8080) >> 8)
+
+template <class Cl>
+static void process_raw(const SensorInfo *s, bool vignetting, int rgb_width, int rgb_height, int yuv_stride, int uv_offset,
+                        const uint8_t *in, uint8_t *out, int expo_time, int gid_x, int gid_y) {
+  const int FRAME_STRIDE = s->frame_stride, FRAME_OFFSET = s->frame_offset;
+  const int ROW_READ_ORDER[4] = {Cl::bggr ? 3 : 0, Cl::bggr ? 2 : 1, Cl::bggr ? 1 : 2, Cl::bggr ? 0 : 3};
+  const int RGB_WRITE_ORDER[4] = {Cl::bggr ? 2 : 0, Cl::bggr ? 3 : 1, Cl::bggr ? 0 : 2, Cl::bggr ? 1 : 3};
+
+  float vignette_factor = 1.0f;
+  if (vignetting) {
+    int gx = (gid_x*2 - rgb_width/2);
+    int gy = (gid_y*2 - rgb_height/2);
+    vignette_factor = Cl::get_vignetting_s(gx*gx + gy*gy);
+  }
+
+  const int row_before_offset = (gid_y == 0) ? 2 : 0;
+  const int row_after_offset = (gid_y == (rgb_height/2 - 1)) ? 1 : 3;
+  const int start_idx = (2 * gid_y - 1) * FRAME_STRIDE + (3 * gid_x - 2) + (FRAME_STRIDE * FRAME_OFFSET);
+
+  // read in 4 rows, 8 uchars each
+  uint8_t dat[4][8];
+  const int offsets[4] = {row_before_offset, 1, 2, row_after_offset};
+  for (int i = 0; i < 4; ++i) {
+    memcpy(dat[i], in + start_idx + FRAME_STRIDE*offsets[i], 8);
+  }
+  if (gid_x == 0 && gid_y == 0) {
+    uint8_t row[8];
+    memcpy(row, in + start_idx + FRAME_STRIDE*1 + 2, 8);
+    const uint8_t shifted[8] = {0, 0, row[0], row[1], row[2], row[3], row[4], row[5]};
+    memcpy(dat[1], shifted, 8);
+  }
+
+  // parse_12bit and normalize_pv
+  float v_rows[4][4];
+  for (int i = 0; i < 4; ++i) {
+    const uint8_t *pvs = dat[i];
+    const int parsed[4] = {((int)pvs[0]<<4) + (pvs[1]>>4), ((int)pvs[2]<<4) + (pvs[4]&0xF),
+                           ((int)pvs[3]<<4) + (pvs[4]>>4), ((int)pvs[5]<<4) + (pvs[7]&0xF)};
+    for (int j = 0; j < 4; ++j) {
+      v_rows[ROW_READ_ORDER[i]][j] = Cl::normalize_pv(parsed[j], vignette_factor);
+    }
+  }
+
+  // mirror padding
+  if (gid_x == 0) {
+    for (int i = 0; i < 4; ++i) v_rows[i][0] = v_rows[i][2];
+  } else if (gid_x == rgb_width/2 - 1) {
+    for (int i = 0; i < 4; ++i) v_rows[i][3] = v_rows[i][1];
+  }
+
+  // debayering
+  float (&v)[4][4] = v_rows;
+  uint8_t rgb_out[4][3];
+  float3 rgb_tmp;
+
+  const float k01 = get_k(v[0][0], v[1][1], v[0][2], v[1][1]);
+  const float k02 = get_k(v[0][2], v[1][1], v[2][2], v[1][1]);
+  const float k03 = get_k(v[2][0], v[1][1], v[2][2], v[1][1]);
+  const float k04 = get_k(v[0][0], v[1][1], v[2][0], v[1][1]);
+  rgb_tmp.x = (k02*v[1][2]+k04*v[1][0])/(k02+k04); // R_G1
+  rgb_tmp.y = v[1][1]; // G1(R)
+  rgb_tmp.z = (k01*v[0][1]+k03*v[2][1])/(k01+k03); // B_G1
+  to_rgb<Cl>(rgb_tmp, expo_time, rgb_out[RGB_WRITE_ORDER[0]]);
+
+  const float k11 = get_k(v[0][1], v[2][1], v[0][3], v[2][3]);
+  const float k12 = get_k(v[0][2], v[1][1], v[1][3], v[2][2]);
+  const float k13 = get_k(v[0][1], v[0][3], v[2][1], v[2][3]);
+  const float k14 = get_k(v[0][2], v[1][3], v[2][2], v[1][1]);
+  rgb_tmp.x = v[1][2]; // R
+  rgb_tmp.y = (k11*(v[0][2]+v[2][2])*0.5f+k13*(v[1][3]+v[1][1])*0.5f)/(k11+k13); // G_R
+  rgb_tmp.z = (k12*(v[0][3]+v[2][1])*0.5f+k14*(v[0][1]+v[2][3])*0.5f)/(k12+k14); // B_R
+  to_rgb<Cl>(rgb_tmp, expo_time, rgb_out[RGB_WRITE_ORDER[1]]);
+
+  const float k21 = get_k(v[1][0], v[3][0], v[1][2], v[3][2]);
+  const float k22 = get_k(v[1][1], v[2][0], v[2][2], v[3][1]);
+  const float k23 = get_k(v[1][0], v[1][2], v[3][0], v[3][2]);
+  const float k24 = get_k(v[1][1], v[2][2], v[3][1], v[2][0]);
+  rgb_tmp.x = (k22*(v[1][2]+v[3][0])*0.5f+k24*(v[1][0]+v[3][2])*0.5f)/(k22+k24); // R_B
+  rgb_tmp.y = (k21*(v[1][1]+v[3][1])*0.5f+k23*(v[2][2]+v[2][0])*0.5f)/(k21+k23); // G_B
+  rgb_tmp.z = v[2][1]; // B
+  to_rgb<Cl>(rgb_tmp, expo_time, rgb_out[RGB_WRITE_ORDER[2]]);
+
+  const float k31 = get_k(v[1][1], v[2][2], v[1][3], v[2][2]);
+  const float k32 = get_k(v[1][3], v[2][2], v[3][3], v[2][2]);
+  const float k33 = get_k(v[3][1], v[2][2], v[3][3], v[2][2]);
+  const float k34 = get_k(v[1][1], v[2][2], v[3][1], v[2][2]);
+  rgb_tmp.x = (k31*v[1][2]+k33*v[3][2])/(k31+k33); // R_G2
+  rgb_tmp.y = v[2][2]; // G2(B)
+  rgb_tmp.z = (k32*v[2][3]+k34*v[2][1])/(k32+k34); // B_G2
+  to_rgb<Cl>(rgb_tmp, expo_time, rgb_out[RGB_WRITE_ORDER[3]]);
+
+  // rgb2yuv(nv12)
+  uint8_t *y0 = out + (gid_y * 2) * yuv_stride + gid_x * 2;
+  y0[0] = RGB_TO_Y(rgb_out[0][0], rgb_out[0][1], rgb_out[0][2]);
+  y0[1] = RGB_TO_Y(rgb_out[1][0], rgb_out[1][1], rgb_out[1][2]);
+  uint8_t *y1 = out + (gid_y * 2 + 1) * yuv_stride + gid_x * 2;
+  y1[0] = RGB_TO_Y(rgb_out[2][0], rgb_out[2][1], rgb_out[2][2]);
+  y1[1] = RGB_TO_Y(rgb_out[3][0], rgb_out[3][1], rgb_out[3][2]);
+
+  // AVERAGE
+  const short ar = (rgb_out[0][0] + rgb_out[1][0] + rgb_out[2][0] + rgb_out[3][0] + 1) >> 1;
+  const short ag = (rgb_out[0][1] + rgb_out[1][1] + rgb_out[2][1] + rgb_out[3][1] + 1) >> 1;
+  const short ab = (rgb_out[0][2] + rgb_out[1][2] + rgb_out[2][2] + rgb_out[3][2] + 1) >> 1;
+  uint8_t *uv = out + uv_offset + gid_y * yuv_stride + gid_x * 2;
+  uv[0] = RGB_TO_U(ar, ag, ab);
+  uv[1] = RGB_TO_V(ar, ag, ab);
+}
+
+// gradients with noise, clipping at both ends, packed as 12 bit MIPI
+static std::vector<uint8_t> random_raw(const SensorInfo *s) {
+  std::vector<uint8_t> raw((s->frame_height + s->extra_height) * s->frame_stride);
+  std::mt19937 rng(1234);
+  std::uniform_int_distribution<int> noise(-256, 256);
+  for (uint32_t y = 0; y < s->frame_height; ++y) {
+    uint8_t *row = &raw[(s->frame_offset + y) * s->frame_stride];
+    for (uint32_t x = 0; x < s->frame_width; x += 2) {
+      int v[2];
+      for (int i = 0; i < 2; ++i) {
+        v[i] = std::clamp<int>(((x + i) * 5000 / s->frame_width + y * 1000 / s->frame_height) - 500 + noise(rng), 0, 4095);
+      }
+      uint8_t *p = &row[x / 2 * 3];
+      p[0] = v[0] >> 4;
+      p[1] = v[1] >> 4;
+      p[2] = (v[0] & 0xF) | ((v[1] & 0xF) << 4);
+    }
+  }
+  return raw;
+}
+
+template <class Sensor, class Cl>
+static void check(int stride, int y_height) {
+  auto sensor = std::make_unique<Sensor>();
+  const int width = sensor->frame_width, height = sensor->frame_height;
+  const int uv_offset = stride * y_height;
+  const std::vector<uint8_t> raw = random_raw(sensor.get());
+
+  for (bool vignetting : {false, true}) {
+    std::vector<uint8_t> ref(uv_offset + stride * (y_height / 2)), out(ref.size());
+    for (int gid_y = 0; gid_y < height / 2; ++gid_y) {
+      for (int gid_x = 0; gid_x < width / 2; ++gid_x) {
+        process_raw<Cl>(sensor.get(), vignetting, width, height, stride, uv_offset, raw.data(), ref.data(),
+                        sensor->exposure_time_max / 2, gid_x, gid_y);
+      }
+    }
+
+    ProcessRawCpu cpu(sensor.get(), vignetting, width, height, stride, uv_offset);
+    cpu.process(raw.data(), out.data(), sensor->exposure_time_max / 2, 4);
+
+    INFO("vignetting " << vignetting);
+    size_t mismatched = 0;
+    for (size_t i = 0; i < ref.size(); ++i) {
+      mismatched += ref[i] != out[i];
+    }
+    REQUIRE(mismatched == 0);
+  }
+}
+
+// NV12 layouts from SpectraCamera::camera_map_bufs
+TEST_CASE("process_raw_cpu ar0231") {
+  check<AR0231, AR0231Cl>(2048, 1216);
+}
+
+TEST_CASE("process_raw_cpu ox03c10") {
+  check<OX03C10, OX03C10Cl>(2048, 1216);
+}
+
+TEST_CASE("process_raw_cpu os04c10") {
+  check<OS04C10, OS04C10Cl>(1408, 768);
+}
@@ -1,7 +1,9 @@
 #include "system/loggerd/encoder/encoder.h"
 
+#include <algorithm>
+
 VideoEncoder::VideoEncoder(const EncoderInfo &encoder_info, int in_width, int in_height)
-    : encoder_info(encoder_info), in_width(in_width), in_height(in_height) {
+    : encoder_info(encoder_info), encode_type(encoder_info.encode_type), in_width(in_width), in_height(in_height) {
 
   out_width = encoder_info.frame_width > 0 ? encoder_info.frame_width : in_width;
   out_height = encoder_info.frame_height > 0 ? encoder_info.frame_height : in_height;
@@ -12,10 +14,16 @@ VideoEncoder::VideoEncoder(const EncoderInfo &encoder_info, int in_width, int in
     pubs.push_back(encoder_info.thumbnail_name);
   }
   pm.reset(new PubMaster(pubs));
+  recent_sizes.resize(encoder_info.fps);
 }
 
 void VideoEncoder::publisher_publish(int segment_num, uint32_t idx, VisionIpcBufExtra &extra,
-                                     unsigned int flags, kj::ArrayPtr<capnp::byte> header, kj::ArrayPtr<capnp::byte> dat) {
+                                     unsigned int flags, kj::ArrayPtr<capnp::byte> header, kj::ArrayPtr<capnp::byte> dat,
+                                     float encode_time_ms) {
+  uint32_t &oldest = recent_sizes[cnt % recent_sizes.size()];
+  recent_bytes += dat.size() - oldest;
+  oldest = dat.size();
+
   // broadcast packet
   MessageBuilder msg;
   auto event = msg.initEvent(true);
@@ -27,12 +35,16 @@ void VideoEncoder::publisher_publish(int segment_num, uint32_t idx, VisionIpcBuf
   edata.setFrameId(extra.frame_id);
   edata.setTimestampSof(extra.timestamp_sof);
   edata.setTimestampEof(extra.timestamp_eof);
-  edata.setType(encoder_info.encode_type);
+  edata.setType(encode_type);
   edata.setEncodeId(cnt++);
   edata.setSegmentNum(segment_num);
   edata.setSegmentId(idx);
   edata.setFlags(flags);
   edata.setLen(dat.size());
+  edata.setQueueDepth(queue_depth);
+  edata.setFramesDropped(frames_dropped);
+  edata.setEncodeTimeMs(encode_time_ms);
+  edata.setBitrate(recent_bytes * 8 * encoder_info.fps / std::min<size_t>(cnt, recent_sizes.size()));
   edat.adoptData(msg.getOrphanage().referenceExternalData(dat));
   edat.setWidth(out_width);
   edat.setHeight(out_height);
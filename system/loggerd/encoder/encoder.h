@@ -8,6 +8,7 @@
 #define V4L2_BUF_FLAG_KEYFRAME 8
 #endif
 
+#include <atomic>
 #include <cassert>
 #include <cstdint>
 #include <memory>
@@ -26,8 +27,15 @@ public:
   virtual int encode_frame(VisionBuf* buf, VisionIpcBufExtra *extra) = 0;
   virtual void encoder_open(const char* path) = 0;
   virtual void encoder_close() = 0;
+  // start the next segment without reopening the codec, the next frame is an IDR
+  virtual void encoder_rotate() = 0;
 
-  void publisher_publish(int segment_num, uint32_t idx, VisionIpcBufExtra &extra, unsigned int flags, kj::ArrayPtr<capnp::byte> header, kj::ArrayPtr<capnp::byte> dat);
+  void publisher_publish(int segment_num, uint32_t idx, VisionIpcBufExtra &extra, unsigned int flags,
+                         kj::ArrayPtr<capnp::byte> header, kj::ArrayPtr<capnp::byte> dat, float encode_time_ms = 0);
+
+  // filled in by the encoderd worker feeding this encoder, published in the EncodeIndex
+  std::atomic<uint32_t> queue_depth = 0;
+  std::atomic<uint32_t> frames_dropped = 0;
 
 protected:
   void publish_thumbnail(uint32_t frame_id, uint64_t timestamp_eof, kj::ArrayPtr<capnp::byte> dat);
@@ -35,10 +43,15 @@ protected:
   int in_width, in_height;
   int out_width, out_height;
   const EncoderInfo encoder_info;
+  // what actually comes out of the encoder, FfmpegEncoder profiles can change it
+  cereal::EncodeIndex::Type encode_type;
 
 private:
   // total frames encoded
   int cnt = 0;
+  // packet sizes over the last second, for the bitrate
+  std::vector<uint32_t> recent_sizes;
+  uint64_t recent_bytes = 0;
   std::unique_ptr<PubMaster> pm;
   std::vector<capnp::byte> msg_cache;
 };
@@ -8,6 +8,7 @@
 #include <cassert>
 #include <cstdio>
 #include <cstdlib>
+#include <utility>
 
 #define __STDC_CONSTANT_MACROS
 
@@ -20,12 +21,40 @@ extern "C" {
 }
 
 #include "common/swaglog.h"
+#include "common/timing.h"
 #include "common/util.h"
 
 const int env_debug_encoder = (getenv("DEBUG_ENCODER") != NULL) ? atoi(getenv("DEBUG_ENCODER")) : 0;
 
+static FfmpegProfile get_profile(const EncoderInfo &encoder_info) {
+  const std::string env = util::getenv("FFMPEG_PROFILE");
+  if (env == "lossless") return FfmpegProfile::LOSSLESS;
+  if (env == "fast_lossless") return FfmpegProfile::FAST_LOSSLESS;
+  if (env == "realtime") return FfmpegProfile::REALTIME;
+  if (env == "near_lossless") return FfmpegProfile::NEAR_LOSSLESS;
+  if (!env.empty()) LOGE("unknown FFMPEG_PROFILE %s", env.c_str());
+  return encoder_info.ffmpeg_profile;
+}
+
 FfmpegEncoder::FfmpegEncoder(const EncoderInfo &encoder_info, int in_width, int in_height)
-    : VideoEncoder(encoder_info, in_width, in_height) {
+    : VideoEncoder(encoder_info, in_width, in_height), profile(get_profile(encoder_info)) {
+  if (profile == FfmpegProfile::REALTIME || profile == FfmpegProfile::NEAR_LOSSLESS) {
+    // qcamera and livestreams stay h264, the main cameras are hevc like on device
+    bool h264 = encoder_info.encode_type == cereal::EncodeIndex::Type::QCAMERA_H264 ||
+                encoder_info.encode_type == cereal::EncodeIndex::Type::LIVESTREAM_H264;
+    codec = avcodec_find_encoder_by_name(h264 ? "libx264" : "libx265");
+    if (codec) {
+      encode_type = h264 ? encoder_info.encode_type : cereal::EncodeIndex::Type::FULL_H_E_V_C;
+    } else {
+      LOGE("%s not available, falling back to lossless", h264 ? "libx264" : "libx265");
+      profile = FfmpegProfile::LOSSLESS;
+    }
+  }
+  if (!codec) {
+    codec = avcodec_find_encoder(AV_CODEC_ID_FFVHUFF);
+  }
+  assert(codec);
+
   frame = av_frame_alloc();
   assert(frame);
   frame->format = AV_PIX_FMT_YUV420P;
@@ -35,10 +64,11 @@ FfmpegEncoder::FfmpegEncoder(const EncoderInfo &encoder_info, int in_width, int
   frame->linesize[1] = out_width/2;
   frame->linesize[2] = out_width/2;
 
-  convert_buf.resize(in_width * in_height * 3 / 2);
-
   if (in_width != out_width || in_height != out_height) {
     downscale_buf.resize(out_width * out_height * 3 / 2);
+    scaler = std::make_unique<Nv12Scaler>(in_width, in_height, out_width, out_height);
+  } else {
+    convert_buf.resize(in_width * in_height * 3 / 2);
   }
 }
 
@@ -48,15 +78,49 @@ FfmpegEncoder::~FfmpegEncoder() {
 }
 
 void FfmpegEncoder::encoder_open(const char* path) {
-  const AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_FFVHUFF);
-
   this->codec_ctx = avcodec_alloc_context3(codec);
   assert(this->codec_ctx);
   this->codec_ctx->width = frame->width;
   this->codec_ctx->height = frame->height;
   this->codec_ctx->pix_fmt = AV_PIX_FMT_YUV420P;
   this->codec_ctx->time_base = (AVRational){ 1, encoder_info.fps };
-  int err = avcodec_open2(this->codec_ctx, codec, NULL);
+
+  AVDictionary *opts = NULL;
+  switch (profile) {
+    case FfmpegProfile::LOSSLESS:
+      break;
+    case FfmpegProfile::FAST_LOSSLESS:
+      this->codec_ctx->thread_type = FF_THREAD_FRAME;
+      this->codec_ctx->thread_count = 0;
+      av_dict_set(&opts, "pred", "left", 0);
+      break;
+    case FfmpegProfile::REALTIME:
+      this->codec_ctx->thread_type = FF_THREAD_SLICE;
+      this->codec_ctx->thread_count = 0;
+      this->codec_ctx->bit_rate = encoder_info.bitrate;
+      av_dict_set(&opts, "preset", "veryfast", 0);
+      av_dict_set(&opts, "tune", "zerolatency", 0);
+      break;
+    case FfmpegProfile::NEAR_LOSSLESS:
+      this->codec_ctx->thread_type = FF_THREAD_FRAME;
+      this->codec_ctx->thread_count = 0;
+      av_dict_set(&opts, "preset", "veryfast", 0);
+      av_dict_set(&opts, "crf", "18", 0);
+      break;
+  }
+  if (codec->id != AV_CODEC_ID_FFVHUFF) {
+    // same GOP as the V4L encoder, and no B-frames so packets come out in frame order
+    this->codec_ctx->gop_size = codec->id == AV_CODEC_ID_HEVC ? 30 : 15;
+    this->codec_ctx->max_b_frames = 0;
+    av_dict_set(&opts, "forced-idr", "1", 0);
+    if (codec->id == AV_CODEC_ID_HEVC) {
+      // every keyframe needs the VPS/SPS/PPS, the hevc files are written raw
+      av_dict_set(&opts, "x265-params", "bframes=0:repeat-headers=1:log-level=error", 0);
+    }
+  }
+
+  int err = avcodec_open2(this->codec_ctx, codec, &opts);
+  av_dict_free(&opts);
   assert(err >= 0);
 
   is_open = true;
@@ -67,66 +131,75 @@ void FfmpegEncoder::encoder_open(const char* path) {
 void FfmpegEncoder::encoder_close() {
   if (!is_open) return;
 
+  // flush the frames still in the codec into this segment
+  int err = avcodec_send_frame(this->codec_ctx, NULL);
+  if (err < 0) {
+    LOGE("avcodec_send_frame flush error %d", err);
+  } else {
+    receive_packets();
+  }
+  pending.clear();
+
   avcodec_free_context(&codec_ctx);
   is_open = false;
 }
 
+void FfmpegEncoder::encoder_rotate() {
+  // frames still inside the codec go out with the segment they were sent in
+  segment_num++;
+  force_keyframe = true;
+}
+
 int FfmpegEncoder::encode_frame(VisionBuf* buf, VisionIpcBufExtra *extra) {
   assert(buf->width == this->in_width);
   assert(buf->height == this->in_height);
 
-  uint8_t *cy = convert_buf.data();
-  uint8_t *cu = cy + in_width * in_height;
-  uint8_t *cv = cu + (in_width / 2) * (in_height / 2);
-  libyuv::NV12ToI420(buf->y, buf->stride,
-                     buf->uv, buf->stride,
-                     cy, in_width,
-                     cu, in_width/2,
-                     cv, in_width/2,
-                     in_width, in_height);
-
-  if (downscale_buf.size() > 0) {
+  if (scaler) {
+    // convert and downscale in one pass, straight from the NV12 buffer
     uint8_t *out_y = downscale_buf.data();
     uint8_t *out_u = out_y + frame->width * frame->height;
     uint8_t *out_v = out_u + (frame->width / 2) * (frame->height / 2);
-    libyuv::I420Scale(cy, in_width,
-                      cu, in_width/2,
-                      cv, in_width/2,
-                      in_width, in_height,
-                      out_y, frame->width,
-                      out_u, frame->width/2,
-                      out_v, frame->width/2,
-                      frame->width, frame->height,
-                      libyuv::kFilterNone);
+    scaler->scale(buf->y, buf->uv, buf->stride, out_y, out_u, out_v);
     frame->data[0] = out_y;
     frame->data[1] = out_u;
     frame->data[2] = out_v;
   } else {
+    uint8_t *cy = convert_buf.data();
+    uint8_t *cu = cy + in_width * in_height;
+    uint8_t *cv = cu + (in_width / 2) * (in_height / 2);
+    libyuv::NV12ToI420(buf->y, buf->stride,
+                       buf->uv, buf->stride,
+                       cy, in_width,
+                       cu, in_width/2,
+                       cv, in_width/2,
+                       in_width, in_height);
     frame->data[0] = cy;
     frame->data[1] = cu;
     frame->data[2] = cv;
   }
-  frame->pts = counter*50*1000; // 50ms per frame
-
-  int ret = counter;
+  frame->pts = frames_in++;
+  frame->pict_type = std::exchange(force_keyframe, false) ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+  pending.push_back({*extra, segment_num, millis_since_boot()});
 
   int err = avcodec_send_frame(this->codec_ctx, frame);
   if (err < 0) {
     LOGE("avcodec_send_frame error %d", err);
-    ret = -1;
+    pending.pop_back();
+    return -1;
   }
+  return receive_packets() < 0 ? -1 : frames_in - 1;
+}
 
+int FfmpegEncoder::receive_packets() {
+  int ret = 0;
   AVPacket pkt;
   av_init_packet(&pkt);
   pkt.data = NULL;
   pkt.size = 0;
-  while (ret >= 0) {
-    err = avcodec_receive_packet(this->codec_ctx, &pkt);
-    if (err == AVERROR_EOF) {
-      break;
-    } else if (err == AVERROR(EAGAIN)) {
+  while (true) {
+    int err = avcodec_receive_packet(this->codec_ctx, &pkt);
+    if (err == AVERROR_EOF || err == AVERROR(EAGAIN)) {
       // Encoder might need a few frames on startup to get started. Keep going
-      ret = 0;
       break;
     } else if (err < 0) {
       LOGE("avcodec_receive_packet error %d", err);
@@ -134,17 +207,28 @@ int FfmpegEncoder::encode_frame(VisionBuf* buf, VisionIpcBufExtra *extra) {
       break;
     }
 
+    // no B-frames, so packets are in the same order as the frames
+    assert(!pending.empty());
+    PendingFrame pf = pending.front();
+    pending.pop_front();
+    float encode_time_ms = millis_since_boot() - pf.send_time;
+    if (pf.segment_num != out_segment_num) {
+      out_segment_num = pf.segment_num;
+      counter = 0;
+    }
+
     if (env_debug_encoder) {
-      printf("%20s got %8d bytes flags %8x idx %4d id %8d\n", encoder_info.publish_name, pkt.size, pkt.flags, counter, extra->frame_id);
+      printf("%20s got %8d bytes flags %8x idx %4d id %8d in %.2f ms\n", encoder_info.publish_name, pkt.size, pkt.flags, counter, pf.extra.frame_id, encode_time_ms);
     }
 
-    publisher_publish(segment_num, counter, *extra,
+    publisher_publish(pf.segment_num, counter, pf.extra,
       (pkt.flags & AV_PKT_FLAG_KEY) ? V4L2_BUF_FLAG_KEYFRAME : 0,
       kj::arrayPtr<capnp::byte>(pkt.data, (size_t)0), // TODO: get the header
-      kj::arrayPtr<capnp::byte>(pkt.data, pkt.size));
+      kj::arrayPtr<capnp::byte>(pkt.data, pkt.size),
+      encode_time_ms);
 
     counter++;
+    av_packet_unref(&pkt);
   }
-  av_packet_unref(&pkt);
   return ret;
 }
@@ -2,6 +2,8 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <deque>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -12,6 +14,7 @@ extern "C" {
 }
 
 #include "system/loggerd/encoder/encoder.h"
+#include "system/loggerd/encoder/yuv_scale.h"
 #include "system/loggerd/loggerd.h"
 
 class FfmpegEncoder : public VideoEncoder {
@@ -21,14 +24,31 @@ public:
   int encode_frame(VisionBuf* buf, VisionIpcBufExtra *extra);
   void encoder_open(const char* path);
   void encoder_close();
+  void encoder_rotate();
 
 private:
+  int receive_packets();
+
   int segment_num = -1;
   int counter = 0;
+  int frames_in = 0;
+  int out_segment_num = -1;
   bool is_open = false;
+  bool force_keyframe = false;
 
+  FfmpegProfile profile;
+  const AVCodec *codec = NULL;
   AVCodecContext *codec_ctx;
   AVFrame *frame = NULL;
   std::vector<uint8_t> convert_buf;
   std::vector<uint8_t> downscale_buf;
+  std::unique_ptr<Nv12Scaler> scaler;
+
+  // frames handed to the codec that haven't come out yet, threaded codecs hold a few
+  struct PendingFrame {
+    VisionIpcBufExtra extra;
+    int segment_num;
+    double send_time;
+  };
+  std::deque<PendingFrame> pending;
 };
@@ -1,5 +1,6 @@
 #include <cassert>
 #include <string>
+#include <utility>
 #include <sys/ioctl.h>
 #include <poll.h>
 
@@ -83,7 +84,7 @@ void V4LEncoder::dequeue_handler(V4LEncoder *e) {
   std::string dequeue_thread_name = "dq-"+std::string(e->encoder_info.publish_name);
   util::set_thread_name(dequeue_thread_name.c_str());
 
-  e->segment_num++;
+  int segment_num = -1;
   uint32_t idx = -1;
   bool exit = false;
 
@@ -129,16 +130,20 @@ void V4LEncoder::dequeue_handler(V4LEncoder *e) {
         // save header
         header = kj::heapArray<capnp::byte>(buf, bytesused);
       } else {
-        VisionIpcBufExtra extra = e->extras.pop();
+        auto [extra, frame_segment_num] = e->extras.pop();
         assert(extra.timestamp_eof/1000 == ts); // stay in sync
         frame_id = extra.frame_id;
+        if (frame_segment_num != segment_num) {
+          segment_num = frame_segment_num;
+          idx = -1;
+        }
         ++idx;
-        e->publisher_publish(e->segment_num, idx, extra, flags, header, kj::arrayPtr<capnp::byte>(buf, bytesused));
+        e->publisher_publish(segment_num, idx, extra, flags, header, kj::arrayPtr<capnp::byte>(buf, bytesused));
       }
 
       if (env_debug_encoder) {
         printf("%20s got(%d) %6d bytes flags %8x idx %3d/%4d id %8d ts %ld lat %.2f ms (%lu frames free)\n",
-          e->encoder_info.publish_name, index, bytesused, flags, e->segment_num, idx, frame_id, ts, millis_since_boot()-(ts/1000.), e->free_buf_in.size());
+          e->encoder_info.publish_name, index, bytesused, flags, segment_num, idx, frame_id, ts, millis_since_boot()-(ts/1000.), e->free_buf_in.size());
       }
 
       // requeue the buffer
@@ -276,11 +281,18 @@ V4LEncoder::V4LEncoder(const EncoderInfo &encoder_info, int in_width, int in_hei
 }
 
 void V4LEncoder::encoder_open(const char* path) {
+  this->segment_num++;
   dequeue_handler_thread = std::thread(V4LEncoder::dequeue_handler, this);
   this->is_open = true;
   this->counter = 0;
 }
 
+void V4LEncoder::encoder_rotate() {
+  // frames already queued in the encoder finish the current segment
+  this->segment_num++;
+  this->force_keyframe = true;
+}
+
 int V4LEncoder::encode_frame(VisionBuf* buf, VisionIpcBufExtra *extra) {
   struct timeval timestamp {
     .tv_sec = (long)(extra->timestamp_eof/1000000000),
@@ -290,8 +302,14 @@ int V4LEncoder::encode_frame(VisionBuf* buf, VisionIpcBufExtra *extra) {
   // reserve buffer
   int buffer_in = free_buf_in.pop();
 
+  // the IDR_PERIOD is 1, so every I-frame is an IDR
+  if (std::exchange(force_keyframe, false)) {
+    struct v4l2_control ctrl = { .id = V4L2_CID_MPEG_VIDC_VIDEO_REQUEST_IFRAME, .value = 1 };
+    checked_ioctl(fd, VIDIOC_S_CTRL, &ctrl);
+  }
+
   // push buffer
-  extras.push(*extra);
+  extras.push({*extra, segment_num});
   //buf->sync(VISIONBUF_SYNC_TO_DEVICE);
   queue_buffer(fd, V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE, buffer_in, buf, timestamp);
 
@@ -13,6 +13,7 @@ public:
   int encode_frame(VisionBuf* buf, VisionIpcBufExtra *extra);
   void encoder_open(const char* path);
   void encoder_close();
+  void encoder_rotate();
 private:
   int fd;
 
@@ -20,7 +21,13 @@ private:
   int segment_num = -1;
   int counter = 0;
 
-  SafeQueue<VisionIpcBufExtra> extras;
+  // frames queued into the encoder, with the segment they belong to
+  struct QueuedFrame {
+    VisionIpcBufExtra extra;
+    int segment_num;
+  };
+  SafeQueue<QueuedFrame> extras;
+  bool force_keyframe = false;
 
   static void dequeue_handler(V4LEncoder *e);
   std::thread dequeue_handler_thread;
@@ -0,0 +1,81 @@
+#include "system/loggerd/encoder/yuv_scale.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "third_party/libyuv/include/libyuv.h"
+
+static void sample_ranges(int src, int dst, std::vector<int> &start, std::vector<int> &end) {
+  start.resize(dst);
+  end.resize(dst);
+  for (int i = 0; i < dst; i++) {
+    start[i] = (int64_t)i * src / dst;
+    end[i] = std::max(start[i] + 1, (int)((int64_t)(i + 1) * src / dst));
+  }
+}
+
+Nv12Scaler::Nv12Scaler(int src_width, int src_height, int dst_width, int dst_height, bool box_filter)
+    : src_width(src_width), src_height(src_height), dst_width(dst_width), dst_height(dst_height), box_filter(box_filter) {
+  assert(dst_width <= src_width && dst_height <= src_height);
+  sample_ranges(src_width / 2, dst_width / 2, x0, x1);
+  sample_ranges(src_height / 2, dst_height / 2, y0, y1);
+  // row sums are 16 bit, so a box can't be taller than 257 rows
+  assert(src_height / dst_height < 256);
+  row_sum.resize(src_width);
+}
+
+void Nv12Scaler::scale(const uint8_t *src_y, const uint8_t *src_uv, int src_stride,
+                       uint8_t *dst_y, uint8_t *dst_u, uint8_t *dst_v) {
+  libyuv::ScalePlane(src_y, src_stride, src_width, src_height,
+                     dst_y, dst_width, dst_width, dst_height,
+                     box_filter ? libyuv::kFilterBox : libyuv::kFilterNone);
+  if (box_filter) {
+    scale_uv_box(src_uv, src_stride, dst_u, dst_v);
+  } else {
+    scale_uv_point(src_uv, src_stride, dst_u, dst_v);
+  }
+}
+
+void Nv12Scaler::scale_uv_point(const uint8_t *src_uv, int src_stride, uint8_t *dst_u, uint8_t *dst_v) {
+  const int w = dst_width / 2;
+  for (int j = 0; j < dst_height / 2; j++) {
+    // sample the center of the box
+    const uint8_t *row = src_uv + ((y0[j] + y1[j]) / 2) * src_stride;
+    for (int i = 0; i < w; i++) {
+      const uint8_t *px = row + (x0[i] + x1[i]) / 2 * 2;
+      dst_u[i] = px[0];
+      dst_v[i] = px[1];
+    }
+    dst_u += w;
+    dst_v += w;
+  }
+}
+
+void Nv12Scaler::scale_uv_box(const uint8_t *src_uv, int src_stride, uint8_t *dst_u, uint8_t *dst_v) {
+  const int w = dst_width / 2;
+  uint16_t *sum = row_sum.data();
+  for (int j = 0; j < dst_height / 2; j++) {
+    // vertical sum of the interleaved rows, the compiler vectorizes this into wide adds
+    const uint8_t *row = src_uv + y0[j] * src_stride;
+    for (int k = 0; k < src_width; k++) sum[k] = row[k];
+    for (int y = y0[j] + 1; y < y1[j]; y++) {
+      row = src_uv + y * src_stride;
+      for (int k = 0; k < src_width; k++) sum[k] += row[k];
+    }
+
+    // horizontal sum and deinterleave
+    const int rows = y1[j] - y0[j];
+    for (int i = 0; i < w; i++) {
+      uint32_t u = 0, v = 0;
+      for (int x = x0[i]; x < x1[i]; x++) {
+        u += sum[2 * x];
+        v += sum[2 * x + 1];
+      }
+      const uint32_t area = rows * (x1[i] - x0[i]);
+      dst_u[i] = (u + area / 2) / area;
+      dst_v[i] = (v + area / 2) / area;
+    }
+    dst_u += w;
+    dst_v += w;
+  }
+}
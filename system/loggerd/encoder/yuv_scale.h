@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Converts NV12 to a downscaled I420 frame in a single pass over the source.
+// Y goes straight through libyuv's SIMD plane scaler, UV is deinterleaved while it's
+// scaled, so there's no full resolution I420 intermediate like NV12ToI420 + I420Scale.
+// All the sampling tables are computed once here, scale() doesn't allocate.
+class Nv12Scaler {
+public:
+  Nv12Scaler(int src_width, int src_height, int dst_width, int dst_height, bool box_filter = false);
+  void scale(const uint8_t *src_y, const uint8_t *src_uv, int src_stride,
+             uint8_t *dst_y, uint8_t *dst_u, uint8_t *dst_v);
+
+private:
+  void scale_uv_point(const uint8_t *src_uv, int src_stride, uint8_t *dst_u, uint8_t *dst_v);
+  void scale_uv_box(const uint8_t *src_uv, int src_stride, uint8_t *dst_u, uint8_t *dst_v);
+
+  int src_width, src_height;
+  int dst_width, dst_height;
+  bool box_filter;
+
+  // source column/row ranges covered by each output chroma sample, [x0, x1)
+  std::vector<int> x0, x1, y0, y1;
+  std::vector<uint16_t> row_sum;
+};
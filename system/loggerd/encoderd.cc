@@ -1,4 +1,7 @@
+#include <atomic>
 #include <cassert>
+#include <condition_variable>
+#include <mutex>
 
 #include "system/loggerd/loggerd.h"
 
@@ -44,11 +47,128 @@ bool sync_encoders(EncoderdState *s, VisionStreamType cam_type, uint32_t frame_i
 }
 
 
+// Each encoder is fed by its own worker thread through a small ring of VisionBuf references,
+// so a slow encoder (e.g. fcamera HEVC) can't hold up the others on the same camera.
+// The ring never blocks the camera thread: when it's full, the frame is dropped for that encoder only.
+// Keep this well below camerad's VIPC_BUFFER_COUNT, the VisionBufs are only valid until camerad reuses them.
+// Frames overwritten while waiting in the ring are skipped. A frame overwritten during the encode has already
+// been handed to the encoder and is only reported.
+constexpr int ENCODER_QUEUE_SIZE = 3;
+
+struct EncoderJob {
+  VisionBuf *buf;
+  VisionIpcBufExtra extra;
+  bool rotate;
+};
+
+class EncoderWorker {
+public:
+  EncoderWorker(const EncoderInfo &encoder_info, int in_width, int in_height)
+      : name(encoder_info.publish_name), encoder(new Encoder(encoder_info, in_width, in_height)) {
+    encoder->encoder_open(nullptr);
+    thread = std::thread(&EncoderWorker::run, this);
+  }
+
+  ~EncoderWorker() {
+    {
+      std::unique_lock lk(lock);
+      exit = true;
+    }
+    cv.notify_one();
+    thread.join();
+  }
+
+  void push(VisionBuf *buf, const VisionIpcBufExtra &extra, bool rotate) {
+    {
+      std::unique_lock lk(lock);
+      if (count == ENCODER_QUEUE_SIZE) {
+        // the rotation has to happen, carry it over to the next frame that fits
+        pending_rotate |= rotate;
+        drop(extra.frame_id, "queue full");
+        return;
+      }
+      ring[(head + count) % ENCODER_QUEUE_SIZE] = {buf, extra, rotate || std::exchange(pending_rotate, false)};
+      encoder->queue_depth = ++count;
+    }
+    cv.notify_one();
+  }
+
+private:
+  void run() {
+    std::string thread_name = "enc-" + std::string(name);
+    util::set_thread_name(thread_name.c_str());
+
+    while (true) {
+      EncoderJob job;
+      {
+        std::unique_lock lk(lock);
+        cv.wait(lk, [this] { return count > 0 || exit; });
+        if (exit) break;
+        job = ring[head];
+        head = (head + 1) % ENCODER_QUEUE_SIZE;
+        encoder->queue_depth = --count;
+      }
+
+      if (job.rotate) {
+        encoder->encoder_rotate();
+      }
+
+      // camerad reused the buffer while it was waiting in the ring
+      if (job.buf->get_frame_id() != job.extra.frame_id) {
+        drop(job.extra.frame_id, "buffer overwritten");
+        continue;
+      }
+
+      if (encoder->encode_frame(job.buf, &job.extra) == -1) {
+        LOGE("Failed to encode frame. frame_id: %d", job.extra.frame_id);
+        continue;
+      }
+
+      // camerad reused the buffer while it was being read. The V4L encoder reads it asynchronously,
+      // so this only catches overwrites that landed before encode_frame returned.
+      if (job.buf->get_frame_id() != job.extra.frame_id) {
+        if (!std::exchange(overwritten, true)) {
+          LOGE("encoder %s: frame %d was overwritten while encoding", name, job.extra.frame_id);
+        }
+      } else {
+        overwritten = false;
+        if (dropping.exchange(false)) {
+          LOGW("encoder %s caught up, %d frames dropped in total", name, encoder->frames_dropped.load());
+        }
+      }
+    }
+  }
+
+  // only the first drop of a run is logged, sustained backpressure would flood the log at camera rate
+  void drop(uint32_t frame_id, const char *reason) {
+    uint32_t dropped = ++encoder->frames_dropped;
+    if (!dropping.exchange(true)) {
+      LOGE("encoder %s dropping frames from %d (%s), %d total", name, frame_id, reason, dropped);
+    }
+  }
+
+  const char *name;
+  std::unique_ptr<Encoder> encoder;
+  std::thread thread;
+
+  std::mutex lock;
+  std::condition_variable cv;
+  EncoderJob ring[ENCODER_QUEUE_SIZE];
+  int head = 0, count = 0;
+  bool pending_rotate = false;
+  bool exit = false;
+  // worker thread only
+  bool overwritten = false;
+  // set from both the camera and the worker thread
+  std::atomic<bool> dropping = false;
+};
+
 void encoder_thread(EncoderdState *s, const LogCameraInfo &cam_info) {
   util::set_thread_name(cam_info.thread_name);
 
-  std::vector<std::unique_ptr<Encoder>> encoders;
   VisionIpcClient vipc_client = VisionIpcClient("camerad", cam_info.stream_type, false);
+  // declared after vipc_client so the workers are stopped and joined before it unmaps the buffers they read
+  std::vector<std::unique_ptr<EncoderWorker>> workers;
 
   int cur_seg = 0;
   while (!do_exit) {
@@ -58,14 +178,13 @@ void encoder_thread(EncoderdState *s, const LogCameraInfo &cam_info) {
     }
 
     // init encoders
-    if (encoders.empty()) {
+    if (workers.empty()) {
       const VisionBuf &buf_info = vipc_client.buffers[0];
       LOGW("encoder %s init %zux%zu", cam_info.thread_name, buf_info.width, buf_info.height);
       assert(buf_info.width > 0 && buf_info.height > 0);
 
       for (const auto &encoder_info : cam_info.encoder_infos) {
-        auto &e = encoders.emplace_back(new Encoder(encoder_info, buf_info.width, buf_info.height));
-        e->encoder_open(nullptr);
+        workers.emplace_back(new EncoderWorker(encoder_info, buf_info.width, buf_info.height));
       }
     }
 
@@ -90,23 +209,17 @@ void encoder_thread(EncoderdState *s, const LogCameraInfo &cam_info) {
       }
       if (do_exit) break;
 
-      // do rotation if required
+      // do rotation if required, the workers rotate right before encoding this frame
       const int frames_per_seg = SEGMENT_LENGTH * MAIN_FPS;
+      bool rotate = false;
       if (cur_seg >= 0 && extra.frame_id >= ((cur_seg + 1) * frames_per_seg) + s->start_frame_id) {
-        for (auto &e : encoders) {
-          e->encoder_close();
-          e->encoder_open(NULL);
-        }
+        rotate = true;
         ++cur_seg;
       }
 
-      // encode a frame
-      for (int i = 0; i < encoders.size(); ++i) {
-        int out_id = encoders[i]->encode_frame(buf, &extra);
-
-        if (out_id == -1) {
-          LOGE("Failed to encode frame. frame_id: %d", extra.frame_id);
-        }
+      // hand the frame to every encoder
+      for (auto &w : workers) {
+        w->push(buf, extra, rotate);
       }
     }
   }
@@ -114,9 +114,11 @@ int handle_encoder_msg(LoggerdState *s, Message *msg, std::string &name, struct
         // if we aren't actually recording, don't create the writer
         if (encoder_info.record) {
           assert(encoder_info.filename != NULL);
+          // preallocate a bit more than a segment at the target bitrate
+          size_t prealloc_size = (size_t)encoder_info.bitrate / 8 * SEGMENT_LENGTH * 1.1;
           re.writer.reset(new VideoWriter(s->logger.segmentPath().c_str(),
             encoder_info.filename, idx.getType() != cereal::EncodeIndex::Type::FULL_H_E_V_C,
-            edata.getWidth(), edata.getHeight(), encoder_info.fps, idx.getType()));
+            edata.getWidth(), edata.getHeight(), encoder_info.fps, idx.getType(), prealloc_size));
           // write the header
           auto header = edata.getHeader();
           re.writer->write((uint8_t *)header.begin(), header.size(), idx.getTimestampEof()/1000, true, false);
@@ -29,6 +29,16 @@ const int SEGMENT_LENGTH = LOGGERD_TEST ? atoi(getenv("LOGGERD_SEGMENT_LENGTH"))
 
 constexpr char PRESERVE_ATTR_NAME[] = "user.preserve";
 constexpr char PRESERVE_ATTR_VALUE = '1';
+
+// FfmpegEncoder settings, only used on PC. The livestreams are realtime, lossless would be too big
+// to stream, and the logged cameras are lossless. FFMPEG_PROFILE overrides it for every encoder
+enum class FfmpegProfile {
+  LOSSLESS,       // ffvhuff, single threaded
+  FAST_LOSSLESS,  // ffvhuff with frame threads and the cheapest predictor
+  REALTIME,       // libx265/libx264 at the encoder bitrate, zerolatency with slice threads
+  NEAR_LOSSLESS,  // libx265/libx264 at crf 18 with frame threads
+};
+
 class EncoderInfo {
 public:
   const char *publish_name;
@@ -41,6 +51,7 @@ public:
   int bitrate = MAIN_BITRATE;
   cereal::EncodeIndex::Type encode_type = Hardware::PC() ? cereal::EncodeIndex::Type::BIG_BOX_LOSSLESS
                                                          : cereal::EncodeIndex::Type::FULL_H_E_V_C;
+  FfmpegProfile ffmpeg_profile = FfmpegProfile::LOSSLESS;
   ::cereal::EncodeData::Reader (cereal::Event::Reader::*get_encode_data_func)() const;
   void (cereal::Event::Builder::*set_encode_idx_func)(::cereal::EncodeIndex::Reader);
   cereal::EncodeData::Builder (cereal::Event::Builder::*init_encode_data_func)();
@@ -79,6 +90,7 @@ const EncoderInfo stream_road_encoder_info = {
   .encode_type = cereal::EncodeIndex::Type::QCAMERA_H264,
   .record = false,
   .bitrate = LIVESTREAM_BITRATE,
+  .ffmpeg_profile = FfmpegProfile::REALTIME,
   INIT_ENCODE_FUNCTIONS(LivestreamRoadEncode),
 };
 
@@ -87,6 +99,7 @@ const EncoderInfo stream_wide_road_encoder_info = {
   .encode_type = cereal::EncodeIndex::Type::QCAMERA_H264,
   .record = false,
   .bitrate = LIVESTREAM_BITRATE,
+  .ffmpeg_profile = FfmpegProfile::REALTIME,
   INIT_ENCODE_FUNCTIONS(LivestreamWideRoadEncode),
 };
 
@@ -95,6 +108,7 @@ const EncoderInfo stream_driver_encoder_info = {
   .encode_type = cereal::EncodeIndex::Type::QCAMERA_H264,
   .record = false,
   .bitrate = LIVESTREAM_BITRATE,
+  .ffmpeg_profile = FfmpegProfile::REALTIME,
   INIT_ENCODE_FUNCTIONS(LivestreamDriverEncode),
 };
 
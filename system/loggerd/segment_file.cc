@@ -0,0 +1,62 @@
+#include "system/loggerd/segment_file.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+
+#include "common/swaglog.h"
+#include "common/util.h"
+
+SegmentFile::SegmentFile(const std::string &path, size_t prealloc_size) : path(path) {
+  fd = HANDLE_EINTR(open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0664));
+  assert(fd >= 0);
+
+#ifdef __linux__
+  // keep the size so readers only see what's been written, the rest is trimmed on close
+  if (prealloc_size > 0 && fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, prealloc_size) != 0) {
+    LOGW("fallocate %zu bytes failed for %s: %s", prealloc_size, path.c_str(), strerror(errno));
+  }
+#endif
+
+  buf.resize(WRITE_BATCH_SIZE);
+}
+
+SegmentFile::~SegmentFile() {
+  flush();
+  // give back whatever was preallocated past the end
+  if (HANDLE_EINTR(ftruncate(fd, file_size)) != 0) {
+    LOGE("ftruncate failed for %s: %s", path.c_str(), strerror(errno));
+  }
+  close(fd);
+}
+
+void SegmentFile::write(const uint8_t *data, size_t len) {
+  while (len > 0) {
+    size_t n = std::min(len, buf.size() - buf_len);
+    memcpy(buf.data() + buf_len, data, n);
+    buf_len += n;
+    data += n;
+    len -= n;
+
+    // a full batch keeps the file offset page aligned
+    if (buf_len == buf.size()) flush();
+  }
+}
+
+void SegmentFile::flush() {
+  size_t done = 0;
+  while (done < buf_len) {
+    ssize_t ret = HANDLE_EINTR(::write(fd, buf.data() + done, buf_len - done));
+    if (ret < 0) {
+      LOGE("failed to write %s: errno=%d", path.c_str(), errno);
+      break;
+    }
+    done += ret;
+  }
+  file_size += done;
+  buf_len = 0;
+}
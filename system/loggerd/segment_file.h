@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// flash pages on the device are 4k, writes go out in whole batches of them
+constexpr size_t FLASH_PAGE_SIZE = 4096;
+constexpr size_t WRITE_BATCH_SIZE = 16 * FLASH_PAGE_SIZE;
+
+// A segment video file that's preallocated with fallocate and written in page aligned
+// batches, so ext4 can lay it out contiguously instead of growing it a packet at a time.
+class SegmentFile {
+public:
+  SegmentFile(const std::string &path, size_t prealloc_size);
+  ~SegmentFile();
+  void write(const uint8_t *data, size_t len);
+
+private:
+  void flush();
+
+  std::string path;
+  int fd = -1;
+  size_t file_size = 0;
+  std::vector<uint8_t> buf;
+  size_t buf_len = 0;
+};
@@ -0,0 +1,62 @@
+// microbenchmark for the qcamera NV12 -> downscaled I420 path in FfmpegEncoder
+// ./bench_yuv_scale [iterations]
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "common/timing.h"
+#include "system/loggerd/encoder/yuv_scale.h"
+#include "third_party/libyuv/include/libyuv.h"
+
+const int IN_WIDTH = 1928, IN_HEIGHT = 1208, STRIDE = 2048;
+const int OUT_WIDTH = 526, OUT_HEIGHT = 330;
+
+template <typename F>
+double bench(const char *name, int iterations, F f) {
+  f();  // warm up
+  double start = millis_since_boot();
+  for (int i = 0; i < iterations; i++) f();
+  double ms = (millis_since_boot() - start) / iterations;
+  printf("%-32s %8.3f ms/frame\n", name, ms);
+  return ms;
+}
+
+int main(int argc, char *argv[]) {
+  const int iterations = argc > 1 ? atoi(argv[1]) : 200;
+
+  std::vector<uint8_t> nv12(STRIDE * IN_HEIGHT * 3 / 2);
+  for (auto &b : nv12) b = rand();
+  const uint8_t *src_y = nv12.data();
+  const uint8_t *src_uv = src_y + STRIDE * IN_HEIGHT;
+
+  std::vector<uint8_t> convert_buf(IN_WIDTH * IN_HEIGHT * 3 / 2);
+  std::vector<uint8_t> out(OUT_WIDTH * OUT_HEIGHT * 3 / 2);
+  uint8_t *out_y = out.data();
+  uint8_t *out_u = out_y + OUT_WIDTH * OUT_HEIGHT;
+  uint8_t *out_v = out_u + (OUT_WIDTH / 2) * (OUT_HEIGHT / 2);
+
+  auto two_pass = [&](libyuv::FilterMode filter) {
+    uint8_t *cy = convert_buf.data();
+    uint8_t *cu = cy + IN_WIDTH * IN_HEIGHT;
+    uint8_t *cv = cu + (IN_WIDTH / 2) * (IN_HEIGHT / 2);
+    libyuv::NV12ToI420(src_y, STRIDE, src_uv, STRIDE,
+                       cy, IN_WIDTH, cu, IN_WIDTH/2, cv, IN_WIDTH/2,
+                       IN_WIDTH, IN_HEIGHT);
+    libyuv::I420Scale(cy, IN_WIDTH, cu, IN_WIDTH/2, cv, IN_WIDTH/2,
+                      IN_WIDTH, IN_HEIGHT,
+                      out_y, OUT_WIDTH, out_u, OUT_WIDTH/2, out_v, OUT_WIDTH/2,
+                      OUT_WIDTH, OUT_HEIGHT, filter);
+  };
+
+  Nv12Scaler point(IN_WIDTH, IN_HEIGHT, OUT_WIDTH, OUT_HEIGHT);
+  Nv12Scaler box(IN_WIDTH, IN_HEIGHT, OUT_WIDTH, OUT_HEIGHT, true);
+
+  printf("%dx%d NV12 -> %dx%d I420, %d iterations\n", IN_WIDTH, IN_HEIGHT, OUT_WIDTH, OUT_HEIGHT, iterations);
+  double base = bench("NV12ToI420 + I420Scale (none)", iterations, [&] { two_pass(libyuv::kFilterNone); });
+  double fused = bench("Nv12Scaler (none)", iterations, [&] { point.scale(src_y, src_uv, STRIDE, out_y, out_u, out_v); });
+  double base_box = bench("NV12ToI420 + I420Scale (box)", iterations, [&] { two_pass(libyuv::kFilterBox); });
+  double fused_box = bench("Nv12Scaler (box)", iterations, [&] { box.scale(src_y, src_uv, STRIDE, out_y, out_u, out_v); });
+  printf("speedup: %.2fx point, %.2fx box\n", base / fused, base_box / fused_box);
+  return 0;
+}
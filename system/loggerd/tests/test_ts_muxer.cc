@@ -0,0 +1,76 @@
+#include <map>
+#include <string>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "common/util.h"
+#include "system/loggerd/ts_muxer.h"
+
+static std::vector<uint8_t> fake_nal(int type, size_t len) {
+  std::vector<uint8_t> nal = {0, 0, 0, 1, (uint8_t)type};
+  for (size_t i = 0; i < len; i++) nal.push_back(0x10 + i % 0x70);
+  return nal;
+}
+
+TEST_CASE("TsMuxer") {
+  const std::string path = "/tmp/test_ts_muxer.ts";
+  const auto header = fake_nal(7, 20);  // SPS
+  std::vector<std::vector<uint8_t>> frames;
+  for (int i = 0; i < 10; i++) {
+    frames.push_back(fake_nal(i % 5 == 0 ? 5 : 1, 100 + i * 997));
+  }
+
+  {
+    SegmentFile file(path, 1 << 20);
+    TsMuxer muxer(&file);
+    muxer.set_header(header.data(), header.size());
+    for (int i = 0; i < frames.size(); i++) {
+      muxer.write_frame(frames[i].data(), frames[i].size(), 1000000 + i * 50000, i % 5 == 0);
+    }
+  }
+
+  std::string ts = util::read_file(path);
+  REQUIRE(ts.size() % TS_PACKET_SIZE == 0);
+
+  std::map<int, int> last_cc;
+  std::vector<std::vector<uint8_t>> payloads;
+  int pat_count = 0;
+  for (size_t off = 0; off < ts.size(); off += TS_PACKET_SIZE) {
+    const uint8_t *pkt = (const uint8_t *)ts.data() + off;
+    REQUIRE(pkt[0] == 0x47);
+    const int pid = ((pkt[1] & 0x1f) << 8) | pkt[2];
+    const bool unit_start = pkt[1] & 0x40;
+    const int cc = pkt[3] & 0xf;
+    if (last_cc.count(pid)) {
+      REQUIRE(cc == ((last_cc[pid] + 1) & 0xf));
+    }
+    last_cc[pid] = cc;
+
+    size_t start = 4;
+    if (pkt[3] & 0x20) start += 1 + pkt[4];
+    REQUIRE(start <= TS_PACKET_SIZE);
+
+    if (pid == 0) {
+      ++pat_count;
+    } else if (pid == 0x100) {
+      if (unit_start) payloads.emplace_back();
+      payloads.back().insert(payloads.back().end(), pkt + start, pkt + TS_PACKET_SIZE);
+    }
+  }
+
+  // tables in front of every keyframe
+  REQUIRE(pat_count == 2);
+  REQUIRE(payloads.size() == frames.size());
+  for (int i = 0; i < frames.size(); i++) {
+    const auto &pes = payloads[i];
+    REQUIRE((pes[0] == 0 && pes[1] == 0 && pes[2] == 1 && pes[3] == 0xe0));
+    std::vector<uint8_t> es(pes.begin() + 9 + pes[8], pes.end());
+
+    // AUD, then the SPS on keyframes, then the frame
+    std::vector<uint8_t> expected = {0, 0, 0, 1, 0x09, 0xf0};
+    if (i % 5 == 0) expected.insert(expected.end(), header.begin(), header.end());
+    expected.insert(expected.end(), frames[i].begin(), frames[i].end());
+    REQUIRE(es == expected);
+  }
+  unlink(path.c_str());
+}
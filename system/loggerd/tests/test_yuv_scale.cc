@@ -0,0 +1,62 @@
+#include <cstdlib>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "system/loggerd/encoder/yuv_scale.h"
+#include "third_party/libyuv/include/libyuv.h"
+
+// Nv12Scaler against the NV12ToI420 + I420Scale path it replaced in FfmpegEncoder.
+// Y goes through the same libyuv plane scaler, so it has to match exactly. UV is sampled
+// from the center of each box instead of libyuv's fixed point stepping, and box sums are
+// rounded instead of truncated, so on a smooth frame chroma may be off by a little.
+const int IN_WIDTH = 1928, IN_HEIGHT = 1208, STRIDE = 2048;
+const int OUT_WIDTH = 526, OUT_HEIGHT = 330;
+const int MAX_UV_DIFF_POINT = 4;
+const int MAX_UV_DIFF_BOX = 1;
+
+static int max_diff(const uint8_t *a, const uint8_t *b, int size) {
+  int diff = 0;
+  for (int i = 0; i < size; i++) {
+    diff = std::max(diff, std::abs(a[i] - b[i]));
+  }
+  return diff;
+}
+
+static void check(libyuv::FilterMode filter, int max_uv_diff) {
+  // gradients with a little noise, like a camera frame without hard edges
+  std::vector<uint8_t> nv12(STRIDE * IN_HEIGHT * 3 / 2);
+  for (int y = 0; y < IN_HEIGHT * 3 / 2; y++) {
+    for (int x = 0; x < STRIDE; x++) {
+      nv12[y * STRIDE + x] = x * 160 / STRIDE + y * 60 / IN_HEIGHT + rand() % 3;
+    }
+  }
+  const uint8_t *src_y = nv12.data();
+  const uint8_t *src_uv = src_y + STRIDE * IN_HEIGHT;
+
+  const int y_size = OUT_WIDTH * OUT_HEIGHT, uv_size = (OUT_WIDTH / 2) * (OUT_HEIGHT / 2);
+  std::vector<uint8_t> convert_buf(IN_WIDTH * IN_HEIGHT * 3 / 2);
+  std::vector<uint8_t> ref(y_size + 2 * uv_size), out(y_size + 2 * uv_size);
+
+  uint8_t *cy = convert_buf.data();
+  uint8_t *cu = cy + IN_WIDTH * IN_HEIGHT;
+  uint8_t *cv = cu + (IN_WIDTH / 2) * (IN_HEIGHT / 2);
+  libyuv::NV12ToI420(src_y, STRIDE, src_uv, STRIDE, cy, IN_WIDTH, cu, IN_WIDTH / 2, cv, IN_WIDTH / 2, IN_WIDTH, IN_HEIGHT);
+  libyuv::I420Scale(cy, IN_WIDTH, cu, IN_WIDTH / 2, cv, IN_WIDTH / 2, IN_WIDTH, IN_HEIGHT,
+                    &ref[0], OUT_WIDTH, &ref[y_size], OUT_WIDTH / 2, &ref[y_size + uv_size], OUT_WIDTH / 2,
+                    OUT_WIDTH, OUT_HEIGHT, filter);
+
+  Nv12Scaler scaler(IN_WIDTH, IN_HEIGHT, OUT_WIDTH, OUT_HEIGHT, filter == libyuv::kFilterBox);
+  scaler.scale(src_y, src_uv, STRIDE, &out[0], &out[y_size], &out[y_size + uv_size]);
+
+  REQUIRE(max_diff(&ref[0], &out[0], y_size) == 0);
+  REQUIRE(max_diff(&ref[y_size], &out[y_size], uv_size) <= max_uv_diff);
+  REQUIRE(max_diff(&ref[y_size + uv_size], &out[y_size + uv_size], uv_size) <= max_uv_diff);
+}
+
+TEST_CASE("Nv12Scaler point") {
+  check(libyuv::kFilterNone, MAX_UV_DIFF_POINT);
+}
+
+TEST_CASE("Nv12Scaler box") {
+  check(libyuv::kFilterBox, MAX_UV_DIFF_BOX);
+}
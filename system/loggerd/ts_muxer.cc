@@ -0,0 +1,174 @@
+#include "system/loggerd/ts_muxer.h"
+
+#include <algorithm>
+#include <cstring>
+
+// same PIDs as ffmpeg's mpegts muxer
+const uint16_t PAT_PID = 0x0000;
+const uint16_t PMT_PID = 0x1000;
+const uint16_t VIDEO_PID = 0x0100;
+const uint8_t STREAM_TYPE_H264 = 0x1b;
+
+// timestamps are in 90kHz and wrap at 33 bits. the PCR runs 0.7s behind the
+// PTS to give the decoder some buffer, like ffmpeg's default mux delay
+const uint64_t TS_MASK = (1ULL << 33) - 1;
+const uint64_t MUX_DELAY = 63000;
+
+static const uint8_t AUD_NAL[] = {0x00, 0x00, 0x00, 0x01, 0x09, 0xf0};
+
+static uint32_t crc32_mpeg(const uint8_t *data, size_t len) {
+  uint32_t crc = 0xffffffff;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= (uint32_t)data[i] << 24;
+    for (int b = 0; b < 8; b++) {
+      crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+// type of the first NAL in an annex b buffer
+static int first_nal_type(const uint8_t *data, size_t len) {
+  for (size_t i = 2; i < len; i++) {
+    if (data[i] == 1 && data[i - 1] == 0 && data[i - 2] == 0) {
+      return i + 1 < len ? data[i + 1] & 0x1f : -1;
+    }
+  }
+  return -1;
+}
+
+static bool has_nal_type(const uint8_t *data, size_t len, int type) {
+  for (size_t i = 2; i + 1 < len; i++) {
+    if (data[i] == 1 && data[i - 1] == 0 && data[i - 2] == 0 && (data[i + 1] & 0x1f) == type) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void TsMuxer::set_header(const uint8_t *data, size_t len) {
+  header.assign(data, data + len);
+}
+
+uint8_t *TsMuxer::start_packet(uint16_t pid, bool unit_start, bool has_adaptation) {
+  uint8_t &cc = continuity[pid == PAT_PID ? 0 : pid == PMT_PID ? 1 : 2];
+  pkt[0] = 0x47;
+  pkt[1] = (unit_start ? 0x40 : 0x00) | ((pid >> 8) & 0x1f);
+  pkt[2] = pid & 0xff;
+  pkt[3] = (has_adaptation ? 0x30 : 0x10) | cc;
+  cc = (cc + 1) & 0xf;
+  return pkt + 4;
+}
+
+void TsMuxer::write_section(uint16_t pid, const uint8_t *section, size_t len) {
+  uint8_t *p = start_packet(pid, true, false);
+  *p++ = 0;  // pointer field
+  memcpy(p, section, len);
+  uint32_t crc = crc32_mpeg(section, len);
+  p += len;
+  *p++ = crc >> 24;
+  *p++ = crc >> 16;
+  *p++ = crc >> 8;
+  *p++ = crc;
+  memset(p, 0xff, pkt + TS_PACKET_SIZE - p);
+  out->write(pkt, TS_PACKET_SIZE);
+}
+
+void TsMuxer::write_tables() {
+  const uint8_t pat[] = {
+    0x00, 0xb0, 13,             // table id, section length
+    0x00, 0x01, 0xc1, 0x00, 0x00,  // transport stream id, version, section numbers
+    0x00, 0x01, (uint8_t)(0xe0 | (PMT_PID >> 8)), (uint8_t)(PMT_PID & 0xff),
+  };
+  write_section(PAT_PID, pat, sizeof(pat));
+
+  const uint8_t pmt[] = {
+    0x02, 0xb0, 18,             // table id, section length
+    0x00, 0x01, 0xc1, 0x00, 0x00,  // program number, version, section numbers
+    (uint8_t)(0xe0 | (VIDEO_PID >> 8)), (uint8_t)(VIDEO_PID & 0xff),  // PCR PID
+    0xf0, 0x00,                 // no program info
+    STREAM_TYPE_H264, (uint8_t)(0xe0 | (VIDEO_PID >> 8)), (uint8_t)(VIDEO_PID & 0xff), 0xf0, 0x00,
+  };
+  write_section(PMT_PID, pmt, sizeof(pmt));
+}
+
+void TsMuxer::write_frame(const uint8_t *data, size_t len, uint64_t timestamp, bool keyframe) {
+  // repeat the tables in front of every keyframe so each GOP can be decoded on its own
+  if (keyframe) {
+    write_tables();
+  }
+
+  const uint64_t pts = (timestamp * 9 / 100 + MUX_DELAY) & TS_MASK;
+  const uint64_t pcr = ((pts - MUX_DELAY) & TS_MASK) * 300;
+
+  uint8_t pes_header[14] = {
+    0x00, 0x00, 0x01, 0xe0,  // video stream
+    0x00, 0x00,              // unbounded length
+    0x80, 0x80, 5,           // PTS only
+    (uint8_t)(0x21 | ((pts >> 29) & 0x0e)),
+    (uint8_t)(pts >> 22),
+    (uint8_t)(((pts >> 14) & 0xfe) | 1),
+    (uint8_t)(pts >> 7),
+    (uint8_t)(((pts << 1) & 0xfe) | 1),
+  };
+
+  // same as ffmpeg: every access unit starts with an AUD, and keyframes carry the SPS/PPS
+  Chunk chunks[4];
+  int n = 0;
+  chunks[n++] = {pes_header, sizeof(pes_header)};
+  if (first_nal_type(data, len) != 9) chunks[n++] = {AUD_NAL, sizeof(AUD_NAL)};
+  if (keyframe && !header.empty() && !has_nal_type(data, len, 7)) chunks[n++] = {header.data(), header.size()};
+  chunks[n++] = {data, len};
+
+  size_t remaining = 0;
+  for (int i = 0; i < n; i++) remaining += chunks[i].len;
+
+  int chunk = 0;
+  size_t chunk_offset = 0;
+  bool first = true;
+  while (remaining > 0) {
+    // the first packet carries the PCR, the last one is padded with adaptation field stuffing
+    size_t af_len = first ? 8 : 0;
+    size_t space = TS_PACKET_SIZE - 4 - af_len;
+    if (remaining < space) {
+      af_len += space - remaining;
+      space = remaining;
+    }
+
+    uint8_t *p = start_packet(VIDEO_PID, first, af_len > 0);
+    if (af_len > 0) {
+      uint8_t *af_end = p + af_len;
+      *p++ = af_len - 1;
+      if (af_len > 1) {
+        *p++ = first ? (0x10 | (keyframe ? 0x40 : 0)) : 0x00;  // PCR, random access
+        if (first) {
+          const uint64_t base = pcr / 300, ext = pcr % 300;
+          *p++ = base >> 25;
+          *p++ = base >> 17;
+          *p++ = base >> 9;
+          *p++ = base >> 1;
+          *p++ = ((base & 1) << 7) | 0x7e | (ext >> 8);
+          *p++ = ext;
+        }
+        memset(p, 0xff, af_end - p);
+        p = af_end;
+      }
+    }
+
+    size_t filled = 0;
+    while (filled < space) {
+      size_t copy = std::min(space - filled, chunks[chunk].len - chunk_offset);
+      memcpy(p + filled, chunks[chunk].data + chunk_offset, copy);
+      filled += copy;
+      chunk_offset += copy;
+      if (chunk_offset == chunks[chunk].len) {
+        ++chunk;
+        chunk_offset = 0;
+      }
+    }
+    out->write(pkt, TS_PACKET_SIZE);
+
+    remaining -= space;
+    first = false;
+  }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "system/loggerd/segment_file.h"
+
+constexpr int TS_PACKET_SIZE = 188;
+
+// Minimal MPEG-TS muxer for a single H264 stream, what qcamera.ts needs.
+// Writes straight into the SegmentFile without any per packet allocations.
+class TsMuxer {
+public:
+  TsMuxer(SegmentFile *out) : out(out) {}
+  // SPS/PPS, repeated in front of every keyframe that doesn't carry its own
+  void set_header(const uint8_t *data, size_t len);
+  // timestamp in microseconds
+  void write_frame(const uint8_t *data, size_t len, uint64_t timestamp, bool keyframe);
+
+private:
+  struct Chunk {
+    const uint8_t *data;
+    size_t len;
+  };
+
+  void write_tables();
+  void write_section(uint16_t pid, const uint8_t *section, size_t len);
+  uint8_t *start_packet(uint16_t pid, bool unit_start, bool has_adaptation);
+
+  SegmentFile *out;
+  std::vector<uint8_t> header;
+  uint8_t continuity[3] = {};
+  uint8_t pkt[TS_PACKET_SIZE];
+};
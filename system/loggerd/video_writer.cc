@@ -5,8 +5,9 @@
 #include "common/swaglog.h"
 #include "common/util.h"
 
-VideoWriter::VideoWriter(const char *path, const char *filename, bool remuxing, int width, int height, int fps, cereal::EncodeIndex::Type codec)
-  : remuxing(remuxing) {
+VideoWriter::VideoWriter(const char *path, const char *filename, bool remuxing, int width, int height, int fps,
+                         cereal::EncodeIndex::Type codec, size_t prealloc_size)
+  : remuxing(remuxing && codec == cereal::EncodeIndex::Type::BIG_BOX_LOSSLESS) {
   vid_path = util::string_format("%s/%s", path, filename);
   lock_path = util::string_format("%s/%s.lock", path, filename);
 
@@ -14,15 +15,12 @@ VideoWriter::VideoWriter(const char *path, const char *filename, bool remuxing,
   assert(lock_fd >= 0);
   close(lock_fd);
 
-  LOGD("encoder_open %s remuxing:%d", this->vid_path.c_str(), this->remuxing);
+  LOGD("encoder_open %s remuxing:%d", this->vid_path.c_str(), remuxing);
   if (this->remuxing) {
-    bool raw = (codec == cereal::EncodeIndex::Type::BIG_BOX_LOSSLESS);
-    avformat_alloc_output_context2(&this->ofmt_ctx, NULL, raw ? "matroska" : NULL, this->vid_path.c_str());
+    avformat_alloc_output_context2(&this->ofmt_ctx, NULL, "matroska", this->vid_path.c_str());
     assert(this->ofmt_ctx);
 
-    // set codec correctly. needed?
-    assert(codec != cereal::EncodeIndex::Type::FULL_H_E_V_C);
-    const AVCodec *avcodec = avcodec_find_encoder(raw ? AV_CODEC_ID_FFVHUFF : AV_CODEC_ID_H264);
+    const AVCodec *avcodec = avcodec_find_encoder(AV_CODEC_ID_FFVHUFF);
     assert(avcodec);
 
     this->codec_ctx = avcodec_alloc_context3(avcodec);
@@ -32,30 +30,34 @@ VideoWriter::VideoWriter(const char *path, const char *filename, bool remuxing,
     this->codec_ctx->pix_fmt = AV_PIX_FMT_YUV420P;
     this->codec_ctx->time_base = (AVRational){ 1, fps };
 
-    if (codec == cereal::EncodeIndex::Type::BIG_BOX_LOSSLESS) {
-      // without this, there's just noise
-      int err = avcodec_open2(this->codec_ctx, avcodec, NULL);
-      assert(err >= 0);
-    }
+    // without this, there's just noise
+    int err = avcodec_open2(this->codec_ctx, avcodec, NULL);
+    assert(err >= 0);
 
-    this->out_stream = avformat_new_stream(this->ofmt_ctx, raw ? avcodec : NULL);
+    this->out_stream = avformat_new_stream(this->ofmt_ctx, avcodec);
     assert(this->out_stream);
 
-    int err = avio_open(&this->ofmt_ctx->pb, this->vid_path.c_str(), AVIO_FLAG_WRITE);
+    err = avio_open(&this->ofmt_ctx->pb, this->vid_path.c_str(), AVIO_FLAG_WRITE);
     assert(err >= 0);
 
   } else {
-    this->of = util::safe_fopen(this->vid_path.c_str(), "wb");
-    assert(this->of);
+    file = std::make_unique<SegmentFile>(this->vid_path, prealloc_size);
+    if (remuxing) {
+      assert(codec != cereal::EncodeIndex::Type::FULL_H_E_V_C);
+      ts_muxer = std::make_unique<TsMuxer>(file.get());
+    }
   }
 }
 
 void VideoWriter::write(uint8_t *data, int len, long long timestamp, bool codecconfig, bool keyframe) {
-  if (of && data) {
-    size_t written = util::safe_fwrite(data, 1, len, of);
-    if (written != len) {
-      LOGE("failed to write file.errno=%d", errno);
+  if (ts_muxer) {
+    if (codecconfig) {
+      ts_muxer->set_header(data, len);
+    } else {
+      ts_muxer->write_frame(data, len, timestamp, keyframe);
     }
+  } else if (file && data) {
+    file->write(data, len);
   }
 
   if (remuxing) {
@@ -104,9 +106,8 @@ VideoWriter::~VideoWriter() {
     if (err != 0) LOGE("avio_closep failed %d", err);
     avformat_free_context(this->ofmt_ctx);
   } else {
-    util::safe_fflush(this->of);
-    fclose(this->of);
-    this->of = nullptr;
+    ts_muxer.reset();
+    file.reset();
   }
   unlink(this->lock_path.c_str());
 }
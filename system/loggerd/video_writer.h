@@ -1,5 +1,6 @@
 #pragma once
 
+#include <memory>
 #include <string>
 
 extern "C" {
@@ -8,16 +9,21 @@ extern "C" {
 }
 
 #include "cereal/messaging/messaging.h"
+#include "system/loggerd/segment_file.h"
+#include "system/loggerd/ts_muxer.h"
 
 class VideoWriter {
 public:
-  VideoWriter(const char *path, const char *filename, bool remuxing, int width, int height, int fps, cereal::EncodeIndex::Type codec);
+  VideoWriter(const char *path, const char *filename, bool remuxing, int width, int height, int fps,
+              cereal::EncodeIndex::Type codec, size_t prealloc_size = 0);
   void write(uint8_t *data, int len, long long timestamp, bool codecconfig, bool keyframe);
   ~VideoWriter();
 private:
   std::string vid_path, lock_path;
-  FILE *of = nullptr;
+  std::unique_ptr<SegmentFile> file;
+  std::unique_ptr<TsMuxer> ts_muxer;
 
+  // libavformat is only used for the lossless matroska files on PC
   AVCodecContext *codec_ctx;
   AVFormatContext *ofmt_ctx;
   AVStream *out_stream;
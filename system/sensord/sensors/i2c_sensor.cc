@@ -32,6 +32,10 @@ int I2CSensor::set_register(uint register_address, uint8_t data) {
   return bus->set_register(get_device_address(), register_address, data);
 }
 
+int I2CSensor::read_burst(uint register_address, uint8_t *buffer, uint16_t len) {
+  return bus->read_burst(get_device_address(), register_address, buffer, len);
+}
+
 int I2CSensor::init_gpio() {
   if (shared_gpio || gpio_nr == 0) {
     return 0;
@@ -229,6 +229,11 @@ bool LSM6DS3_Accel::get_event(MessageBuilder &msg, uint64_t ts) {
   int len = read_register(LSM6DS3_ACCEL_I2C_REG_OUTX_L_XL, buffer, sizeof(buffer));
   assert(len == sizeof(buffer));
 
+  build_event(msg, buffer, ts);
+  return true;
+}
+
+void LSM6DS3_Accel::build_event(MessageBuilder &msg, const uint8_t *buffer, uint64_t ts) {
   float scale = 9.81 * 2.0f / (1 << 15);
   float x = read_16_bit(buffer[0], buffer[1]) * scale;
   float y = read_16_bit(buffer[2], buffer[3]) * scale;
@@ -245,6 +250,4 @@ bool LSM6DS3_Accel::get_event(MessageBuilder &msg, uint64_t ts) {
   auto svec = event.initAcceleration();
   svec.setV(xyz);
   svec.setStatus(true);
-
-  return true;
 }
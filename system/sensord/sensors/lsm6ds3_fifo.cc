@@ -0,0 +1,178 @@
+#include "system/sensord/sensors/lsm6ds3_fifo.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "common/swaglog.h"
+
+LSM6DS3_Fifo::LSM6DS3_Fifo(I2CBus *bus, int gpio_nr, int samples) :
+  I2CSensor(bus, gpio_nr), accel(bus), gyro(bus), samples(samples) {
+  assert(samples > 0 && samples <= LSM6DS3_FIFO_MAX_SAMPLES);
+}
+
+int LSM6DS3_Fifo::reset_fifo() {
+  // bypass mode empties the FIFO
+  int ret = set_register(LSM6DS3_FIFO_I2C_REG_CTRL5, LSM6DS3_FIFO_MODE_BYPASS);
+  if (ret < 0) {
+    return ret;
+  }
+
+  last_ts = 0;
+  return set_register(LSM6DS3_FIFO_I2C_REG_CTRL5, LSM6DS3_FIFO_ODR_104HZ | LSM6DS3_FIFO_MODE_CONTINUOUS);
+}
+
+int LSM6DS3_Fifo::init() {
+  uint8_t value = 0;
+  const int threshold = samples * LSM6DS3_FIFO_SAMPLE_WORDS;
+
+  // chip ID, self tests, scale and data rate are the same as without the FIFO
+  int ret = accel.init();
+  if (ret < 0) {
+    goto fail;
+  }
+
+  ret = gyro.init();
+  if (ret < 0) {
+    goto fail;
+  }
+
+  ret = init_gpio();
+  if (ret < 0) {
+    goto fail;
+  }
+
+  // threshold in 16 bit words
+  ret = set_register(LSM6DS3_FIFO_I2C_REG_CTRL1, threshold & 0xFF);
+  if (ret < 0) {
+    goto fail;
+  }
+
+  ret = set_register(LSM6DS3_FIFO_I2C_REG_CTRL2, (threshold >> 8) & LSM6DS3_FIFO_DIFF_MASK_H);
+  if (ret < 0) {
+    goto fail;
+  }
+
+  // gyro and accel at the full data rate
+  ret = set_register(LSM6DS3_FIFO_I2C_REG_CTRL3, LSM6DS3_FIFO_DEC_GYRO_NONE | LSM6DS3_FIFO_DEC_XL_NONE);
+  if (ret < 0) {
+    goto fail;
+  }
+
+  ret = reset_fifo();
+  if (ret < 0) {
+    goto fail;
+  }
+
+  // replace the data ready interrupts on INT1 with the FIFO threshold
+  ret = read_register(LSM6DS3_FIFO_I2C_REG_INT1_CTRL, &value, 1);
+  if (ret < 0) {
+    goto fail;
+  }
+
+  value &= ~(LSM6DS3_ACCEL_INT1_DRDY_XL | LSM6DS3_GYRO_INT1_DRDY_G);
+  value |= LSM6DS3_FIFO_INT1_FTH;
+  ret = set_register(LSM6DS3_FIFO_I2C_REG_INT1_CTRL, value);
+
+fail:
+  return ret;
+}
+
+int LSM6DS3_Fifo::shutdown() {
+  int ret = 0;
+
+  // disable FIFO threshold interrupt on INT1
+  uint8_t value = 0;
+  ret = read_register(LSM6DS3_FIFO_I2C_REG_INT1_CTRL, &value, 1);
+  if (ret < 0) {
+    goto fail;
+  }
+
+  value &= ~(LSM6DS3_FIFO_INT1_FTH);
+  ret = set_register(LSM6DS3_FIFO_I2C_REG_INT1_CTRL, value);
+  if (ret < 0) {
+    LOGE("Could not disable lsm6ds3 FIFO interrupt!");
+    goto fail;
+  }
+
+  ret = set_register(LSM6DS3_FIFO_I2C_REG_CTRL5, LSM6DS3_FIFO_MODE_BYPASS);
+  if (ret < 0) {
+    goto fail;
+  }
+
+  ret = accel.shutdown();
+  if (ret < 0) {
+    goto fail;
+  }
+
+  ret = gyro.shutdown();
+
+fail:
+  return ret;
+}
+
+int LSM6DS3_Fifo::read_fifo(uint64_t ts, const PublishFunc &publish) {
+  // FIFO_STATUS1-4: unread words and the position in the pattern
+  uint8_t status[4];
+  int ret = read_register(LSM6DS3_FIFO_I2C_REG_STATUS1, status, sizeof(status));
+  if (ret < 0) {
+    return ret;
+  }
+
+  if (status[1] & LSM6DS3_FIFO_OVER_RUN) {
+    LOGE("lsm6ds3 FIFO overrun");
+    return reset_fifo();
+  }
+
+  const int words = status[0] | ((status[1] & LSM6DS3_FIFO_DIFF_MASK_H) << 8);
+  const int pattern = status[2] | ((status[3] & LSM6DS3_FIFO_PATTERN_MASK_H) << 8);
+  if (pattern != 0) {
+    LOGE("lsm6ds3 FIFO not at a sample boundary: %d", pattern);
+    return reset_fifo();
+  }
+
+  // All samples read on the last interrupt came in since then, so the interval between
+  // interrupts measures the sample period. The sensor's data rate is only accurate to a
+  // few percent, so it's tracked instead of assuming 104Hz.
+  if (last_ts != 0 && last_read > 0 && ts > last_ts) {
+    const double measured = double(ts - last_ts) / last_read;
+    if (std::abs(measured - LSM6DS3_FIFO_SAMPLE_NS) < 0.1 * LSM6DS3_FIFO_SAMPLE_NS) {
+      sample_ns += 0.1 * (measured - sample_ns);
+    }
+  }
+  last_ts = ts;
+
+  // The interrupt came with the threshold sample, the ones after it came in since.
+  // The address rolls back to FIFO_DATA_OUT_L after FIFO_DATA_OUT_H, so a burst reads consecutive words.
+  const int available = words / LSM6DS3_FIFO_SAMPLE_WORDS;
+  uint8_t buffer[LSM6DS3_FIFO_MAX_SAMPLES * LSM6DS3_FIFO_SAMPLE_BYTES];
+  int count = 0;
+  while (count < available) {
+    const int n = std::min(available - count, LSM6DS3_FIFO_MAX_SAMPLES);
+    ret = read_burst(LSM6DS3_FIFO_I2C_REG_DATA_OUT_L, buffer, n * LSM6DS3_FIFO_SAMPLE_BYTES);
+    if (ret < 0) {
+      // the interrupt stays high until the FIFO is under the threshold, start over
+      LOGE("lsm6ds3 FIFO read failed: %d", ret);
+      reset_fifo();
+      return ret;
+    }
+
+    for (int i = 0; i < n; i++, count++) {
+      const uint64_t sample_ts = ts + (int64_t)std::round((count - (samples - 1)) * sample_ns);
+      const uint8_t *sample = &buffer[i * LSM6DS3_FIFO_SAMPLE_BYTES];
+      {
+        MessageBuilder msg;
+        gyro.build_event(msg, &sample[0], sample_ts);
+        publish("gyroscope", msg);
+      }
+      {
+        MessageBuilder msg;
+        accel.build_event(msg, &sample[6], sample_ts);
+        publish("accelerometer", msg);
+      }
+    }
+  }
+
+  last_read = count;
+  return count;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "system/sensord/sensors/i2c_sensor.h"
+#include "system/sensord/sensors/lsm6ds3_accel.h"
+#include "system/sensord/sensors/lsm6ds3_gyro.h"
+
+// Address of the chip on the bus
+#define LSM6DS3_FIFO_I2C_ADDR       0x6A
+
+// Registers of the chip
+#define LSM6DS3_FIFO_I2C_REG_CTRL1        0x06
+#define LSM6DS3_FIFO_I2C_REG_CTRL2        0x07
+#define LSM6DS3_FIFO_I2C_REG_CTRL3        0x08
+#define LSM6DS3_FIFO_I2C_REG_CTRL5        0x0A
+#define LSM6DS3_FIFO_I2C_REG_INT1_CTRL    0x0D
+#define LSM6DS3_FIFO_I2C_REG_STATUS1      0x3A
+#define LSM6DS3_FIFO_I2C_REG_DATA_OUT_L   0x3E
+
+// Constants
+#define LSM6DS3_FIFO_DEC_GYRO_NONE    (0b001 << 3)
+#define LSM6DS3_FIFO_DEC_XL_NONE      0b001
+#define LSM6DS3_FIFO_ODR_104HZ        (0b0100 << 3)
+#define LSM6DS3_FIFO_MODE_BYPASS      0b000
+#define LSM6DS3_FIFO_MODE_CONTINUOUS  0b110
+#define LSM6DS3_FIFO_INT1_FTH         (1 << 3)
+#define LSM6DS3_FIFO_OVER_RUN         (1 << 6)
+#define LSM6DS3_FIFO_DIFF_MASK_H      0x0F
+#define LSM6DS3_FIFO_PATTERN_MASK_H   0x03
+// one sample is the gyro x, y, z followed by the accel x, y, z, 16 bit each
+#define LSM6DS3_FIFO_SAMPLE_WORDS     6
+#define LSM6DS3_FIFO_SAMPLE_BYTES     (LSM6DS3_FIFO_SAMPLE_WORDS * 2)
+#define LSM6DS3_FIFO_MAX_SAMPLES      32
+#define LSM6DS3_FIFO_SAMPLE_NS        (1e9 / 104.0)
+
+// Accel and gyro through the FIFO: the FIFO threshold interrupt fires every `samples`
+// samples, and they're read in one I2C transaction. The sample times are reconstructed
+// from the interrupt time and the sample period measured between interrupts.
+// The events are `samples` - 1 sample periods later than with the data ready interrupts.
+class LSM6DS3_Fifo : public I2CSensor {
+  uint8_t get_device_address() {return LSM6DS3_FIFO_I2C_ADDR;}
+
+  LSM6DS3_Accel accel;
+  LSM6DS3_Gyro gyro;
+  int samples;
+
+  uint64_t last_ts = 0;
+  int last_read = 0;
+  double sample_ns = LSM6DS3_FIFO_SAMPLE_NS;
+
+  int reset_fifo();
+public:
+  LSM6DS3_Fifo(I2CBus *bus, int gpio_nr, int samples);
+  int init();
+  bool get_event(MessageBuilder &msg, uint64_t ts = 0) { return false; }
+  int shutdown();
+
+  bool has_fifo() { return true; }
+  int read_fifo(uint64_t ts, const PublishFunc &publish);
+};
@@ -42,4 +42,6 @@ public:
   int init();
   bool get_event(MessageBuilder &msg, uint64_t ts = 0);
   int shutdown();
+  // builds the event from the 6 bytes of output registers
+  void build_event(MessageBuilder &msg, const uint8_t *buffer, uint64_t ts);
 };
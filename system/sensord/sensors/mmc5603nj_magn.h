@@ -34,4 +34,6 @@ public:
   int init();
   bool get_event(MessageBuilder &msg, uint64_t ts = 0);
   int shutdown();
+  // the SET and RESET measurements sleep for 20ms
+  bool has_blocking_read() { return true; }
 };
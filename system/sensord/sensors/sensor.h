@@ -1,5 +1,7 @@
 #pragma once
 
+#include <functional>
+
 #include "cereal/messaging/messaging.h"
 
 class Sensor {
@@ -15,6 +17,15 @@ public:
   virtual bool has_interrupt_enabled() = 0;
   virtual int shutdown() = 0;
 
+  // Sensors with a hardware FIFO read every queued sample on one interrupt at ts,
+  // and call publish with an event for each of them instead of using get_event.
+  typedef std::function<void(const char *service, MessageBuilder &msg)> PublishFunc;
+  virtual bool has_fifo() { return false; }
+  virtual int read_fifo(uint64_t ts, const PublishFunc &publish) { return -1; }
+
+  // Polled sensors whose get_event sleeps get a thread of their own, so they don't hold up the others
+  virtual bool has_blocking_read() { return false; }
+
   virtual bool is_data_valid(uint64_t current_ts) {
     if (start_ts == 0) {
       start_ts = current_ts;
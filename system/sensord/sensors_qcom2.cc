@@ -1,15 +1,22 @@
 #include <sys/resource.h>
 
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <random>
 #include <thread>
 #include <vector>
 #include <map>
+#include <set>
 #include <poll.h>
 #include <linux/gpio.h>
 
 #include "cereal/services.h"
 #include "cereal/messaging/messaging.h"
 #include "common/i2c.h"
+#include "common/i2c_sim.h"
 #include "common/ratekeeper.h"
 #include "common/swaglog.h"
 #include "common/timing.h"
@@ -20,6 +27,7 @@
 #include "system/sensord/sensors/bmx055_temp.h"
 #include "system/sensord/sensors/constants.h"
 #include "system/sensord/sensors/lsm6ds3_accel.h"
+#include "system/sensord/sensors/lsm6ds3_fifo.h"
 #include "system/sensord/sensors/lsm6ds3_gyro.h"
 #include "system/sensord/sensors/lsm6ds3_temp.h"
 #include "system/sensord/sensors/mmc5603nj_magn.h"
@@ -83,11 +91,33 @@ void interrupt_loop(std::vector<std::tuple<Sensor *, std::string>> sensors) {
     int num_events = err / sizeof(*evdata);
     uint64_t ts = evdata[num_events - 1].timestamp - cur_offset;
 
+    // The FIFO threshold interrupt stays high until the FIFO is read,
+    // the falling edge is from reading it and has no new samples.
+    uint64_t fifo_ts = 0;
+    for (int i = 0; i < num_events; i++) {
+      if (evdata[i].id == GPIOEVENT_EVENT_RISING_EDGE) {
+        fifo_ts = evdata[i].timestamp - cur_offset;
+      }
+    }
+
     for (auto &[sensor, msg_name] : sensors) {
       if (!sensor->has_interrupt_enabled()) {
         continue;
       }
 
+      if (sensor->has_fifo()) {
+        if (fifo_ts == 0) {
+          continue;
+        }
+        const bool valid = sensor->is_data_valid(fifo_ts);
+        sensor->read_fifo(fifo_ts, [&pm, valid](const char *service, MessageBuilder &msg) {
+          if (valid) {
+            pm.send(service, msg);
+          }
+        });
+        continue;
+      }
+
       MessageBuilder msg;
       if (!sensor->get_event(msg, ts)) {
         continue;
@@ -102,45 +132,98 @@ void interrupt_loop(std::vector<std::tuple<Sensor *, std::string>> sensors) {
   }
 }
 
-void polling_loop(Sensor *sensor, std::string msg_name) {
-  PubMaster pm({msg_name.c_str()});
-  RateKeeper rk(msg_name, services.at(msg_name).frequency);
+// Polled sensors share a thread, each one is read when it's due
+void polling_loop(std::vector<std::tuple<Sensor *, std::string>> sensors) {
+  struct PolledSensor {
+    Sensor *sensor;
+    std::string msg_name;
+    uint64_t interval;
+    uint64_t next;
+  };
+
+  std::vector<PolledSensor> polled;
+  std::set<std::string> msg_names;
+  for (auto &[sensor, msg_name] : sensors) {
+    polled.push_back({sensor, msg_name, uint64_t(1e9 / services.at(msg_name).frequency), nanos_since_boot()});
+    msg_names.insert(msg_name);
+  }
+
+  std::vector<const char *> pubs;
+  for (auto &msg_name : msg_names) {
+    pubs.push_back(msg_name.c_str());
+  }
+  PubMaster pm(pubs);
+
   while (!do_exit) {
+    auto due = std::min_element(polled.begin(), polled.end(), [](auto &a, auto &b) { return a.next < b.next; });
+    uint64_t now = nanos_since_boot();
+    if (due->next > now) {
+      std::this_thread::sleep_for(std::chrono::nanoseconds(due->next - now));
+    }
+
     MessageBuilder msg;
-    if (sensor->get_event(msg) && sensor->is_data_valid(nanos_since_boot())) {
-      pm.send(msg_name.c_str(), msg);
+    if (due->sensor->get_event(msg) && due->sensor->is_data_valid(nanos_since_boot())) {
+      pm.send(due->msg_name.c_str(), msg);
+    }
+
+    // keep the schedule like RateKeeper, unless it fell behind
+    now = nanos_since_boot();
+    due->next += due->interval;
+    if (due->next < now) {
+      due->next = now + due->interval;
     }
-    rk.keepTime();
   }
 }
 
-int sensor_loop(I2CBus *i2c_bus_imu) {
-  // Sensor init
-  std::vector<std::tuple<Sensor *, std::string>> sensors_init = {
+std::vector<std::tuple<Sensor *, std::string>> create_sensors(I2CBus *i2c_bus_imu, int lsm_gpio) {
+  std::vector<std::tuple<Sensor *, std::string>> sensors = {
     {new BMX055_Accel(i2c_bus_imu), "accelerometer2"},
     {new BMX055_Gyro(i2c_bus_imu), "gyroscope2"},
     {new BMX055_Magn(i2c_bus_imu), "magnetometer"},
     {new BMX055_Temp(i2c_bus_imu), "temperatureSensor2"},
+  };
 
-    {new LSM6DS3_Accel(i2c_bus_imu, GPIO_LSM_INT), "accelerometer"},
-    {new LSM6DS3_Gyro(i2c_bus_imu, GPIO_LSM_INT, true), "gyroscope"},
-    {new LSM6DS3_Temp(i2c_bus_imu), "temperatureSensor"},
+  // LSM_FIFO_SAMPLES=<n> reads the LSM6DS3 accel and gyro through the FIFO, n samples per interrupt
+  const int lsm_fifo_samples = util::getenv("LSM_FIFO_SAMPLES", 0);
+  if (lsm_fifo_samples > 0) {
+    // publishes both accelerometer and gyroscope
+    sensors.push_back({new LSM6DS3_Fifo(i2c_bus_imu, lsm_gpio, lsm_fifo_samples), "accelerometer"});
+  } else {
+    sensors.push_back({new LSM6DS3_Accel(i2c_bus_imu, lsm_gpio), "accelerometer"});
+    sensors.push_back({new LSM6DS3_Gyro(i2c_bus_imu, lsm_gpio, true), "gyroscope"});
+  }
+  sensors.push_back({new LSM6DS3_Temp(i2c_bus_imu), "temperatureSensor"});
 
-    {new MMC5603NJ_Magn(i2c_bus_imu), "magnetometer"},
-  };
+  sensors.push_back({new MMC5603NJ_Magn(i2c_bus_imu), "magnetometer"});
+  return sensors;
+}
+
+int sensor_loop(I2CBus *i2c_bus_imu) {
+  // Sensor init
+  std::vector<std::tuple<Sensor *, std::string>> sensors_init = create_sensors(i2c_bus_imu, GPIO_LSM_INT);
 
   // Initialize sensors
   std::vector<std::thread> threads;
+  std::vector<std::tuple<Sensor *, std::string>> polled_sensors;
   for (auto &[sensor, msg_name] : sensors_init) {
     int err = sensor->init();
     if (err < 0) {
       continue;
     }
 
-    if (!sensor->has_interrupt_enabled()) {
-      threads.emplace_back(polling_loop, sensor, msg_name);
+    if (sensor->has_interrupt_enabled()) {
+      continue;
+    }
+
+    if (sensor->has_blocking_read()) {
+      threads.emplace_back(polling_loop, std::vector<std::tuple<Sensor *, std::string>>{{sensor, msg_name}});
+    } else {
+      polled_sensors.push_back({sensor, msg_name});
     }
   }
+  if (!polled_sensors.empty()) {
+    threads.emplace_back(polling_loop, polled_sensors);
+  }
 
   // increase interrupt quality by pinning interrupt and process to core 1
   setpriority(PRIO_PROCESS, 0, -18);
@@ -168,9 +251,119 @@ int sensor_loop(I2CBus *i2c_bus_imu) {
   return 0;
 }
 
+// LSM6DS3 and MMC5603NJ at rest, with noise
+void sim_sensors(I2CSimBus *bus) {
+  std::mt19937 rng(0);
+  std::normal_distribution<float> noise(0, 20);
+  auto le16 = [](int v) { return std::vector<uint8_t>{uint8_t(v & 0xFF), uint8_t((v >> 8) & 0xFF)}; };
+
+  bus->set_registers(LSM6DS3_ACCEL_I2C_ADDR, LSM6DS3_ACCEL_I2C_REG_ID, {LSM6DS3_ACCEL_CHIP_ID});
+  bus->set_registers(LSM6DS3_ACCEL_I2C_ADDR, LSM6DS3_ACCEL_I2C_REG_STAT_REG, {LSM6DS3_ACCEL_DRDY_XLDA | LSM6DS3_GYRO_DRDY_GDA});
+  const int fifo_words = util::getenv("LSM_FIFO_SAMPLES", 0) * LSM6DS3_FIFO_SAMPLE_WORDS;
+  bus->set_registers(LSM6DS3_ACCEL_I2C_ADDR, LSM6DS3_FIFO_I2C_REG_STATUS1, {uint8_t(fifo_words & 0xFF), uint8_t(fifo_words >> 8), 0, 0});
+  for (int i = 0; i < 1000; i++) {
+    std::vector<uint8_t> gyro, accel;
+    for (int axis = 0; axis < 3; axis++) {
+      auto g = le16(noise(rng));
+      auto a = le16((axis == 2 ? 16384 : 0) + noise(rng));  // 1g at +-2g full scale
+      gyro.insert(gyro.end(), g.begin(), g.end());
+      accel.insert(accel.end(), a.begin(), a.end());
+    }
+    bus->add_sample(LSM6DS3_ACCEL_I2C_ADDR, LSM6DS3_GYRO_I2C_REG_OUTX_L_G, gyro);
+    bus->add_sample(LSM6DS3_ACCEL_I2C_ADDR, LSM6DS3_ACCEL_I2C_REG_OUTX_L_XL, accel);
+    bus->add_sample(LSM6DS3_ACCEL_I2C_ADDR, LSM6DS3_FIFO_I2C_REG_DATA_OUT_L, gyro);
+    bus->add_sample(LSM6DS3_ACCEL_I2C_ADDR, LSM6DS3_FIFO_I2C_REG_DATA_OUT_L, accel);
+  }
+
+  bus->set_registers(MMC5603NJ_I2C_ADDR, MMC5603NJ_I2C_REG_ID, {MMC5603NJ_CHIP_ID});
+  // 20 bit readings around the zero field offset
+  bus->set_registers(MMC5603NJ_I2C_ADDR, MMC5603NJ_I2C_REG_XOUT0, {0x80, 0x40, 0x80, 0x20, 0x7f, 0xc0, 0, 0, 0});
+}
+
+// Runs the drivers on a simulated bus, and measures how long every sample takes to read and
+// serialize. The spread of the per sample time is the jitter the drivers add to the interrupt path.
+// sensord --bench [--replay <file>] [--iterations <n>] [--latency-us <us per transaction>] [--error-rate <p>]
+int sensor_bench(int argc, char *argv[]) {
+  const char *replay = nullptr;
+  int iterations = 200;
+  double latency_us = 0, error_rate = 0;
+  for (int i = 0; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--replay") == 0) {
+      replay = argv[i + 1];
+    } else if (strcmp(argv[i], "--iterations") == 0) {
+      iterations = atoi(argv[i + 1]);
+    } else if (strcmp(argv[i], "--latency-us") == 0) {
+      latency_us = atof(argv[i + 1]);
+    } else if (strcmp(argv[i], "--error-rate") == 0) {
+      error_rate = atof(argv[i + 1]);
+    }
+  }
+
+  I2CSimBus bus(latency_us * 1e3, error_rate);
+  if (replay) {
+    if (!bus.load(replay)) return 1;
+  } else {
+    sim_sensors(&bus);
+  }
+
+  // the interrupt sensors are read the same way as the polled ones
+  auto sensors = create_sensors(&bus, 0);
+  for (auto &[sensor, msg_name] : sensors) {
+    if (sensor->init() < 0) {
+      continue;
+    }
+
+    std::vector<double> sample_us;
+    const uint64_t transactions = bus.transactions, bytes = bus.bytes_transferred;
+    for (int i = 0; i < iterations; i++) {
+      const uint64_t start = nanos_since_boot();
+      int n = 0;
+      if (sensor->has_fifo()) {
+        n = std::max(0, sensor->read_fifo(start, [](const char *service, MessageBuilder &msg) { msg.toBytes(); }));
+      } else {
+        MessageBuilder msg;
+        if (sensor->get_event(msg, start)) {
+          msg.toBytes();
+          n = 1;
+        }
+      }
+      const double us = (nanos_since_boot() - start) / 1e3;
+      for (int j = 0; j < n; j++) {
+        sample_us.push_back(us / n);
+      }
+    }
+    if (sample_us.empty()) {
+      printf("%-20s no samples\n", msg_name.c_str());
+      continue;
+    }
+
+    std::sort(sample_us.begin(), sample_us.end());
+    const double mean = std::accumulate(sample_us.begin(), sample_us.end(), 0.0) / sample_us.size();
+    double var = 0;
+    for (double us : sample_us) {
+      var += (us - mean) * (us - mean);
+    }
+    printf("%-20s %5zu samples, us per sample: mean %7.1f p50 %7.1f p99 %7.1f max %7.1f stddev %6.1f, per sample: %.1f transactions %.1f bytes\n",
+           sensor->has_fifo() ? "accel+gyro fifo" : msg_name.c_str(), sample_us.size(), mean, sample_us[sample_us.size() / 2],
+           sample_us[sample_us.size() * 99 / 100], sample_us.back(), std::sqrt(var / sample_us.size()),
+           double(bus.transactions - transactions) / sample_us.size(), double(bus.bytes_transferred - bytes) / sample_us.size());
+  }
+  printf("bus: %lu transactions, %lu bytes, %lu errors\n", bus.transactions, bus.bytes_transferred, bus.errors);
+
+  for (auto &[sensor, msg_name] : sensors) {
+    sensor->shutdown();
+    delete sensor;
+  }
+  return 0;
+}
+
 int main(int argc, char *argv[]) {
+  if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+    return sensor_bench(argc - 2, argv + 2);
+  }
+
   try {
-    auto i2c_bus_imu = std::make_unique<I2CBus>(I2C_BUS_IMU);
+    auto i2c_bus_imu = std::make_unique<I2CDevBus>(I2C_BUS_IMU);
     return sensor_loop(i2c_bus_imu.get());
   } catch (std::exception &e) {
     LOGE("I2CBus init failed");
@@ -0,0 +1,88 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "common/i2c_sim.h"
+#include "system/sensord/sensors/lsm6ds3_fifo.h"
+
+const int SAMPLES = 4;
+
+struct FifoEvents {
+  std::vector<uint64_t> gyro, accel;
+};
+
+// queues n samples in the FIFO
+static void fill_fifo(I2CSimBus &bus, int n) {
+  const int words = n * LSM6DS3_FIFO_SAMPLE_WORDS;
+  bus.set_registers(LSM6DS3_FIFO_I2C_ADDR, LSM6DS3_FIFO_I2C_REG_STATUS1, {uint8_t(words & 0xFF), uint8_t(words >> 8), 0, 0});
+}
+
+static int read_fifo(LSM6DS3_Fifo &fifo, uint64_t ts, FifoEvents &events) {
+  events = {};
+  return fifo.read_fifo(ts, [&events](const char *service, MessageBuilder &msg) {
+    auto event = msg.getRoot<cereal::Event>().asReader();
+    if (event.isGyroscope()) {
+      events.gyro.push_back(event.getGyroscope().getTimestamp());
+    } else {
+      events.accel.push_back(event.getAccelerometer().getTimestamp());
+    }
+  });
+}
+
+// the threshold sample came with the interrupt at ts, the others are a sample period apart
+static void check_timestamps(const FifoEvents &events, uint64_t ts, double sample_ns) {
+  REQUIRE(events.gyro == events.accel);
+  for (int i = 0; i < (int)events.gyro.size(); i++) {
+    const double expected = ts + (i - (SAMPLES - 1)) * sample_ns;
+    REQUIRE(std::abs(double(events.gyro[i]) - expected) <= 1.0);
+  }
+}
+
+TEST_CASE("LSM6DS3_Fifo reconstructs sample times from the interrupt") {
+  I2CSimBus bus;
+  for (int i = 0; i < SAMPLES; i++) {
+    bus.add_sample(LSM6DS3_FIFO_I2C_ADDR, LSM6DS3_FIFO_I2C_REG_DATA_OUT_L, std::vector<uint8_t>(LSM6DS3_FIFO_SAMPLE_BYTES, i));
+  }
+  LSM6DS3_Fifo fifo(&bus, 0, SAMPLES);
+  FifoEvents events;
+
+  // the first interrupt has nothing to measure the period against, it's the nominal 104Hz
+  const uint64_t ts0 = 1e9;
+  fill_fifo(bus, SAMPLES);
+  REQUIRE(read_fifo(fifo, ts0, events) == SAMPLES);
+  REQUIRE(events.gyro.size() == SAMPLES);
+  REQUIRE(events.gyro.back() == ts0);
+  check_timestamps(events, ts0, LSM6DS3_FIFO_SAMPLE_NS);
+
+  // the sensor runs 2% slow, the period moves a tenth of the way towards it
+  const double measured_ns = 1.02 * LSM6DS3_FIFO_SAMPLE_NS;
+  const uint64_t ts1 = ts0 + std::llround(SAMPLES * measured_ns);
+  const double sample_ns = LSM6DS3_FIFO_SAMPLE_NS + 0.1 * (double(ts1 - ts0) / SAMPLES - LSM6DS3_FIFO_SAMPLE_NS);
+  fill_fifo(bus, SAMPLES);
+  REQUIRE(read_fifo(fifo, ts1, events) == SAMPLES);
+  REQUIRE(events.gyro.back() == ts1);
+  check_timestamps(events, ts1, sample_ns);
+
+  SECTION("samples after the threshold one are later than the interrupt") {
+    const uint64_t ts2 = ts1 + std::llround(SAMPLES * sample_ns);
+    fill_fifo(bus, SAMPLES + 2);
+    REQUIRE(read_fifo(fifo, ts2, events) == SAMPLES + 2);
+    REQUIRE(events.gyro[SAMPLES - 1] == ts2);
+    REQUIRE(events.gyro.back() > ts2);
+    REQUIRE(std::is_sorted(events.gyro.begin(), events.gyro.end()));
+  }
+
+  SECTION("an interrupt far off the nominal rate doesn't change the period") {
+    const uint64_t ts2 = ts1 + std::llround(SAMPLES * 2 * LSM6DS3_FIFO_SAMPLE_NS);
+    fill_fifo(bus, SAMPLES);
+    REQUIRE(read_fifo(fifo, ts2, events) == SAMPLES);
+    check_timestamps(events, ts2, sample_ns);
+  }
+
+  SECTION("an overrun resets the FIFO and publishes nothing") {
+    bus.set_registers(LSM6DS3_FIFO_I2C_ADDR, LSM6DS3_FIFO_I2C_REG_STATUS1, {0, LSM6DS3_FIFO_OVER_RUN, 0, 0});
+    REQUIRE(read_fifo(fifo, ts1 + 1000000, events) == 0);
+    REQUIRE(events.gyro.empty());
+  }
+}
@@ -0,0 +1,189 @@
+// Decodes a synthetic receiver stream with the kaitai parser and with the views in ubx_view.h,
+// then runs it through UbloxMsgParser the way ubloxd does. Reports throughput and heap allocations.
+// ./bench_ubx [epochs]
+//
+// An epoch is what the receiver sends every 100ms: RXM-RAWX with 32 measurements, NAV-PVT,
+// NAV-SAT with 40 satellites and MON-HW.
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <kaitai/kaitaistream.h>
+
+#include "common/timing.h"
+#include "system/ubloxd/generated/ubx.h"
+#include "system/ubloxd/ublox_msg.h"
+
+static std::atomic<uint64_t> allocations = 0;
+
+void *operator new(size_t size) {
+  allocations++;
+  if (void *p = malloc(size)) return p;
+  throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+static std::string frame(uint16_t msg_type, const std::string &payload) {
+  std::string f = {(char)ublox::PREAMBLE1, (char)ublox::PREAMBLE2, (char)(msg_type >> 8), (char)(msg_type & 0xFF),
+                   (char)(payload.size() & 0xFF), (char)(payload.size() >> 8)};
+  return ublox::ubx_add_checksum(f + payload);
+}
+
+static std::string epoch(std::mt19937 &rng) {
+  std::uniform_int_distribution<int> byte(0, 255);
+  auto payload = [&](size_t size, size_t count_offset, int count, size_t item_size) {
+    std::string p(size + count * item_size, 0);
+    for (char &c : p) c = byte(rng);
+    if (item_size) p[count_offset] = count;
+    return p;
+  };
+  return frame(ublox::RXM_RAWX, payload(ublox::RxmRawx::SIZE, 11, 32, ublox::RxmRawx::MEAS_SIZE)) +
+         frame(ublox::NAV_PVT, payload(ublox::NavPvt::SIZE, 0, 0, 0)) +
+         frame(ublox::NAV_SAT, payload(ublox::NavSat::SIZE, 5, 40, ublox::NavSat::SV_SIZE)) +
+         frame(ublox::MON_HW, payload(ublox::MonHw::SIZE, 0, 0, 0));
+}
+
+// reads the fields UbloxMsgParser publishes, so neither parser is measured doing less.
+// The frame is copied, as the kaitai stream needed it to be in a std::string.
+static double decode_kaitai(std::string f) {
+  kaitai::kstream stream(f);
+  ubx_t msg(&stream);
+  double sum = 0;
+  switch (msg.msg_type()) {
+    case ublox::RXM_RAWX: {
+      auto rawx = static_cast<ubx_t::rxm_rawx_t *>(msg.body());
+      sum += rawx->rcv_tow() + rawx->week() + rawx->leap_s() + rawx->rec_stat();
+      for (auto meas : *rawx->meas()) {
+        sum += meas->sv_id() + meas->pr_mes() + meas->cp_mes() + meas->do_mes() + meas->gnss_id() + meas->freq_id() +
+               meas->lock_time() + meas->cno() + meas->pr_stdev() + meas->cp_stdev() + meas->do_stdev() + meas->trk_stat();
+      }
+      break;
+    }
+    case ublox::NAV_PVT: {
+      auto pvt = static_cast<ubx_t::nav_pvt_t *>(msg.body());
+      sum += pvt->flags() + pvt->lat() + pvt->lon() + pvt->height() + pvt->g_speed() + pvt->head_mot() + pvt->h_acc() +
+             pvt->num_sv() + pvt->year() + pvt->month() + pvt->day() + pvt->hour() + pvt->min() + pvt->sec() + pvt->nano() +
+             pvt->vel_n() + pvt->vel_e() + pvt->vel_d() + pvt->v_acc() + pvt->s_acc() + pvt->head_acc();
+      break;
+    }
+    case ublox::NAV_SAT: {
+      auto sat = static_cast<ubx_t::nav_sat_t *>(msg.body());
+      sum += sat->itow();
+      for (auto sv : *sat->svs()) {
+        sum += sv->sv_id() + sv->gnss_id() + sv->flags();
+      }
+      break;
+    }
+    case ublox::MON_HW: {
+      auto hw = static_cast<ubx_t::mon_hw_t *>(msg.body());
+      sum += hw->noise_per_ms() + hw->flags() + hw->agc_cnt() + hw->a_status() + hw->a_power() + hw->jam_ind();
+      break;
+    }
+  }
+  return sum;
+}
+
+static double decode_view(const std::string &f) {
+  const ublox::Frame frame = {(const uint8_t *)f.data()};
+  const uint8_t *payload = frame.payload();
+  double sum = 0;
+  switch (frame.msg_type()) {
+    case ublox::RXM_RAWX: {
+      if (!ublox::payload_valid<ublox::RxmRawx>(payload, frame.length())) break;
+      ublox::RxmRawx rawx = {payload};
+      sum += rawx.rcv_tow() + rawx.week() + rawx.leap_s() + rawx.rec_stat();
+      for (int i = 0; i < rawx.num_meas(); i++) {
+        auto meas = rawx.meas(i);
+        sum += meas.sv_id() + meas.pr_mes() + meas.cp_mes() + meas.do_mes() + meas.gnss_id() + meas.freq_id() +
+               meas.lock_time() + meas.cno() + meas.pr_stdev() + meas.cp_stdev() + meas.do_stdev() + meas.trk_stat();
+      }
+      break;
+    }
+    case ublox::NAV_PVT: {
+      if (!ublox::payload_valid<ublox::NavPvt>(payload, frame.length())) break;
+      ublox::NavPvt pvt = {payload};
+      sum += pvt.flags() + pvt.lat() + pvt.lon() + pvt.height() + pvt.g_speed() + pvt.head_mot() + pvt.h_acc() +
+             pvt.num_sv() + pvt.year() + pvt.month() + pvt.day() + pvt.hour() + pvt.min() + pvt.sec() + pvt.nano() +
+             pvt.vel_n() + pvt.vel_e() + pvt.vel_d() + pvt.v_acc() + pvt.s_acc() + pvt.head_acc();
+      break;
+    }
+    case ublox::NAV_SAT: {
+      if (!ublox::payload_valid<ublox::NavSat>(payload, frame.length())) break;
+      ublox::NavSat sat = {payload};
+      sum += sat.itow();
+      for (int i = 0; i < sat.num_svs(); i++) {
+        auto sv = sat.svs(i);
+        sum += sv.sv_id() + sv.gnss_id() + sv.flags();
+      }
+      break;
+    }
+    case ublox::MON_HW: {
+      if (!ublox::payload_valid<ublox::MonHw>(payload, frame.length())) break;
+      ublox::MonHw hw = {payload};
+      sum += hw.noise_per_ms() + hw.flags() + hw.agc_cnt() + hw.a_status() + hw.a_power() + hw.jam_ind();
+      break;
+    }
+  }
+  return sum;
+}
+
+template <class F>
+static void report(const char *name, size_t msgs, size_t bytes, F f) {
+  const uint64_t allocs = allocations;
+  const double start = millis_since_boot();
+  f();
+  const double ms = millis_since_boot() - start;
+  printf("%-28s %8.0f msgs/s %8.1f MB/s %6.1f allocations/msg\n", name, msgs / ms * 1e3, bytes / ms * 1e-3,
+         double(allocations - allocs) / msgs);
+}
+
+int main(int argc, char *argv[]) {
+  const int epochs = argc > 1 ? atoi(argv[1]) : 10000;
+
+  std::mt19937 rng(1234);
+  std::vector<std::string> frames;
+  std::string stream;
+  for (int i = 0; i < epochs; i++) {
+    stream += epoch(rng);
+  }
+  for (size_t pos = 0; pos < stream.size();) {
+    const size_t len = ublox::UBLOX_HEADER_SIZE + ublox::get<uint16_t>((const uint8_t *)stream.data() + pos, 4) + ublox::UBLOX_CHECKSUM_SIZE;
+    frames.push_back(stream.substr(pos, len));
+    pos += len;
+  }
+  printf("%d epochs, %zu messages, %zu bytes\n", epochs, frames.size(), stream.size());
+
+  volatile double sink = 0;
+  report("kaitai decode", frames.size(), stream.size(), [&]() {
+    for (const auto &f : frames) sink = sink + decode_kaitai(f);
+  });
+  report("view decode", frames.size(), stream.size(), [&]() {
+    for (const auto &f : frames) sink = sink + decode_view(f);
+  });
+
+  // framing, decoding and building the capnp events
+  UbloxMsgParser parser;
+  size_t published = 0, published_bytes = 0;
+  report("UbloxMsgParser", frames.size(), stream.size(), [&]() {
+    const uint8_t *data = (const uint8_t *)stream.data();
+    size_t bytes_consumed = 0;
+    while (bytes_consumed < stream.size()) {
+      size_t bytes_consumed_this_time = 0U;
+      if (parser.add_data(0, data + bytes_consumed, (uint32_t)(stream.size() - bytes_consumed), bytes_consumed_this_time)) {
+        auto ublox_msg = parser.gen_msg();
+        published += ublox_msg.second.size() > 0;
+        published_bytes += ublox_msg.second.asBytes().size();
+        parser.reset();
+      }
+      bytes_consumed += bytes_consumed_this_time;
+    }
+  });
+  printf("published %zu of %zu messages, %zu bytes\n", published, frames.size(), published_bytes);
+  return published == frames.size() ? 0 : 1;
+}
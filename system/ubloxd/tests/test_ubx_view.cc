@@ -0,0 +1,211 @@
+#include <random>
+#include <string>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "system/ubloxd/generated/ubx.h"
+#include "system/ubloxd/ubx_view.h"
+
+// Random messages of every type are decoded with both the views and the kaitai parser, which
+// is the reference. The frames have no checksum, kaitai only reads it on demand.
+
+static std::mt19937 rng(1234);
+
+static std::string random_bytes(size_t len) {
+  std::uniform_int_distribution<int> byte(0, 255);
+  std::string s(len, 0);
+  for (char &c : s) c = byte(rng);
+  return s;
+}
+
+// payload with a count byte at count_offset, and room for that many items
+static std::string random_payload(size_t size, size_t count_offset = 0, size_t item_size = 0, int max_count = 0) {
+  const int count = max_count ? std::uniform_int_distribution<int>(0, max_count)(rng) : 0;
+  std::string payload = random_bytes(size + count * item_size);
+  if (item_size) payload[count_offset] = count;
+  return payload;
+}
+
+static std::string frame(uint16_t msg_type, const std::string &payload) {
+  std::string f = {'\xb5', '\x62', (char)(msg_type >> 8), (char)(msg_type & 0xFF),
+                   (char)(payload.size() & 0xFF), (char)(payload.size() >> 8)};
+  return f + payload;
+}
+
+template <class Msg, class KaitaiMsg, class F>
+static void decode(std::string f, F compare) {
+  kaitai::kstream stream(f);
+  ubx_t ref(&stream);
+  const ublox::Frame view = {(const uint8_t *)f.data()};
+  REQUIRE(view.msg_type() == ref.msg_type());
+  REQUIRE(view.length() == ref.length());
+  REQUIRE(ublox::payload_valid<Msg>(view.payload(), view.length()));
+  compare(Msg{view.payload()}, static_cast<KaitaiMsg *>(ref.body()));
+}
+
+TEST_CASE("ubx_view_nav_pvt") {
+  for (int i = 0; i < 1000; i++) {
+    decode<ublox::NavPvt, ubx_t::nav_pvt_t>(frame(ublox::NAV_PVT, random_payload(ublox::NavPvt::SIZE)), [](auto msg, auto ref) {
+      REQUIRE(msg.i_tow() == ref->i_tow());
+      REQUIRE(msg.year() == ref->year());
+      REQUIRE(msg.month() == ref->month());
+      REQUIRE(msg.day() == ref->day());
+      REQUIRE(msg.hour() == ref->hour());
+      REQUIRE(msg.min() == ref->min());
+      REQUIRE(msg.sec() == ref->sec());
+      REQUIRE(msg.valid() == ref->valid());
+      REQUIRE(msg.t_acc() == ref->t_acc());
+      REQUIRE(msg.nano() == ref->nano());
+      REQUIRE(msg.fix_type() == ref->fix_type());
+      REQUIRE(msg.flags() == ref->flags());
+      REQUIRE(msg.flags2() == ref->flags2());
+      REQUIRE(msg.num_sv() == ref->num_sv());
+      REQUIRE(msg.lon() == ref->lon());
+      REQUIRE(msg.lat() == ref->lat());
+      REQUIRE(msg.height() == ref->height());
+      REQUIRE(msg.h_msl() == ref->h_msl());
+      REQUIRE(msg.h_acc() == ref->h_acc());
+      REQUIRE(msg.v_acc() == ref->v_acc());
+      REQUIRE(msg.vel_n() == ref->vel_n());
+      REQUIRE(msg.vel_e() == ref->vel_e());
+      REQUIRE(msg.vel_d() == ref->vel_d());
+      REQUIRE(msg.g_speed() == ref->g_speed());
+      REQUIRE(msg.head_mot() == ref->head_mot());
+      REQUIRE(msg.s_acc() == ref->s_acc());
+      REQUIRE(msg.head_acc() == ref->head_acc());
+      REQUIRE(msg.p_dop() == ref->p_dop());
+      REQUIRE(msg.flags3() == ref->flags3());
+      REQUIRE(msg.head_veh() == ref->head_veh());
+      REQUIRE(msg.mag_dec() == ref->mag_dec());
+      REQUIRE(msg.mag_acc() == ref->mag_acc());
+    });
+  }
+}
+
+TEST_CASE("ubx_view_rxm_sfrbx") {
+  for (int i = 0; i < 1000; i++) {
+    auto payload = random_payload(ublox::RxmSfrbx::SIZE, 4, ublox::RxmSfrbx::WORD_SIZE, 16);
+    decode<ublox::RxmSfrbx, ubx_t::rxm_sfrbx_t>(frame(ublox::RXM_SFRBX, payload), [](auto msg, auto ref) {
+      REQUIRE(msg.gnss_id() == ref->gnss_id());
+      REQUIRE(msg.sv_id() == ref->sv_id());
+      REQUIRE(msg.freq_id() == ref->freq_id());
+      REQUIRE(msg.num_words() == ref->num_words());
+      REQUIRE(msg.version() == ref->version());
+      for (int j = 0; j < msg.num_words(); j++) {
+        REQUIRE(msg.body(j) == ref->body()->at(j));
+      }
+    });
+  }
+}
+
+TEST_CASE("ubx_view_rxm_rawx") {
+  for (int i = 0; i < 1000; i++) {
+    auto payload = random_payload(ublox::RxmRawx::SIZE, 11, ublox::RxmRawx::MEAS_SIZE, 64);
+    decode<ublox::RxmRawx, ubx_t::rxm_rawx_t>(frame(ublox::RXM_RAWX, payload), [](auto msg, auto ref) {
+      // random bits may be NaNs, compare the bits
+      double rcv_tow = ref->rcv_tow();
+      REQUIRE(memcmp(msg.p, &rcv_tow, sizeof(rcv_tow)) == 0);
+      REQUIRE(msg.week() == ref->week());
+      REQUIRE(msg.leap_s() == ref->leap_s());
+      REQUIRE(msg.num_meas() == ref->num_meas());
+      REQUIRE(msg.rec_stat() == ref->rec_stat());
+      for (int j = 0; j < msg.num_meas(); j++) {
+        auto meas = msg.meas(j);
+        auto ref_meas = ref->meas()->at(j);
+        double pr_mes = ref_meas->pr_mes(), cp_mes = ref_meas->cp_mes();
+        float do_mes = ref_meas->do_mes();
+        REQUIRE(memcmp(meas.p, &pr_mes, sizeof(pr_mes)) == 0);
+        REQUIRE(memcmp(meas.p + 8, &cp_mes, sizeof(cp_mes)) == 0);
+        REQUIRE(memcmp(meas.p + 16, &do_mes, sizeof(do_mes)) == 0);
+        REQUIRE(meas.gnss_id() == ref_meas->gnss_id());
+        REQUIRE(meas.sv_id() == ref_meas->sv_id());
+        REQUIRE(meas.freq_id() == ref_meas->freq_id());
+        REQUIRE(meas.lock_time() == ref_meas->lock_time());
+        REQUIRE(meas.cno() == ref_meas->cno());
+        REQUIRE(meas.pr_stdev() == ref_meas->pr_stdev());
+        REQUIRE(meas.cp_stdev() == ref_meas->cp_stdev());
+        REQUIRE(meas.do_stdev() == ref_meas->do_stdev());
+        REQUIRE(meas.trk_stat() == ref_meas->trk_stat());
+      }
+    });
+  }
+}
+
+TEST_CASE("ubx_view_mon_hw") {
+  for (int i = 0; i < 1000; i++) {
+    decode<ublox::MonHw, ubx_t::mon_hw_t>(frame(ublox::MON_HW, random_payload(ublox::MonHw::SIZE)), [](auto msg, auto ref) {
+      REQUIRE(msg.noise_per_ms() == ref->noise_per_ms());
+      REQUIRE(msg.agc_cnt() == ref->agc_cnt());
+      REQUIRE(msg.a_status() == ref->a_status());
+      REQUIRE(msg.a_power() == ref->a_power());
+      REQUIRE(msg.flags() == ref->flags());
+      REQUIRE(msg.used_mask() == ref->used_mask());
+      REQUIRE(msg.jam_ind() == ref->jam_ind());
+    });
+  }
+}
+
+TEST_CASE("ubx_view_mon_hw2") {
+  for (int i = 0; i < 1000; i++) {
+    decode<ublox::MonHw2, ubx_t::mon_hw2_t>(frame(ublox::MON_HW2, random_payload(ublox::MonHw2::SIZE)), [](auto msg, auto ref) {
+      REQUIRE(msg.ofs_i() == ref->ofs_i());
+      REQUIRE(msg.mag_i() == ref->mag_i());
+      REQUIRE(msg.ofs_q() == ref->ofs_q());
+      REQUIRE(msg.mag_q() == ref->mag_q());
+      REQUIRE(msg.cfg_source() == ref->cfg_source());
+      REQUIRE(msg.low_lev_cfg() == ref->low_lev_cfg());
+      REQUIRE(msg.post_status() == ref->post_status());
+    });
+  }
+}
+
+TEST_CASE("ubx_view_nav_sat") {
+  for (int i = 0; i < 1000; i++) {
+    auto payload = random_payload(ublox::NavSat::SIZE, 5, ublox::NavSat::SV_SIZE, 64);
+    decode<ublox::NavSat, ubx_t::nav_sat_t>(frame(ublox::NAV_SAT, payload), [](auto msg, auto ref) {
+      REQUIRE(msg.itow() == ref->itow());
+      REQUIRE(msg.version() == ref->version());
+      REQUIRE(msg.num_svs() == ref->num_svs());
+      for (int j = 0; j < msg.num_svs(); j++) {
+        auto sv = msg.svs(j);
+        auto ref_sv = ref->svs()->at(j);
+        REQUIRE(sv.gnss_id() == ref_sv->gnss_id());
+        REQUIRE(sv.sv_id() == ref_sv->sv_id());
+        REQUIRE(sv.cno() == ref_sv->cno());
+        REQUIRE(sv.elev() == ref_sv->elev());
+        REQUIRE(sv.azim() == ref_sv->azim());
+        REQUIRE(sv.pr_res() == ref_sv->pr_res());
+        REQUIRE(sv.flags() == ref_sv->flags());
+      }
+    });
+  }
+}
+
+// Parses the body alone, ubx_t leaves its body pointer uninitialized and frees it when the body
+// throws. A payload is valid exactly when kaitai can read the whole message from it.
+template <class Msg, class KaitaiMsg>
+static void truncate(const std::string &payload) {
+  for (size_t len = 0; len <= payload.size(); len++) {
+    std::string truncated = payload.substr(0, len);
+    bool kaitai_ok = true;
+    try {
+      kaitai::kstream stream(truncated);
+      KaitaiMsg ref(&stream);
+    } catch (const std::exception &) {
+      kaitai_ok = false;
+    }
+    INFO("length " << len << " of " << payload.size());
+    REQUIRE(ublox::payload_valid<Msg>((const uint8_t *)truncated.data(), len) == kaitai_ok);
+  }
+}
+
+TEST_CASE("ubx_view_truncated") {
+  for (int i = 0; i < 10; i++) {
+    truncate<ublox::NavPvt, ubx_t::nav_pvt_t>(random_payload(ublox::NavPvt::SIZE));
+    truncate<ublox::RxmSfrbx, ubx_t::rxm_sfrbx_t>(random_payload(ublox::RxmSfrbx::SIZE, 4, ublox::RxmSfrbx::WORD_SIZE, 16));
+    truncate<ublox::RxmRawx, ubx_t::rxm_rawx_t>(random_payload(ublox::RxmRawx::SIZE, 11, ublox::RxmRawx::MEAS_SIZE, 64));
+    truncate<ublox::MonHw, ubx_t::mon_hw_t>(random_payload(ublox::MonHw::SIZE));
+    truncate<ublox::MonHw2, ubx_t::mon_hw2_t>(random_payload(ublox::MonHw2::SIZE));
+    truncate<ublox::NavSat, ubx_t::nav_sat_t>(random_payload(ublox::NavSat::SIZE, 5, ublox::NavSat::SV_SIZE, 64));
+  }
+}
@@ -96,73 +96,80 @@ bool UbloxMsgParser::add_data(float log_time, const uint8_t *incoming_data, uint
 
 
 std::pair<std::string, kj::Array<capnp::word>> UbloxMsgParser::gen_msg() {
-  std::string dat = data();
-  kaitai::kstream stream(dat);
-
-  ubx_t ubx_message(&stream);
-  auto body = ubx_message.body();
-
-  switch (ubx_message.msg_type()) {
-  case 0x0107:
-    return {"gpsLocationExternal", gen_nav_pvt(static_cast<ubx_t::nav_pvt_t*>(body))};
-  case 0x0213: // UBX-RXM-SFRB (Broadcast Navigation Data Subframe)
-    return {"ubloxGnss", gen_rxm_sfrbx(static_cast<ubx_t::rxm_sfrbx_t*>(body))};
-  case 0x0215: // UBX-RXM-RAW (Multi-GNSS Raw Measurement Data)
-    return {"ubloxGnss", gen_rxm_rawx(static_cast<ubx_t::rxm_rawx_t*>(body))};
-  case 0x0a09:
-    return {"ubloxGnss", gen_mon_hw(static_cast<ubx_t::mon_hw_t*>(body))};
-  case 0x0a0b:
-    return {"ubloxGnss", gen_mon_hw2(static_cast<ubx_t::mon_hw2_t*>(body))};
-  case 0x0135:
-    return {"ubloxGnss", gen_nav_sat(static_cast<ubx_t::nav_sat_t*>(body))};
+  // decoded in place, valid() has checked the frame length and checksum
+  const ublox::Frame frame = {msg_parse_buf};
+  const uint8_t *payload = frame.payload();
+  const size_t len = frame.length();
+
+  switch (frame.msg_type()) {
+  case ublox::NAV_PVT:
+    if (!ublox::payload_valid<ublox::NavPvt>(payload, len)) break;
+    return {"gpsLocationExternal", gen_nav_pvt({payload})};
+  case ublox::RXM_SFRBX: // UBX-RXM-SFRB (Broadcast Navigation Data Subframe)
+    if (!ublox::payload_valid<ublox::RxmSfrbx>(payload, len)) break;
+    return {"ubloxGnss", gen_rxm_sfrbx({payload})};
+  case ublox::RXM_RAWX: // UBX-RXM-RAW (Multi-GNSS Raw Measurement Data)
+    if (!ublox::payload_valid<ublox::RxmRawx>(payload, len)) break;
+    return {"ubloxGnss", gen_rxm_rawx({payload})};
+  case ublox::MON_HW:
+    if (!ublox::payload_valid<ublox::MonHw>(payload, len)) break;
+    return {"ubloxGnss", gen_mon_hw({payload})};
+  case ublox::MON_HW2:
+    if (!ublox::payload_valid<ublox::MonHw2>(payload, len)) break;
+    return {"ubloxGnss", gen_mon_hw2({payload})};
+  case ublox::NAV_SAT:
+    if (!ublox::payload_valid<ublox::NavSat>(payload, len)) break;
+    return {"ubloxGnss", gen_nav_sat({payload})};
   default:
-    LOGE("Unknown message type %x", ubx_message.msg_type());
+    LOGE("Unknown message type %x", frame.msg_type());
     return {"ubloxGnss", kj::Array<capnp::word>()};
   }
+
+  LOGE("Truncated message type %x, length %zu", frame.msg_type(), len);
+  return {"ubloxGnss", kj::Array<capnp::word>()};
 }
 
 
-kj::Array<capnp::word> UbloxMsgParser::gen_nav_pvt(ubx_t::nav_pvt_t *msg) {
+kj::Array<capnp::word> UbloxMsgParser::gen_nav_pvt(ublox::NavPvt msg) {
   MessageBuilder msg_builder;
   auto gpsLoc = msg_builder.initEvent().initGpsLocationExternal();
   gpsLoc.setSource(cereal::GpsLocationData::SensorSource::UBLOX);
-  gpsLoc.setFlags(msg->flags());
-  gpsLoc.setHasFix((msg->flags() % 2) == 1);
-  gpsLoc.setLatitude(msg->lat() * 1e-07);
-  gpsLoc.setLongitude(msg->lon() * 1e-07);
-  gpsLoc.setAltitude(msg->height() * 1e-03);
-  gpsLoc.setSpeed(msg->g_speed() * 1e-03);
-  gpsLoc.setBearingDeg(msg->head_mot() * 1e-5);
-  gpsLoc.setHorizontalAccuracy(msg->h_acc() * 1e-03);
-  gpsLoc.setSatelliteCount(msg->num_sv());
+  gpsLoc.setFlags(msg.flags());
+  gpsLoc.setHasFix((msg.flags() % 2) == 1);
+  gpsLoc.setLatitude(msg.lat() * 1e-07);
+  gpsLoc.setLongitude(msg.lon() * 1e-07);
+  gpsLoc.setAltitude(msg.height() * 1e-03);
+  gpsLoc.setSpeed(msg.g_speed() * 1e-03);
+  gpsLoc.setBearingDeg(msg.head_mot() * 1e-5);
+  gpsLoc.setHorizontalAccuracy(msg.h_acc() * 1e-03);
+  gpsLoc.setSatelliteCount(msg.num_sv());
   std::tm timeinfo = std::tm();
-  timeinfo.tm_year = msg->year() - 1900;
-  timeinfo.tm_mon = msg->month() - 1;
-  timeinfo.tm_mday = msg->day();
-  timeinfo.tm_hour = msg->hour();
-  timeinfo.tm_min = msg->min();
-  timeinfo.tm_sec = msg->sec();
+  timeinfo.tm_year = msg.year() - 1900;
+  timeinfo.tm_mon = msg.month() - 1;
+  timeinfo.tm_mday = msg.day();
+  timeinfo.tm_hour = msg.hour();
+  timeinfo.tm_min = msg.min();
+  timeinfo.tm_sec = msg.sec();
 
   std::time_t utc_tt = timegm(&timeinfo);
-  gpsLoc.setUnixTimestampMillis(utc_tt * 1e+03 + msg->nano() * 1e-06);
-  float f[] = { msg->vel_n() * 1e-03f, msg->vel_e() * 1e-03f, msg->vel_d() * 1e-03f };
+  gpsLoc.setUnixTimestampMillis(utc_tt * 1e+03 + msg.nano() * 1e-06);
+  float f[] = { msg.vel_n() * 1e-03f, msg.vel_e() * 1e-03f, msg.vel_d() * 1e-03f };
   gpsLoc.setVNED(f);
-  gpsLoc.setVerticalAccuracy(msg->v_acc() * 1e-03);
-  gpsLoc.setSpeedAccuracy(msg->s_acc() * 1e-03);
-  gpsLoc.setBearingAccuracyDeg(msg->head_acc() * 1e-05);
+  gpsLoc.setVerticalAccuracy(msg.v_acc() * 1e-03);
+  gpsLoc.setSpeedAccuracy(msg.s_acc() * 1e-03);
+  gpsLoc.setBearingAccuracyDeg(msg.head_acc() * 1e-05);
   return capnp::messageToFlatArray(msg_builder);
 }
 
-kj::Array<capnp::word> UbloxMsgParser::parse_gps_ephemeris(ubx_t::rxm_sfrbx_t *msg) {
+kj::Array<capnp::word> UbloxMsgParser::parse_gps_ephemeris(ublox::RxmSfrbx msg) {
   // GPS subframes are packed into 10x 4 bytes, each containing 3 actual bytes
   // We will first need to separate the data from the padding and parity
-  auto body = *msg->body();
-  assert(body.size() == 10);
+  assert(msg.num_words() == 10);
 
   std::string subframe_data;
   subframe_data.reserve(30);
-  for (uint32_t word : body) {
-    word = word >> 6; // TODO: Verify parity
+  for (int i = 0; i < msg.num_words(); i++) {
+    uint32_t word = msg.body(i) >> 6; // TODO: Verify parity
     subframe_data.push_back(word >> 16);
     subframe_data.push_back(word >> 8);
     subframe_data.push_back(word >> 0);
@@ -178,14 +185,14 @@ kj::Array<capnp::word> UbloxMsgParser::parse_gps_ephemeris(ubx_t::rxm_sfrbx_t *m
       // don't parse almanac subframes
       return kj::Array<capnp::word>();
     }
-    gps_subframes[msg->sv_id()][subframe_id] = subframe_data;
+    gps_subframes[msg.sv_id()][subframe_id] = subframe_data;
   }
 
   // publish if subframes 1-3 have been collected
-  if (gps_subframes[msg->sv_id()].size() == 3) {
+  if (gps_subframes[msg.sv_id()].size() == 3) {
     MessageBuilder msg_builder;
     auto eph = msg_builder.initEvent().initUbloxGnss().initEphemeris();
-    eph.setSvId(msg->sv_id());
+    eph.setSvId(msg.sv_id());
 
     int iode_s2 = 0;
     int iode_s3 = 0;
@@ -194,7 +201,7 @@ kj::Array<capnp::word> UbloxMsgParser::parse_gps_ephemeris(ubx_t::rxm_sfrbx_t *m
 
     // Subframe 1
     {
-      kaitai::kstream stream(gps_subframes[msg->sv_id()][1]);
+      kaitai::kstream stream(gps_subframes[msg.sv_id()][1]);
       gps_t subframe(&stream);
       gps_t::subframe_1_t* subframe_1 = static_cast<gps_t::subframe_1_t*>(subframe.body());
 
@@ -218,7 +225,7 @@ kj::Array<capnp::word> UbloxMsgParser::parse_gps_ephemeris(ubx_t::rxm_sfrbx_t *m
 
     // Subframe 2
     {
-      kaitai::kstream stream(gps_subframes[msg->sv_id()][2]);
+      kaitai::kstream stream(gps_subframes[msg.sv_id()][2]);
       gps_t subframe(&stream);
       gps_t::subframe_2_t* subframe_2 = static_cast<gps_t::subframe_2_t*>(subframe.body());
 
@@ -241,7 +248,7 @@ kj::Array<capnp::word> UbloxMsgParser::parse_gps_ephemeris(ubx_t::rxm_sfrbx_t *m
 
     // Subframe 3
     {
-      kaitai::kstream stream(gps_subframes[msg->sv_id()][3]);
+      kaitai::kstream stream(gps_subframes[msg.sv_id()][3]);
       gps_t subframe(&stream);
       gps_t::subframe_3_t* subframe_3 = static_cast<gps_t::subframe_3_t*>(subframe.body());
 
@@ -260,7 +267,7 @@ kj::Array<capnp::word> UbloxMsgParser::parse_gps_ephemeris(ubx_t::rxm_sfrbx_t *m
     eph.setToeWeek(week);
     eph.setTocWeek(week);
 
-    gps_subframes[msg->sv_id()].clear();
+    gps_subframes[msg.sv_id()].clear();
     if (iodc_lsb != iode_s2 || iodc_lsb != iode_s3) {
       // data set cutover, reject ephemeris
       return kj::Array<capnp::word>();
@@ -270,15 +277,15 @@ kj::Array<capnp::word> UbloxMsgParser::parse_gps_ephemeris(ubx_t::rxm_sfrbx_t *m
   return kj::Array<capnp::word>();
 }
 
-kj::Array<capnp::word> UbloxMsgParser::parse_glonass_ephemeris(ubx_t::rxm_sfrbx_t *msg) {
+kj::Array<capnp::word> UbloxMsgParser::parse_glonass_ephemeris(ublox::RxmSfrbx msg) {
   // This parser assumes that no 2 satellites of the same frequency
   // can be in view at the same time
-  auto body = *msg->body();
-  assert(body.size() == 4);
+  assert(msg.num_words() == 4);
   {
     std::string string_data;
     string_data.reserve(16);
-    for (uint32_t word : body) {
+    for (int w = 0; w < msg.num_words(); w++) {
+      uint32_t word = msg.body(w);
       for (int i = 3; i >= 0; i--)
         string_data.push_back(word >> 8*i);
     }
@@ -295,51 +302,51 @@ kj::Array<capnp::word> UbloxMsgParser::parse_glonass_ephemeris(ubx_t::rxm_sfrbx_
     bool superframe_unknown = false;
     bool needs_clear = false;
     for (int i = 1; i <= 5; i++) {
-      if (glonass_strings[msg->freq_id()].find(i) == glonass_strings[msg->freq_id()].end())
+      if (glonass_strings[msg.freq_id()].find(i) == glonass_strings[msg.freq_id()].end())
         continue;
-      if (glonass_string_superframes[msg->freq_id()][i] == 0 || gl_string.superframe_number() == 0) {
+      if (glonass_string_superframes[msg.freq_id()][i] == 0 || gl_string.superframe_number() == 0) {
         superframe_unknown = true;
-      } else if (glonass_string_superframes[msg->freq_id()][i] != gl_string.superframe_number()) {
+      } else if (glonass_string_superframes[msg.freq_id()][i] != gl_string.superframe_number()) {
         needs_clear = true;
       }
       // Check if string times add up to being from the same frame
       // If superframe is known this is redundant
       // Strings are sent 2s apart and frames are 30s apart
       if (superframe_unknown &&
-          std::abs((glonass_string_times[msg->freq_id()][i] - 2.0 * i) - (last_log_time - 2.0 * string_number)) > 10)
+          std::abs((glonass_string_times[msg.freq_id()][i] - 2.0 * i) - (last_log_time - 2.0 * string_number)) > 10)
         needs_clear = true;
     }
     if (needs_clear) {
-      glonass_strings[msg->freq_id()].clear();
-      glonass_string_superframes[msg->freq_id()].clear();
-      glonass_string_times[msg->freq_id()].clear();
+      glonass_strings[msg.freq_id()].clear();
+      glonass_string_superframes[msg.freq_id()].clear();
+      glonass_string_times[msg.freq_id()].clear();
     }
-    glonass_strings[msg->freq_id()][string_number] = string_data;
-    glonass_string_superframes[msg->freq_id()][string_number] = gl_string.superframe_number();
-    glonass_string_times[msg->freq_id()][string_number] = last_log_time;
+    glonass_strings[msg.freq_id()][string_number] = string_data;
+    glonass_string_superframes[msg.freq_id()][string_number] = gl_string.superframe_number();
+    glonass_string_times[msg.freq_id()][string_number] = last_log_time;
   }
-  if (msg->sv_id() == 255) {
+  if (msg.sv_id() == 255) {
     // data can be decoded before identifying the SV number, in this case 255
     // is returned, which means "unknown"  (ublox p32)
     return kj::Array<capnp::word>();
   }
 
   // publish if strings 1-5 have been collected
-  if (glonass_strings[msg->freq_id()].size() != 5) {
+  if (glonass_strings[msg.freq_id()].size() != 5) {
     return kj::Array<capnp::word>();
   }
 
   MessageBuilder msg_builder;
   auto eph = msg_builder.initEvent().initUbloxGnss().initGlonassEphemeris();
-  eph.setSvId(msg->sv_id());
-  eph.setFreqNum(msg->freq_id() - 7);
+  eph.setSvId(msg.sv_id());
+  eph.setFreqNum(msg.freq_id() - 7);
 
   uint16_t current_day = 0;
   uint16_t tk = 0;
 
   // string number 1
   {
-    kaitai::kstream stream(glonass_strings[msg->freq_id()][1]);
+    kaitai::kstream stream(glonass_strings[msg.freq_id()][1]);
     glonass_t gl_stream(&stream);
     glonass_t::string_1_t* data = static_cast<glonass_t::string_1_t*>(gl_stream.data());
 
@@ -353,7 +360,7 @@ kj::Array<capnp::word> UbloxMsgParser::parse_glonass_ephemeris(ubx_t::rxm_sfrbx_
 
   // string number 2
   {
-    kaitai::kstream stream(glonass_strings[msg->freq_id()][2]);
+    kaitai::kstream stream(glonass_strings[msg.freq_id()][2]);
     glonass_t gl_stream(&stream);
     glonass_t::string_2_t* data = static_cast<glonass_t::string_2_t*>(gl_stream.data());
 
@@ -367,7 +374,7 @@ kj::Array<capnp::word> UbloxMsgParser::parse_glonass_ephemeris(ubx_t::rxm_sfrbx_
 
   // string number 3
   {
-    kaitai::kstream stream(glonass_strings[msg->freq_id()][3]);
+    kaitai::kstream stream(glonass_strings[msg.freq_id()][3]);
     glonass_t gl_stream(&stream);
     glonass_t::string_3_t* data = static_cast<glonass_t::string_3_t*>(gl_stream.data());
 
@@ -381,7 +388,7 @@ kj::Array<capnp::word> UbloxMsgParser::parse_glonass_ephemeris(ubx_t::rxm_sfrbx_
 
   // string number 4
   {
-    kaitai::kstream stream(glonass_strings[msg->freq_id()][4]);
+    kaitai::kstream stream(glonass_strings[msg.freq_id()][4]);
     glonass_t gl_stream(&stream);
     glonass_t::string_4_t* data = static_cast<glonass_t::string_4_t*>(gl_stream.data());
 
@@ -392,15 +399,15 @@ kj::Array<capnp::word> UbloxMsgParser::parse_glonass_ephemeris(ubx_t::rxm_sfrbx_
     eph.setAge(data->e_n());
     eph.setP4(data->p4());
     eph.setSvURA(glonass_URA_lookup.at(data->f_t()));
-    if (msg->sv_id() != data->n()) {
-      LOGE("SV_ID != SLOT_NUMBER: %d %" PRIu64, msg->sv_id(), data->n());
+    if (msg.sv_id() != data->n()) {
+      LOGE("SV_ID != SLOT_NUMBER: %d %" PRIu64, msg.sv_id(), data->n());
     }
     eph.setSvType(data->m());
   }
 
   // string number 5
   {
-    kaitai::kstream stream(glonass_strings[msg->freq_id()][5]);
+    kaitai::kstream stream(glonass_strings[msg.freq_id()][5]);
     glonass_t gl_stream(&stream);
     glonass_t::string_5_t* data = static_cast<glonass_t::string_5_t*>(gl_stream.data());
 
@@ -411,107 +418,107 @@ kj::Array<capnp::word> UbloxMsgParser::parse_glonass_ephemeris(ubx_t::rxm_sfrbx_
     eph.setTkSeconds(tk_seconds);
   }
 
-  glonass_strings[msg->freq_id()].clear();
+  glonass_strings[msg.freq_id()].clear();
   return capnp::messageToFlatArray(msg_builder);
 }
 
 
-kj::Array<capnp::word> UbloxMsgParser::gen_rxm_sfrbx(ubx_t::rxm_sfrbx_t *msg) {
-  switch (msg->gnss_id()) {
-    case ubx_t::gnss_type_t::GNSS_TYPE_GPS:
+kj::Array<capnp::word> UbloxMsgParser::gen_rxm_sfrbx(ublox::RxmSfrbx msg) {
+  switch (msg.gnss_id()) {
+    case ublox::GNSS_GPS:
       return parse_gps_ephemeris(msg);
-    case ubx_t::gnss_type_t::GNSS_TYPE_GLONASS:
+    case ublox::GNSS_GLONASS:
       return parse_glonass_ephemeris(msg);
     default:
       return kj::Array<capnp::word>();
   }
 }
 
-kj::Array<capnp::word> UbloxMsgParser::gen_rxm_rawx(ubx_t::rxm_rawx_t *msg) {
+kj::Array<capnp::word> UbloxMsgParser::gen_rxm_rawx(ublox::RxmRawx msg) {
   MessageBuilder msg_builder;
   auto mr = msg_builder.initEvent().initUbloxGnss().initMeasurementReport();
-  mr.setRcvTow(msg->rcv_tow());
-  mr.setGpsWeek(msg->week());
-  mr.setLeapSeconds(msg->leap_s());
-  mr.setGpsWeek(msg->week());
-
-  auto mb = mr.initMeasurements(msg->num_meas());
-  auto measurements = *msg->meas();
-  for (int8_t i = 0; i < msg->num_meas(); i++) {
-    mb[i].setSvId(measurements[i]->sv_id());
-    mb[i].setPseudorange(measurements[i]->pr_mes());
-    mb[i].setCarrierCycles(measurements[i]->cp_mes());
-    mb[i].setDoppler(measurements[i]->do_mes());
-    mb[i].setGnssId(measurements[i]->gnss_id());
-    mb[i].setGlonassFrequencyIndex(measurements[i]->freq_id());
-    mb[i].setLocktime(measurements[i]->lock_time());
-    mb[i].setCno(measurements[i]->cno());
-    mb[i].setPseudorangeStdev(0.01 * (pow(2, (measurements[i]->pr_stdev() & 15)))); // weird scaling, might be wrong
-    mb[i].setCarrierPhaseStdev(0.004 * (measurements[i]->cp_stdev() & 15));
-    mb[i].setDopplerStdev(0.002 * (pow(2, (measurements[i]->do_stdev() & 15)))); // weird scaling, might be wrong
+  mr.setRcvTow(msg.rcv_tow());
+  mr.setGpsWeek(msg.week());
+  mr.setLeapSeconds(msg.leap_s());
+  mr.setGpsWeek(msg.week());
+
+  auto mb = mr.initMeasurements(msg.num_meas());
+  for (int i = 0; i < msg.num_meas(); i++) {
+    auto meas = msg.meas(i);
+    mb[i].setSvId(meas.sv_id());
+    mb[i].setPseudorange(meas.pr_mes());
+    mb[i].setCarrierCycles(meas.cp_mes());
+    mb[i].setDoppler(meas.do_mes());
+    mb[i].setGnssId(meas.gnss_id());
+    mb[i].setGlonassFrequencyIndex(meas.freq_id());
+    mb[i].setLocktime(meas.lock_time());
+    mb[i].setCno(meas.cno());
+    mb[i].setPseudorangeStdev(0.01 * (pow(2, (meas.pr_stdev() & 15)))); // weird scaling, might be wrong
+    mb[i].setCarrierPhaseStdev(0.004 * (meas.cp_stdev() & 15));
+    mb[i].setDopplerStdev(0.002 * (pow(2, (meas.do_stdev() & 15)))); // weird scaling, might be wrong
 
     auto ts = mb[i].initTrackingStatus();
-    auto trk_stat = measurements[i]->trk_stat();
+    auto trk_stat = meas.trk_stat();
     ts.setPseudorangeValid(bit_to_bool(trk_stat, 0));
     ts.setCarrierPhaseValid(bit_to_bool(trk_stat, 1));
     ts.setHalfCycleValid(bit_to_bool(trk_stat, 2));
     ts.setHalfCycleSubtracted(bit_to_bool(trk_stat, 3));
   }
 
-  mr.setNumMeas(msg->num_meas());
+  mr.setNumMeas(msg.num_meas());
   auto rs = mr.initReceiverStatus();
-  rs.setLeapSecValid(bit_to_bool(msg->rec_stat(), 0));
-  rs.setClkReset(bit_to_bool(msg->rec_stat(), 2));
+  rs.setLeapSecValid(bit_to_bool(msg.rec_stat(), 0));
+  rs.setClkReset(bit_to_bool(msg.rec_stat(), 2));
   return capnp::messageToFlatArray(msg_builder);
 }
 
-kj::Array<capnp::word> UbloxMsgParser::gen_nav_sat(ubx_t::nav_sat_t *msg) {
+kj::Array<capnp::word> UbloxMsgParser::gen_nav_sat(ublox::NavSat msg) {
   MessageBuilder msg_builder;
   auto sr = msg_builder.initEvent().initUbloxGnss().initSatReport();
-  sr.setITow(msg->itow());
-
-  auto svs = sr.initSvs(msg->num_svs());
-  auto svs_data = *msg->svs();
-  for (int8_t i = 0; i < msg->num_svs(); i++) {
-    svs[i].setSvId(svs_data[i]->sv_id());
-    svs[i].setGnssId(svs_data[i]->gnss_id());
-    svs[i].setFlagsBitfield(svs_data[i]->flags());
+  sr.setITow(msg.itow());
+
+  auto svs = sr.initSvs(msg.num_svs());
+  for (int i = 0; i < msg.num_svs(); i++) {
+    auto sv = msg.svs(i);
+    svs[i].setSvId(sv.sv_id());
+    svs[i].setGnssId(sv.gnss_id());
+    svs[i].setFlagsBitfield(sv.flags());
   }
 
   return capnp::messageToFlatArray(msg_builder);
 }
 
-kj::Array<capnp::word> UbloxMsgParser::gen_mon_hw(ubx_t::mon_hw_t *msg) {
+kj::Array<capnp::word> UbloxMsgParser::gen_mon_hw(ublox::MonHw msg) {
   MessageBuilder msg_builder;
   auto hwStatus = msg_builder.initEvent().initUbloxGnss().initHwStatus();
-  hwStatus.setNoisePerMS(msg->noise_per_ms());
-  hwStatus.setFlags(msg->flags());
-  hwStatus.setAgcCnt(msg->agc_cnt());
-  hwStatus.setAStatus((cereal::UbloxGnss::HwStatus::AntennaSupervisorState) msg->a_status());
-  hwStatus.setAPower((cereal::UbloxGnss::HwStatus::AntennaPowerStatus) msg->a_power());
-  hwStatus.setJamInd(msg->jam_ind());
+  hwStatus.setNoisePerMS(msg.noise_per_ms());
+  hwStatus.setFlags(msg.flags());
+  hwStatus.setAgcCnt(msg.agc_cnt());
+  hwStatus.setAStatus((cereal::UbloxGnss::HwStatus::AntennaSupervisorState) msg.a_status());
+  hwStatus.setAPower((cereal::UbloxGnss::HwStatus::AntennaPowerStatus) msg.a_power());
+  hwStatus.setJamInd(msg.jam_ind());
   return capnp::messageToFlatArray(msg_builder);
 }
 
-kj::Array<capnp::word> UbloxMsgParser::gen_mon_hw2(ubx_t::mon_hw2_t *msg) {
+kj::Array<capnp::word> UbloxMsgParser::gen_mon_hw2(ublox::MonHw2 msg) {
   MessageBuilder msg_builder;
   auto hwStatus = msg_builder.initEvent().initUbloxGnss().initHwStatus2();
-  hwStatus.setOfsI(msg->ofs_i());
-  hwStatus.setMagI(msg->mag_i());
-  hwStatus.setOfsQ(msg->ofs_q());
-  hwStatus.setMagQ(msg->mag_q());
+  hwStatus.setOfsI(msg.ofs_i());
+  hwStatus.setMagI(msg.mag_i());
+  hwStatus.setOfsQ(msg.ofs_q());
+  hwStatus.setMagQ(msg.mag_q());
 
-  switch (msg->cfg_source()) {
-    case ubx_t::mon_hw2_t::config_source_t::CONFIG_SOURCE_ROM:
+  switch (msg.cfg_source()) {
+    case ublox::MonHw2::CONFIG_SOURCE_ROM:
       hwStatus.setCfgSource(cereal::UbloxGnss::HwStatus2::ConfigSource::ROM);
       break;
-    case ubx_t::mon_hw2_t::config_source_t::CONFIG_SOURCE_OTP:
+    case ublox::MonHw2::CONFIG_SOURCE_OTP:
       hwStatus.setCfgSource(cereal::UbloxGnss::HwStatus2::ConfigSource::OTP);
       break;
-    case ubx_t::mon_hw2_t::config_source_t::CONFIG_SOURCE_CONFIG_PINS:
+    case ublox::MonHw2::CONFIG_SOURCE_CONFIG_PINS:
       hwStatus.setCfgSource(cereal::UbloxGnss::HwStatus2::ConfigSource::CONFIGPINS);
       break;
-    case ubx_t::mon_hw2_t::config_source_t::CONFIG_SOURCE_FLASH:
+    case ublox::MonHw2::CONFIG_SOURCE_FLASH:
       hwStatus.setCfgSource(cereal::UbloxGnss::HwStatus2::ConfigSource::FLASH);
       break;
     default:
@@ -519,8 +526,8 @@ kj::Array<capnp::word> UbloxMsgParser::gen_mon_hw2(ubx_t::mon_hw2_t *msg) {
       break;
   }
 
-  hwStatus.setLowLevCfg(msg->low_lev_cfg());
-  hwStatus.setPostStatus(msg->post_status());
+  hwStatus.setLowLevCfg(msg.low_lev_cfg());
+  hwStatus.setPostStatus(msg.post_status());
 
   return capnp::messageToFlatArray(msg_builder);
 }
@@ -12,7 +12,7 @@
 #include "common/util.h"
 #include "system/ubloxd/generated/gps.h"
 #include "system/ubloxd/generated/glonass.h"
-#include "system/ubloxd/generated/ubx.h"
+#include "system/ubloxd/ubx_view.h"
 
 using namespace std::string_literals;
 
@@ -98,20 +98,20 @@ class UbloxMsgParser {
     inline std::string data() {return std::string((const char*)msg_parse_buf, bytes_in_parse_buf);}
 
     std::pair<std::string, kj::Array<capnp::word>> gen_msg();
-    kj::Array<capnp::word> gen_nav_pvt(ubx_t::nav_pvt_t *msg);
-    kj::Array<capnp::word> gen_rxm_sfrbx(ubx_t::rxm_sfrbx_t *msg);
-    kj::Array<capnp::word> gen_rxm_rawx(ubx_t::rxm_rawx_t *msg);
-    kj::Array<capnp::word> gen_mon_hw(ubx_t::mon_hw_t *msg);
-    kj::Array<capnp::word> gen_mon_hw2(ubx_t::mon_hw2_t *msg);
-    kj::Array<capnp::word> gen_nav_sat(ubx_t::nav_sat_t *msg);
+    kj::Array<capnp::word> gen_nav_pvt(ublox::NavPvt msg);
+    kj::Array<capnp::word> gen_rxm_sfrbx(ublox::RxmSfrbx msg);
+    kj::Array<capnp::word> gen_rxm_rawx(ublox::RxmRawx msg);
+    kj::Array<capnp::word> gen_mon_hw(ublox::MonHw msg);
+    kj::Array<capnp::word> gen_mon_hw2(ublox::MonHw2 msg);
+    kj::Array<capnp::word> gen_nav_sat(ublox::NavSat msg);
 
   private:
     inline bool valid_cheksum();
     inline bool valid();
     inline bool valid_so_far();
 
-    kj::Array<capnp::word> parse_gps_ephemeris(ubx_t::rxm_sfrbx_t *msg);
-    kj::Array<capnp::word> parse_glonass_ephemeris(ubx_t::rxm_sfrbx_t *msg);
+    kj::Array<capnp::word> parse_gps_ephemeris(ublox::RxmSfrbx msg);
+    kj::Array<capnp::word> parse_glonass_ephemeris(ublox::RxmSfrbx msg);
 
     std::unordered_map<int, std::unordered_map<int, std::string>> gps_subframes;
 
@@ -1,6 +1,5 @@
 #include <cassert>
-
-#include <kaitai/kaitaistream.h>
+#include <cstdint>
 
 #include "cereal/messaging/messaging.h"
 #include "common/swaglog.h"
@@ -29,7 +28,14 @@ int main() {
       continue;
     }
 
-    capnp::FlatArrayMessageReader cmsg(aligned_buf.align(msg.get()));
+    // msgq buffers are word aligned, only copy the ones that aren't
+    kj::ArrayPtr<const capnp::word> words;
+    if ((uintptr_t)msg->getData() % sizeof(capnp::word) == 0) {
+      words = kj::ArrayPtr<const capnp::word>((const capnp::word *)msg->getData(), msg->getSize() / sizeof(capnp::word));
+    } else {
+      words = aligned_buf.align(msg.get());
+    }
+    capnp::FlatArrayMessageReader cmsg(words);
     cereal::Event::Reader event = cmsg.getRoot<cereal::Event>();
     auto ubloxRaw = event.getUbloxRaw();
     float log_time = 1e-9 * event.getLogMonoTime();
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Zero copy views of the UBX messages ubloxd publishes, laid out as in ubx.ksy.
+// A view only holds a pointer into the frame, the fields are decoded when they are read.
+// The views don't check lengths, use payload_valid before reading a payload.
+namespace ublox {
+  // payload fields are little endian and unaligned
+  template <class T>
+  inline T get(const uint8_t *p, size_t offset) {
+    T v;
+    memcpy(&v, p + offset, sizeof(T));
+    return v;
+  }
+
+  enum GnssType : uint8_t {
+    GNSS_GPS = 0,
+    GNSS_SBAS = 1,
+    GNSS_GALILEO = 2,
+    GNSS_BEIDOU = 3,
+    GNSS_IMES = 4,
+    GNSS_QZSS = 5,
+    GNSS_GLONASS = 6,
+  };
+
+  // message class and id, as in ubx_t::msg_type
+  enum MsgType : uint16_t {
+    NAV_PVT = 0x0107,
+    NAV_SAT = 0x0135,
+    RXM_SFRBX = 0x0213,
+    RXM_RAWX = 0x0215,
+    MON_HW = 0x0a09,
+    MON_HW2 = 0x0a0b,
+  };
+
+  struct Frame {
+    const uint8_t *p;
+    uint16_t msg_type() const { return (p[2] << 8) | p[3]; }
+    uint16_t length() const { return get<uint16_t>(p, 4); }
+    const uint8_t *payload() const { return p + 6; }
+  };
+
+  struct NavPvt {
+    static constexpr size_t SIZE = 92;
+    const uint8_t *p;
+    uint32_t i_tow() const { return get<uint32_t>(p, 0); }
+    uint16_t year() const { return get<uint16_t>(p, 4); }
+    uint8_t month() const { return p[6]; }
+    uint8_t day() const { return p[7]; }
+    uint8_t hour() const { return p[8]; }
+    uint8_t min() const { return p[9]; }
+    uint8_t sec() const { return p[10]; }
+    uint8_t valid() const { return p[11]; }
+    uint32_t t_acc() const { return get<uint32_t>(p, 12); }
+    int32_t nano() const { return get<int32_t>(p, 16); }
+    uint8_t fix_type() const { return p[20]; }
+    uint8_t flags() const { return p[21]; }
+    uint8_t flags2() const { return p[22]; }
+    uint8_t num_sv() const { return p[23]; }
+    int32_t lon() const { return get<int32_t>(p, 24); }
+    int32_t lat() const { return get<int32_t>(p, 28); }
+    int32_t height() const { return get<int32_t>(p, 32); }
+    int32_t h_msl() const { return get<int32_t>(p, 36); }
+    uint32_t h_acc() const { return get<uint32_t>(p, 40); }
+    uint32_t v_acc() const { return get<uint32_t>(p, 44); }
+    int32_t vel_n() const { return get<int32_t>(p, 48); }
+    int32_t vel_e() const { return get<int32_t>(p, 52); }
+    int32_t vel_d() const { return get<int32_t>(p, 56); }
+    int32_t g_speed() const { return get<int32_t>(p, 60); }
+    int32_t head_mot() const { return get<int32_t>(p, 64); }
+    int32_t s_acc() const { return get<int32_t>(p, 68); }
+    uint32_t head_acc() const { return get<uint32_t>(p, 72); }
+    uint16_t p_dop() const { return get<uint16_t>(p, 76); }
+    uint8_t flags3() const { return p[78]; }
+    int32_t head_veh() const { return get<int32_t>(p, 84); }
+    int16_t mag_dec() const { return get<int16_t>(p, 88); }
+    uint16_t mag_acc() const { return get<uint16_t>(p, 90); }
+    size_t size() const { return SIZE; }
+  };
+
+  struct RxmSfrbx {
+    static constexpr size_t SIZE = 8;
+    static constexpr size_t WORD_SIZE = 4;
+    const uint8_t *p;
+    uint8_t gnss_id() const { return p[0]; }
+    uint8_t sv_id() const { return p[1]; }
+    uint8_t freq_id() const { return p[3]; }
+    uint8_t num_words() const { return p[4]; }
+    uint8_t version() const { return p[6]; }
+    uint32_t body(int i) const { return get<uint32_t>(p, SIZE + i * WORD_SIZE); }
+    size_t size() const { return SIZE + num_words() * WORD_SIZE; }
+  };
+
+  struct RxmRawx {
+    static constexpr size_t SIZE = 16;
+    static constexpr size_t MEAS_SIZE = 32;
+    struct Measurement {
+      const uint8_t *p;
+      double pr_mes() const { return get<double>(p, 0); }
+      double cp_mes() const { return get<double>(p, 8); }
+      float do_mes() const { return get<float>(p, 16); }
+      uint8_t gnss_id() const { return p[20]; }
+      uint8_t sv_id() const { return p[21]; }
+      uint8_t freq_id() const { return p[23]; }
+      uint16_t lock_time() const { return get<uint16_t>(p, 24); }
+      uint8_t cno() const { return p[26]; }
+      uint8_t pr_stdev() const { return p[27]; }
+      uint8_t cp_stdev() const { return p[28]; }
+      uint8_t do_stdev() const { return p[29]; }
+      uint8_t trk_stat() const { return p[30]; }
+    };
+
+    const uint8_t *p;
+    double rcv_tow() const { return get<double>(p, 0); }
+    uint16_t week() const { return get<uint16_t>(p, 8); }
+    int8_t leap_s() const { return p[10]; }
+    uint8_t num_meas() const { return p[11]; }
+    uint8_t rec_stat() const { return p[12]; }
+    Measurement meas(int i) const { return {p + SIZE + i * MEAS_SIZE}; }
+    size_t size() const { return SIZE + num_meas() * MEAS_SIZE; }
+  };
+
+  struct MonHw {
+    static constexpr size_t SIZE = 60;
+    const uint8_t *p;
+    uint16_t noise_per_ms() const { return get<uint16_t>(p, 16); }
+    uint16_t agc_cnt() const { return get<uint16_t>(p, 18); }
+    uint8_t a_status() const { return p[20]; }
+    uint8_t a_power() const { return p[21]; }
+    uint8_t flags() const { return p[22]; }
+    uint32_t used_mask() const { return get<uint32_t>(p, 24); }
+    uint8_t jam_ind() const { return p[45]; }
+    size_t size() const { return SIZE; }
+  };
+
+  struct MonHw2 {
+    static constexpr size_t SIZE = 28;
+    enum ConfigSource : uint8_t {
+      CONFIG_SOURCE_FLASH = 102,
+      CONFIG_SOURCE_OTP = 111,
+      CONFIG_SOURCE_CONFIG_PINS = 112,
+      CONFIG_SOURCE_ROM = 113,
+    };
+
+    const uint8_t *p;
+    int8_t ofs_i() const { return p[0]; }
+    uint8_t mag_i() const { return p[1]; }
+    int8_t ofs_q() const { return p[2]; }
+    uint8_t mag_q() const { return p[3]; }
+    uint8_t cfg_source() const { return p[4]; }
+    uint32_t low_lev_cfg() const { return get<uint32_t>(p, 8); }
+    uint32_t post_status() const { return get<uint32_t>(p, 20); }
+    size_t size() const { return SIZE; }
+  };
+
+  struct NavSat {
+    static constexpr size_t SIZE = 8;
+    static constexpr size_t SV_SIZE = 12;
+    struct Sv {
+      const uint8_t *p;
+      uint8_t gnss_id() const { return p[0]; }
+      uint8_t sv_id() const { return p[1]; }
+      uint8_t cno() const { return p[2]; }
+      int8_t elev() const { return p[3]; }
+      int16_t azim() const { return get<int16_t>(p, 4); }
+      int16_t pr_res() const { return get<int16_t>(p, 6); }
+      uint32_t flags() const { return get<uint32_t>(p, 8); }
+    };
+
+    const uint8_t *p;
+    uint32_t itow() const { return get<uint32_t>(p, 0); }
+    uint8_t version() const { return p[4]; }
+    uint8_t num_svs() const { return p[5]; }
+    Sv svs(int i) const { return {p + SIZE + i * SV_SIZE}; }
+    size_t size() const { return SIZE + num_svs() * SV_SIZE; }
+  };
+
+  // true if the payload holds the whole message, including its repeated fields
+  template <class Msg>
+  inline bool payload_valid(const uint8_t *payload, size_t len) {
+    return len >= Msg::SIZE && len >= Msg{payload}.size();
+  }
+}